@@ -35,6 +35,8 @@
 #include "gstomxh263dec.h"
 #include "gstomxvp8dec.h"
 #include "gstomxtheoradec.h"
+#include "gstomxh265dec.h"
+#include "gstomxh265enc.h"
 #include "gstomxwmvdec.h"
 #include "gstomxmpeg4videoenc.h"
 #include "gstomxh264enc.h"
@@ -43,12 +45,19 @@
 #include "gstomxmp3dec.h"
 #include "gstomxaacenc.h"
 #include "gstomxamrdec.h"
+#include "gstomxmultidec.h"
+#include "gstomxsimulcastenc.h"
 #include "gstomxanalogaudiosink.h"
 #include "gstomxhdmiaudiosink.h"
 
 GST_DEBUG_CATEGORY (gstomx_debug);
 #define GST_CAT_DEFAULT gstomx_debug
 
+/* Initial and maximum number of buffers allocated on top of
+ * nBufferCountMin for ports that wrap their buffers */
+#define GST_OMX_PORT_WRAP_EXTRA_BUFFERS 4
+#define GST_OMX_PORT_WRAP_MAX_EXTRA_BUFFERS 16
+
 G_LOCK_DEFINE_STATIC (core_handles);
 static GHashTable *core_handles;
 
@@ -955,6 +964,7 @@ gst_omx_component_add_port (GstOMXComponent * comp, guint32 index)
   port->enabled_pending = FALSE;
   port->disabled_pending = FALSE;
   port->eos = FALSE;
+  port->wrap_extra_buffers = GST_OMX_PORT_WRAP_EXTRA_BUFFERS;
 
   if (port->port_def.eDir == OMX_DirInput)
     comp->n_in_ports++;
@@ -1084,6 +1094,25 @@ gst_omx_component_set_config (GstOMXComponent * comp, OMX_INDEXTYPE index,
   return err;
 }
 
+OMX_ERRORTYPE
+gst_omx_component_get_extension_index (GstOMXComponent * comp,
+    const gchar * name, OMX_INDEXTYPE * index)
+{
+  OMX_ERRORTYPE err;
+
+  g_return_val_if_fail (comp != NULL, OMX_ErrorUndefined);
+  g_return_val_if_fail (name != NULL, OMX_ErrorUndefined);
+  g_return_val_if_fail (index != NULL, OMX_ErrorUndefined);
+
+  GST_DEBUG_OBJECT (comp->parent, "Getting %s extension index for %s",
+      comp->name, name);
+  err = OMX_GetExtensionIndex (comp->handle, (OMX_STRING) name, index);
+  GST_DEBUG_OBJECT (comp->parent, "Got %s extension index for %s: %s "
+      "(0x%08x)", comp->name, name, gst_omx_error_to_string (err), err);
+
+  return err;
+}
+
 OMX_ERRORTYPE
 gst_omx_setup_tunnel (GstOMXPort * port1, GstOMXPort * port2)
 {
@@ -1388,6 +1417,166 @@ done:
   return ret;
 }
 
+/* Output buffers wrapped into GstMemory by gst_omx_port_wrap_buffer() */
+typedef struct
+{
+  /* NULL if the port deallocated the buffer before downstream
+   * freed the memory, wrap_lock */
+  GstOMXBuffer *buf;
+  /* The wrapped host memory, owned by us after the buffer was
+   * deallocated, wrap_lock */
+  gpointer data;
+} GstOMXWrappedBuffer;
+
+/* Protects GstOMXWrappedBuffer, GstOMXBuffer::wrapped and
+ * GstOMXBuffer::wrap_data. GstOMXPort::n_wrapped is only changed with it
+ * held, atomically as it is also read with only comp->lock.
+ * Locking order: wrap_lock -> comp->lock */
+static GMutex wrap_lock;
+
+static void
+gst_omx_wrapped_buffer_free (GstOMXWrappedBuffer * wrapped)
+{
+  g_mutex_lock (&wrap_lock);
+  if (wrapped->buf) {
+    GstOMXBuffer *buf = wrapped->buf;
+    GstOMXPort *port = buf->port;
+
+    buf->wrapped = NULL;
+    gst_omx_port_release_buffer (port, buf);
+    g_atomic_int_add (&port->n_wrapped, -1);
+  } else {
+    g_free (wrapped->data);
+  }
+  g_mutex_unlock (&wrap_lock);
+
+  g_slice_free (GstOMXWrappedBuffer, wrapped);
+}
+
+/* Makes the buffers of the output @port wrappable by
+ * gst_omx_port_wrap_buffer(). They are then allocated in host memory
+ * that stays valid until downstream freed it, even if the port
+ * deallocates the buffers before. @port also gets a few more buffers than
+ * the component needs as downstream holds on to them for a while. That
+ * margin doubles whenever wrapping failed because all of them were in
+ * use. Must be called while @port is disabled or the component is in
+ * Loaded state, the changes take effect with the next allocation. */
+void
+gst_omx_port_set_wrap_buffers (GstOMXPort * port, gboolean wrap)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+  OMX_ERRORTYPE err;
+  guint n;
+
+  g_return_if_fail (port != NULL);
+  g_return_if_fail (port->port_def.eDir == OMX_DirOutput);
+
+  port->wrap_buffers = wrap;
+  if (!wrap)
+    return;
+
+  /* Had to copy with the previous buffers, try with more */
+  if (port->wrap_starved) {
+    port->wrap_extra_buffers = MIN (port->wrap_extra_buffers * 2,
+        GST_OMX_PORT_WRAP_MAX_EXTRA_BUFFERS);
+    port->wrap_starved = FALSE;
+  }
+
+  gst_omx_port_get_port_definition (port, &port_def);
+  n = port_def.nBufferCountMin + port->wrap_extra_buffers;
+  if (port_def.nBufferCountActual >= n)
+    return;
+
+  port_def.nBufferCountActual = n;
+  err = gst_omx_port_update_port_definition (port, &port_def);
+  if (err != OMX_ErrorNone)
+    GST_WARNING_OBJECT (port->comp->parent, "Failed to configure %u buffers "
+        "for %s port %u: %s (0x%08x)", n, port->comp->name, port->index,
+        gst_omx_error_to_string (err), err);
+  else
+    GST_DEBUG_OBJECT (port->comp->parent, "Using %u buffers for %s port %u",
+        (guint) port->port_def.nBufferCountActual, port->comp->name,
+        port->index);
+}
+
+/* Wraps the filled region of an acquired output buffer in a GstBuffer
+ * without copying. The ownership of @buf is passed to the returned
+ * GstBuffer and it is released back to the port once the memory is
+ * freed. Returns NULL if @port doesn't wrap its buffers or if this would
+ * leave the component with fewer than nBufferCountMin buffers, the
+ * caller has to copy and release @buf then. */
+GstBuffer *
+gst_omx_port_wrap_buffer (GstOMXPort * port, GstOMXBuffer * buf)
+{
+  GstOMXWrappedBuffer *wrapped;
+  GstBuffer *outbuf;
+  GstMemory *mem;
+
+  g_return_val_if_fail (port != NULL, NULL);
+  g_return_val_if_fail (port->port_def.eDir == OMX_DirOutput, NULL);
+  g_return_val_if_fail (buf != NULL, NULL);
+  g_return_val_if_fail (buf->port == port, NULL);
+
+  if (!buf->wrap_data)
+    return NULL;
+
+  g_mutex_lock (&wrap_lock);
+  if (!port->buffers
+      || port->buffers->len < port->n_wrapped + 1 +
+      port->port_def.nBufferCountMin) {
+    GST_LOG_OBJECT (port->comp->parent, "%u of %u buffers of %s port %u "
+        "are used downstream, not wrapping", port->n_wrapped,
+        port->buffers ? port->buffers->len : 0, port->comp->name, port->index);
+    port->wrap_starved = TRUE;
+    g_mutex_unlock (&wrap_lock);
+    return NULL;
+  }
+
+  wrapped = g_slice_new (GstOMXWrappedBuffer);
+  wrapped->buf = buf;
+  wrapped->data = buf->wrap_data;
+  buf->wrapped = wrapped;
+  g_atomic_int_inc (&port->n_wrapped);
+  g_mutex_unlock (&wrap_lock);
+
+  mem = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+      buf->wrap_data, buf->omx_buf->nAllocLen, buf->omx_buf->nOffset,
+      buf->omx_buf->nFilledLen, wrapped,
+      (GDestroyNotify) gst_omx_wrapped_buffer_free);
+
+  outbuf = gst_buffer_new ();
+  gst_buffer_append_memory (outbuf, mem);
+
+  GST_LOG_OBJECT (port->comp->parent, "Wrapped buffer %p (%p) of %s port %u",
+      buf, buf->omx_buf->pBuffer, port->comp->name, port->index);
+
+  return outbuf;
+}
+
+/* Returns a GstBuffer with the filled region of the acquired output
+ * buffer @buf. The data is wrapped with gst_omx_port_wrap_buffer() if
+ * possible, @wrapped is set to TRUE then and @buf must not be released
+ * anymore. Otherwise the data is copied. */
+GstBuffer *
+gst_omx_port_wrap_or_copy_buffer (GstOMXPort * port, GstOMXBuffer * buf,
+    gboolean * wrapped)
+{
+  GstBuffer *outbuf;
+
+  g_return_val_if_fail (wrapped != NULL, NULL);
+
+  outbuf = gst_omx_port_wrap_buffer (port, buf);
+  *wrapped = outbuf != NULL;
+  if (outbuf)
+    return outbuf;
+
+  outbuf = gst_buffer_new_and_alloc (buf->omx_buf->nFilledLen);
+  gst_buffer_fill (outbuf, 0, buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
+      buf->omx_buf->nFilledLen);
+
+  return outbuf;
+}
+
 /* NOTE: Uses comp->lock and comp->messages_lock */
 OMX_ERRORTYPE
 gst_omx_port_release_buffer (GstOMXPort * port, GstOMXBuffer * buf)
@@ -1579,6 +1768,108 @@ done:
   return err;
 }
 
+/* Sets all @ports of @comp to flushing and flushes them. Unlike calling
+ * gst_omx_port_set_flushing() for every port, the flush commands are sent
+ * to all ports first and are then waited for together, so the component
+ * can flush the ports in parallel.
+ *
+ * Unflushing still happens with gst_omx_port_set_flushing().
+ *
+ * NOTE: Uses comp->lock and comp->messages_lock */
+OMX_ERRORTYPE
+gst_omx_component_flush_ports (GstOMXComponent * comp, GstOMXPort ** ports,
+    guint n_ports, GstClockTime timeout)
+{
+  OMX_ERRORTYPE err = OMX_ErrorNone;
+  gboolean signalled, pending;
+  guint i;
+
+  g_return_val_if_fail (comp != NULL, OMX_ErrorUndefined);
+  g_return_val_if_fail (ports != NULL || n_ports == 0, OMX_ErrorUndefined);
+
+  g_mutex_lock (&comp->lock);
+
+  GST_DEBUG_OBJECT (comp->parent, "Flushing %u ports of %s", n_ports,
+      comp->name);
+
+  gst_omx_component_handle_messages (comp);
+
+  if ((err = comp->last_error) != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent, "Component %s is in error state: %s "
+        "(0x%08x)", comp->name, gst_omx_error_to_string (err), err);
+    goto done;
+  }
+
+  for (i = 0; i < n_ports; i++) {
+    g_assert (ports[i]->comp == comp);
+    ports[i]->flushing = TRUE;
+    ports[i]->flushed = FALSE;
+  }
+
+  /* Wake up everybody waiting for buffers */
+  gst_omx_component_send_message (comp, NULL);
+
+  for (i = 0; i < n_ports; i++) {
+    err = OMX_SendCommand (comp->handle, OMX_CommandFlush, ports[i]->index,
+        NULL);
+
+    if (err != OMX_ErrorNone) {
+      GST_ERROR_OBJECT (comp->parent,
+          "Error sending flush command to %s port %u: %s (0x%08x)", comp->name,
+          ports[i]->index, gst_omx_error_to_string (err), err);
+      goto done;
+    }
+  }
+
+  /* Wait until all flush commands completed or all buffers of each
+   * port were released by the component */
+  signalled = TRUE;
+  gst_omx_component_handle_messages (comp);
+  do {
+    pending = FALSE;
+    for (i = 0; i < n_ports; i++) {
+      GstOMXPort *port = ports[i];
+
+      if (!port->flushed && port->buffers
+          && port->buffers->len > g_queue_get_length (&port->pending_buffers))
+        pending = TRUE;
+    }
+
+    if (!pending || comp->last_error != OMX_ErrorNone)
+      break;
+
+    signalled = gst_omx_component_wait_message (comp, timeout);
+    if (signalled)
+      gst_omx_component_handle_messages (comp);
+  } while (signalled);
+
+  for (i = 0; i < n_ports; i++) {
+    ports[i]->flushed = FALSE;
+    ports[i]->eos = FALSE;
+  }
+
+  if ((err = comp->last_error) != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (comp->parent,
+        "Got error while flushing %s ports: %s (0x%08x)", comp->name,
+        gst_omx_error_to_string (err), err);
+  } else if (!signalled) {
+    GST_ERROR_OBJECT (comp->parent, "Timeout while flushing %s ports",
+        comp->name);
+    err = OMX_ErrorTimeout;
+  }
+
+done:
+  for (i = 0; i < n_ports; i++)
+    gst_omx_port_update_port_definition (ports[i], NULL);
+
+  GST_DEBUG_OBJECT (comp->parent, "Flushed %u ports of %s: %s (0x%08x)",
+      n_ports, comp->name, gst_omx_error_to_string (err), err);
+  gst_omx_component_handle_messages (comp);
+  g_mutex_unlock (&comp->lock);
+
+  return err;
+}
+
 /* NOTE: Uses comp->lock and comp->messages_lock */
 gboolean
 gst_omx_port_is_flushing (GstOMXPort * port)
@@ -1664,6 +1955,25 @@ gst_omx_port_allocate_buffers_unlocked (GstOMXPort * port,
           OMX_UseBuffer (comp->handle, &buf->omx_buf, port->index, buf,
           port->port_def.nBufferSize, l->data);
       buf->eglimage = FALSE;
+    } else if (port->wrap_buffers) {
+      /* Our own memory, so that wrapped buffers can outlive the port */
+      buf->wrap_data = g_malloc (port->port_def.nBufferSize);
+      err =
+          OMX_UseBuffer (comp->handle, &buf->omx_buf, port->index, buf,
+          port->port_def.nBufferSize, buf->wrap_data);
+      buf->eglimage = FALSE;
+
+      if (err != OMX_ErrorNone && i == 0) {
+        GST_WARNING_OBJECT (comp->parent, "%s port %u can't use our memory, "
+            "not wrapping its buffers: %s (0x%08x)", comp->name, port->index,
+            gst_omx_error_to_string (err), err);
+        g_free (buf->wrap_data);
+        buf->wrap_data = NULL;
+        port->wrap_buffers = FALSE;
+        err =
+            OMX_AllocateBuffer (comp->handle, &buf->omx_buf, port->index, buf,
+            port->port_def.nBufferSize);
+      }
     } else if (images) {
       err =
           OMX_UseEGLImage (comp->handle, &buf->omx_buf, port->index, buf,
@@ -1820,6 +2130,8 @@ gst_omx_port_deallocate_buffers_unlocked (GstOMXPort * port)
           err = tmp;
       }
     }
+    /* NULL if it's still wrapped, freed with the memory then */
+    g_free (buf->wrap_data);
     g_slice_free (GstOMXBuffer, buf);
   }
   g_queue_clear (&port->pending_buffers);
@@ -1845,9 +2157,31 @@ gst_omx_port_deallocate_buffers (GstOMXPort * port)
 
   g_return_val_if_fail (port != NULL, OMX_ErrorUndefined);
 
+  g_mutex_lock (&wrap_lock);
+  if (port->n_wrapped > 0 && port->buffers) {
+    guint i;
+
+    /* The memory of buffers that are still used downstream is freed
+     * together with the GstMemory wrapping it */
+    GST_DEBUG_OBJECT (port->comp->parent, "%u buffers of %s port %u are "
+        "still used downstream", port->n_wrapped, port->comp->name,
+        port->index);
+    for (i = 0; i < port->buffers->len; i++) {
+      GstOMXBuffer *buf = g_ptr_array_index (port->buffers, i);
+
+      if (buf->wrapped) {
+        ((GstOMXWrappedBuffer *) buf->wrapped)->buf = NULL;
+        buf->wrapped = NULL;
+        buf->wrap_data = NULL;
+      }
+    }
+    g_atomic_int_set (&port->n_wrapped, 0);
+  }
+
   g_mutex_lock (&port->comp->lock);
   err = gst_omx_port_deallocate_buffers_unlocked (port);
   g_mutex_unlock (&port->comp->lock);
+  g_mutex_unlock (&wrap_lock);
 
   return err;
 }
@@ -1945,10 +2279,13 @@ gst_omx_port_wait_buffers_released_unlocked (GstOMXPort * port,
   GST_INFO_OBJECT (comp->parent, "Waiting for %s port %u to release all "
       "buffers", comp->name, port->index);
 
+  /* Buffers wrapped in memory that is used downstream are not owned by the
+   * component, they can be deallocated in any case */
   if (timeout == 0) {
     if (!port->flushed || (port->buffers
             && port->buffers->len >
-            g_queue_get_length (&port->pending_buffers)))
+            g_queue_get_length (&port->pending_buffers) +
+            g_atomic_int_get (&port->n_wrapped)))
       err = OMX_ErrorTimeout;
     goto done;
   }
@@ -1959,7 +2296,8 @@ gst_omx_port_wait_buffers_released_unlocked (GstOMXPort * port,
   gst_omx_component_handle_messages (comp);
   while (signalled && last_error == OMX_ErrorNone && (port->buffers
           && port->buffers->len >
-          g_queue_get_length (&port->pending_buffers))) {
+          g_queue_get_length (&port->pending_buffers) +
+          g_atomic_int_get (&port->n_wrapped))) {
     signalled = gst_omx_component_wait_message (comp, timeout);
     if (signalled)
       gst_omx_component_handle_messages (comp);
@@ -2276,13 +2614,17 @@ static const GGetTypeFunction types[] = {
   gst_omx_h264_enc_get_type, gst_omx_h263_enc_get_type,
   gst_omx_aac_enc_get_type, gst_omx_mjpeg_dec_get_type,
   gst_omx_aac_dec_get_type, gst_omx_mp3_dec_get_type,
-  gst_omx_amr_dec_get_type
+  gst_omx_amr_dec_get_type, gst_omx_multi_dec_get_type,
+  gst_omx_simulcast_enc_get_type
 #ifdef HAVE_VP8
       , gst_omx_vp8_dec_get_type
 #endif
 #ifdef HAVE_THEORA
       , gst_omx_theora_dec_get_type
 #endif
+#ifdef HAVE_HEVC
+      , gst_omx_h265_dec_get_type, gst_omx_h265_enc_get_type
+#endif
 };
 
 struct TypeOffest
@@ -2297,6 +2639,9 @@ static const struct TypeOffest base_types[] = {
   {gst_omx_video_enc_get_type, G_STRUCT_OFFSET (GstOMXVideoEncClass, cdata)},
   {gst_omx_audio_dec_get_type, G_STRUCT_OFFSET (GstOMXAudioDecClass, cdata)},
   {gst_omx_audio_enc_get_type, G_STRUCT_OFFSET (GstOMXAudioEncClass, cdata)},
+  {gst_omx_multi_dec_get_type, G_STRUCT_OFFSET (GstOMXMultiDecClass, cdata)},
+  {gst_omx_simulcast_enc_get_type,
+      G_STRUCT_OFFSET (GstOMXSimulcastEncClass, cdata)},
 };
 
 static GKeyFile *config = NULL;
@@ -2522,12 +2867,11 @@ _class_init (gpointer g_class, gpointer data)
   gchar *template_caps;
   GstPadTemplate *templ;
   GstCaps *caps;
+  gboolean multi, split;
   gchar **hacks;
+  gint latency;
   int i;
 
-  if (!element_name)
-    return;
-
   /* Find the GstOMXClassData for this class */
   for (i = 0; i < G_N_ELEMENTS (base_types); i++) {
     GType gtype = base_types[i].get_type ();
@@ -2541,6 +2885,12 @@ _class_init (gpointer g_class, gpointer data)
 
   g_assert (class_data != NULL);
 
+  /* Unknown unless configured below */
+  class_data->latency = GST_CLOCK_TIME_NONE;
+
+  if (!element_name)
+    return;
+
   config = gst_omx_get_configuration ();
 
   /* This will alwaxys succeed, see check in plugin_init */
@@ -2586,6 +2936,8 @@ _class_init (gpointer g_class, gpointer data)
   class_data->out_port_index = out_port_index;
 
   /* Add pad templates */
+  multi = class_data->type == GST_OMX_COMPONENT_TYPE_MULTI_FILTER;
+  split = class_data->type == GST_OMX_COMPONENT_TYPE_SPLIT_FILTER;
   err = NULL;
   if (class_data->type != GST_OMX_COMPONENT_TYPE_SOURCE) {
     if (!(template_caps =
@@ -2608,7 +2960,12 @@ _class_init (gpointer g_class, gpointer data)
         g_assert (caps != NULL);
       }
     }
-    templ = gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps);
+    if (multi)
+      templ =
+          gst_pad_template_new ("sink_%u", GST_PAD_SINK, GST_PAD_REQUEST,
+          caps);
+    else
+      templ = gst_pad_template_new ("sink", GST_PAD_SINK, GST_PAD_ALWAYS, caps);
     g_free (template_caps);
     gst_element_class_add_pad_template (element_class, templ);
   }
@@ -2634,7 +2991,11 @@ _class_init (gpointer g_class, gpointer data)
         g_assert (caps != NULL);
       }
     }
-    templ = gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps);
+    if (multi || split)
+      templ =
+          gst_pad_template_new ("src_%u", GST_PAD_SRC, GST_PAD_SOMETIMES, caps);
+    else
+      templ = gst_pad_template_new ("src", GST_PAD_SRC, GST_PAD_ALWAYS, caps);
     g_free (template_caps);
     gst_element_class_add_pad_template (element_class, templ);
   }
@@ -2654,6 +3015,17 @@ _class_init (gpointer g_class, gpointer data)
     class_data->hacks = gst_omx_parse_hacks (hacks);
     g_strfreev (hacks);
   }
+
+  /* Static latency in milliseconds, used until it was measured */
+  err = NULL;
+  latency = g_key_file_get_integer (config, element_name, "latency", &err);
+  if (err != NULL || latency < 0) {
+    if (err)
+      g_error_free (err);
+  } else {
+    GST_DEBUG ("Using latency %d ms for element '%s'", latency, element_name);
+    class_data->latency = latency * GST_MSECOND;
+  }
 }
 
 static gboolean
@@ -191,7 +191,11 @@ typedef enum {
 typedef enum {
   GST_OMX_COMPONENT_TYPE_SINK,
   GST_OMX_COMPONENT_TYPE_SOURCE,
-  GST_OMX_COMPONENT_TYPE_FILTER
+  GST_OMX_COMPONENT_TYPE_FILTER,
+  /* Filter with request sink pads and one source pad per sink pad */
+  GST_OMX_COMPONENT_TYPE_MULTI_FILTER,
+  /* Filter with one sink pad and several source pads */
+  GST_OMX_COMPONENT_TYPE_SPLIT_FILTER
 } GstOmxComponentType;
 
 struct _GstOMXMessage {
@@ -248,6 +252,16 @@ struct _GstOMXPort {
    */
   gint settings_cookie;
   gint configured_settings_cookie;
+
+  /* Number of buffers wrapped by gst_omx_port_wrap_buffer()
+   * that were not freed downstream yet */
+  guint n_wrapped;
+  /* Set by gst_omx_port_set_wrap_buffers() */
+  gboolean wrap_buffers;
+  /* Buffers allocated on top of nBufferCountMin if wrap_buffers is set,
+   * wrap_starved is set when wrapping failed because all were used */
+  guint wrap_extra_buffers;
+  gboolean wrap_starved;
 };
 
 struct _GstOMXComponent {
@@ -297,6 +311,11 @@ struct _GstOMXBuffer {
 
   /* TRUE if this is an EGLImage */
   gboolean eglimage;
+
+  /* Set while the buffer is wrapped in memory used downstream */
+  gpointer wrapped;
+  /* Host memory used by the component if the port wraps its buffers */
+  gpointer wrap_data;
 };
 
 struct _GstOMXClassData {
@@ -311,6 +330,9 @@ struct _GstOMXClassData {
 
   guint64 hacks;
 
+  /* Static latency of the component, GST_CLOCK_TIME_NONE if unknown */
+  GstClockTime latency;
+
   GstOmxComponentType type;
 };
 
@@ -344,6 +366,8 @@ OMX_ERRORTYPE     gst_omx_component_set_parameter (GstOMXComponent * comp, OMX_I
 OMX_ERRORTYPE     gst_omx_component_get_config (GstOMXComponent * comp, OMX_INDEXTYPE index, gpointer config);
 OMX_ERRORTYPE     gst_omx_component_set_config (GstOMXComponent * comp, OMX_INDEXTYPE index, gpointer config);
 
+OMX_ERRORTYPE     gst_omx_component_get_extension_index (GstOMXComponent * comp, const gchar * name, OMX_INDEXTYPE * index);
+
 OMX_ERRORTYPE     gst_omx_setup_tunnel (GstOMXPort * port1, GstOMXPort * port2);
 OMX_ERRORTYPE     gst_omx_close_tunnel (GstOMXPort * port1, GstOMXPort * port2);
 
@@ -353,9 +377,13 @@ OMX_ERRORTYPE     gst_omx_port_update_port_definition (GstOMXPort *port, OMX_PAR
 
 GstOMXAcquireBufferReturn gst_omx_port_acquire_buffer (GstOMXPort *port, GstOMXBuffer **buf);
 OMX_ERRORTYPE     gst_omx_port_release_buffer (GstOMXPort *port, GstOMXBuffer *buf);
+void              gst_omx_port_set_wrap_buffers (GstOMXPort *port, gboolean wrap);
+GstBuffer *       gst_omx_port_wrap_buffer (GstOMXPort *port, GstOMXBuffer *buf);
+GstBuffer *       gst_omx_port_wrap_or_copy_buffer (GstOMXPort *port, GstOMXBuffer *buf, gboolean *wrapped);
 
 OMX_ERRORTYPE     gst_omx_port_set_flushing (GstOMXPort *port, GstClockTime timeout, gboolean flush);
 gboolean          gst_omx_port_is_flushing (GstOMXPort *port);
+OMX_ERRORTYPE     gst_omx_component_flush_ports (GstOMXComponent * comp, GstOMXPort ** ports, guint n_ports, GstClockTime timeout);
 
 OMX_ERRORTYPE     gst_omx_port_allocate_buffers (GstOMXPort *port);
 OMX_ERRORTYPE     gst_omx_port_use_buffers (GstOMXPort *port, const GList *buffers);
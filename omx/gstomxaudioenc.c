@@ -32,6 +32,10 @@ GST_DEBUG_CATEGORY_STATIC (gst_omx_audio_enc_debug_category);
 
 /* prototypes */
 static void gst_omx_audio_enc_finalize (GObject * object);
+static void gst_omx_audio_enc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_omx_audio_enc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
 
 static GstStateChangeReturn
 gst_omx_audio_enc_change_state (GstElement * element,
@@ -51,9 +55,12 @@ static GstFlowReturn gst_omx_audio_enc_drain (GstOMXAudioEnc * self);
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_ZERO_COPY_OUTPUT
 };
 
+#define GST_OMX_AUDIO_ENC_ZERO_COPY_OUTPUT_DEFAULT (FALSE)
+
 /* class initialization */
 #define do_init \
 { \
@@ -73,6 +80,17 @@ gst_omx_audio_enc_class_init (GstOMXAudioEncClass * klass)
   GstAudioEncoderClass *audio_encoder_class = GST_AUDIO_ENCODER_CLASS (klass);
 
   gobject_class->finalize = gst_omx_audio_enc_finalize;
+  gobject_class->set_property = gst_omx_audio_enc_set_property;
+  gobject_class->get_property = gst_omx_audio_enc_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_ZERO_COPY_OUTPUT,
+      g_param_spec_boolean ("zero-copy-output", "Zero-copy Output",
+          "Push the encoded data in the component's output buffers instead "
+          "of copying it, falls back to copying if downstream holds on to "
+          "too many buffers",
+          GST_OMX_AUDIO_ENC_ZERO_COPY_OUTPUT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
 
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_omx_audio_enc_change_state);
@@ -98,10 +116,44 @@ gst_omx_audio_enc_class_init (GstOMXAudioEncClass * klass)
 static void
 gst_omx_audio_enc_init (GstOMXAudioEnc * self)
 {
+  self->zero_copy_output = GST_OMX_AUDIO_ENC_ZERO_COPY_OUTPUT_DEFAULT;
+
   g_mutex_init (&self->drain_lock);
   g_cond_init (&self->drain_cond);
 }
 
+static void
+gst_omx_audio_enc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXAudioEnc *self = GST_OMX_AUDIO_ENC (object);
+
+  switch (prop_id) {
+    case PROP_ZERO_COPY_OUTPUT:
+      self->zero_copy_output = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_audio_enc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXAudioEnc *self = GST_OMX_AUDIO_ENC (object);
+
+  switch (prop_id) {
+    case PROP_ZERO_COPY_OUTPUT:
+      g_value_set_boolean (value, self->zero_copy_output);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static gboolean
 gst_omx_audio_enc_open (GstAudioEncoder * encoder)
 {
@@ -281,6 +333,7 @@ gst_omx_audio_enc_loop (GstOMXAudioEnc * self)
   GstOMXBuffer *buf = NULL;
   GstFlowReturn flow_ret = GST_FLOW_OK;
   GstOMXAcquireBufferReturn acq_return;
+  gboolean wrapped = FALSE;
   OMX_ERRORTYPE err;
 
   klass = GST_OMX_AUDIO_ENC_GET_CLASS (self);
@@ -346,6 +399,9 @@ gst_omx_audio_enc_loop (GstOMXAudioEnc * self)
     GST_AUDIO_ENCODER_STREAM_UNLOCK (self);
 
     if (acq_return == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
+      gst_omx_port_set_wrap_buffers (self->enc_out_port,
+          self->zero_copy_output);
+
       err = gst_omx_port_set_enabled (port, TRUE);
       if (err != OMX_ErrorNone)
         goto reconfigure_error;
@@ -425,7 +481,7 @@ gst_omx_audio_enc_loop (GstOMXAudioEnc * self)
     gst_caps_unref (caps);
     flow_ret = GST_FLOW_OK;
   } else if (buf->omx_buf->nFilledLen > 0) {
-    GstBuffer *outbuf;
+    GstBuffer *outbuf = NULL;
     guint n_samples;
 
     GST_DEBUG_OBJECT (self, "Handling output data");
@@ -434,20 +490,7 @@ gst_omx_audio_enc_loop (GstOMXAudioEnc * self)
         klass->get_num_samples (self, self->enc_out_port,
         gst_audio_encoder_get_audio_info (GST_AUDIO_ENCODER (self)), buf);
 
-    if (buf->omx_buf->nFilledLen > 0) {
-      GstMapInfo map = GST_MAP_INFO_INIT;
-      outbuf = gst_buffer_new_and_alloc (buf->omx_buf->nFilledLen);
-
-      gst_buffer_map (outbuf, &map, GST_MAP_WRITE);
-
-      memcpy (map.data,
-          buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
-          buf->omx_buf->nFilledLen);
-      gst_buffer_unmap (outbuf, &map);
-
-    } else {
-      outbuf = gst_buffer_new ();
-    }
+    outbuf = gst_omx_port_wrap_or_copy_buffer (port, buf, &wrapped);
 
     GST_BUFFER_TIMESTAMP (outbuf) =
         gst_util_uint64_scale (GST_OMX_GET_TICKS (buf->omx_buf->nTimeStamp),
@@ -466,9 +509,12 @@ gst_omx_audio_enc_loop (GstOMXAudioEnc * self)
 
   GST_DEBUG_OBJECT (self, "Finished frame: %s", gst_flow_get_name (flow_ret));
 
-  err = gst_omx_port_release_buffer (port, buf);
-  if (err != OMX_ErrorNone)
-    goto release_error;
+  /* Otherwise it's released once downstream doesn't need it anymore */
+  if (!wrapped) {
+    err = gst_omx_port_release_buffer (port, buf);
+    if (err != OMX_ErrorNone)
+      goto release_error;
+  }
 
   self->downstream_flow_ret = flow_ret;
 
@@ -797,6 +843,9 @@ gst_omx_audio_enc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
           NULL) != OMX_ErrorNone)
     return FALSE;
 
+  gst_omx_port_set_wrap_buffers (self->enc_out_port,
+      self->zero_copy_output);
+
   GST_DEBUG_OBJECT (self, "Enabling component");
   if (needs_disable) {
     if (gst_omx_port_set_enabled (self->enc_in_port, TRUE) != OMX_ErrorNone)
@@ -980,6 +1029,9 @@ gst_omx_audio_enc_handle_frame (GstAudioEncoder * encoder, GstBuffer * inbuf)
         goto reconfigure_error;
       }
 
+      gst_omx_port_set_wrap_buffers (self->enc_out_port,
+          self->zero_copy_output);
+
       err = gst_omx_port_set_enabled (port, TRUE);
       if (err != OMX_ErrorNone) {
         GST_AUDIO_ENCODER_STREAM_LOCK (self);
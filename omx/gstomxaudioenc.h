@@ -66,6 +66,9 @@ struct _GstOMXAudioEnc
   /* TRUE if EOS buffers shouldn't be forwarded */
   gboolean draining;
 
+  /* properties */
+  gboolean zero_copy_output;
+
   GstFlowReturn downstream_flow_ret;
 };
 
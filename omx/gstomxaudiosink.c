@@ -29,6 +29,10 @@
 
 #include <math.h>
 
+#if defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "gstomxaudiosink.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_omx_audio_sink_debug_category);
@@ -53,156 +57,233 @@ enum
 
 #define gst_omx_audio_sink_parent_class parent_class
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE (GstOMXAudioSink, gst_omx_audio_sink,
-    GST_TYPE_AUDIO_SINK, G_IMPLEMENT_INTERFACE (GST_TYPE_STREAM_VOLUME, NULL);
+    GST_TYPE_AUDIO_BASE_SINK,
+    G_IMPLEMENT_INTERFACE (GST_TYPE_STREAM_VOLUME, NULL);
     DEBUG_INIT);
 
-#define transform_3_4(type) \
-static inline void \
-transform_3_4_##type (gpointer psrc, gpointer pdst, guint len) \
-{ \
-  g##type *src = (g##type *) psrc; \
-  g##type *dst = (g##type *) pdst; \
-  for (; len > 0; len--) { \
-    dst[0] = src[0]; \
-    dst[1] = src[1]; \
-    dst[2] = src[2]; \
-    dst[3] = 0; \
-    src += 3; \
-    dst += 4; \
-  } \
+/* Converters from the negotiated layout to the one of the component. Every
+ * layout gets its own function, picked once in prepare, so that the channel
+ * counts are constants the compiler can unroll.
+ *
+ * With NEON a frame is padded with one masked vector load and store. The
+ * load reads out - in samples of the next frame, the last frame is always
+ * converted by the scalar code. */
+#if defined (__ARM_NEON__) || defined (__ARM_NEON)
+#define USE_NEON_TRANSFORM 1
+#endif
+
+#ifdef USE_NEON_TRANSFORM
+static const guint16 lanes16[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+static const guint32 lanes32[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+
+static inline guint
+pad_frames_int16_neon (const gint16 ** psrc, gint16 ** pdst, guint len,
+    guint in, guint out)
+{
+  const gint16 *src = *psrc;
+  gint16 *dst = *pdst;
+
+  if (out == 8) {
+    uint16x8_t mask = vcltq_u16 (vld1q_u16 (lanes16), vdupq_n_u16 (in));
+
+    for (; len > 1; len--) {
+      uint16x8_t v = vreinterpretq_u16_s16 (vld1q_s16 (src));
+
+      vst1q_s16 (dst, vreinterpretq_s16_u16 (vandq_u16 (v, mask)));
+      src += in;
+      dst += out;
+    }
+  } else if (out == 4) {
+    uint16x4_t mask = vclt_u16 (vld1_u16 (lanes16), vdup_n_u16 (in));
+
+    for (; len > 1; len--) {
+      uint16x4_t v = vreinterpret_u16_s16 (vld1_s16 (src));
+
+      vst1_s16 (dst, vreinterpret_s16_u16 (vand_u16 (v, mask)));
+      src += in;
+      dst += out;
+    }
+  }
+
+  *psrc = src;
+  *pdst = dst;
+  return len;
 }
 
-#define transform_5_8(type) \
-static inline void \
-transform_5_8_##type (gpointer psrc, gpointer pdst, guint len) \
-{ \
-  g##type *src = (g##type *) psrc; \
-  g##type *dst = (g##type *) pdst; \
-  for (; len > 0; len--) { \
-    dst[0] = src[0]; \
-    dst[1] = src[1]; \
-    dst[2] = src[2]; \
-    dst[3] = src[3]; \
-    dst[4] = src[4]; \
-    dst[5] = 0; \
-    dst[6] = 0; \
-    dst[7] = 0; \
-    src += 5; \
-    dst += 8; \
-  } \
+static inline guint
+pad_frames_int32_neon (const gint32 ** psrc, gint32 ** pdst, guint len,
+    guint in, guint out)
+{
+  const gint32 *src = *psrc;
+  gint32 *dst = *pdst;
+  uint32x4_t mask_lo = vcltq_u32 (vld1q_u32 (lanes32), vdupq_n_u32 (in));
+  uint32x4_t mask_hi = vcltq_u32 (vld1q_u32 (lanes32 + 4), vdupq_n_u32 (in));
+
+  for (; len > 1; len--) {
+    uint32x4_t v = vreinterpretq_u32_s32 (vld1q_s32 (src));
+
+    vst1q_s32 (dst, vreinterpretq_s32_u32 (vandq_u32 (v, mask_lo)));
+    if (out == 8) {
+      v = vreinterpretq_u32_s32 (vld1q_s32 (src + 4));
+      vst1q_s32 (dst + 4, vreinterpretq_s32_u32 (vandq_u32 (v, mask_hi)));
+    }
+    src += in;
+    dst += out;
+  }
+
+  *psrc = src;
+  *pdst = dst;
+  return len;
 }
 
-#define transform_6_8(type) \
-static inline void \
-transform_6_8_##type (gpointer psrc, gpointer pdst, guint len) \
+/* vcvtq_n_s32_f32 saturates and converts NaN to 0 like f32_to_s32 */
+static inline guint
+pad_frames_f32_neon (const gfloat ** psrc, gint32 ** pdst, guint len,
+    guint in, guint out)
+{
+  const gfloat *src = *psrc;
+  gint32 *dst = *pdst;
+  uint32x4_t mask_lo = vcltq_u32 (vld1q_u32 (lanes32), vdupq_n_u32 (in));
+  uint32x4_t mask_hi = vcltq_u32 (vld1q_u32 (lanes32 + 4), vdupq_n_u32 (in));
+
+  if (in == out) {
+    guint n = len * in;
+
+    for (; n >= 4; n -= 4) {
+      vst1q_s32 (dst, vcvtq_n_s32_f32 (vld1q_f32 (src), 31));
+      src += 4;
+      dst += 4;
+    }
+    len = n / in;
+  } else {
+    for (; len > 1; len--) {
+      uint32x4_t v =
+          vreinterpretq_u32_s32 (vcvtq_n_s32_f32 (vld1q_f32 (src), 31));
+
+      vst1q_s32 (dst, vreinterpretq_s32_u32 (vandq_u32 (v, mask_lo)));
+      if (out == 8) {
+        v = vreinterpretq_u32_s32 (vcvtq_n_s32_f32 (vld1q_f32 (src + 4), 31));
+        vst1q_s32 (dst + 4, vreinterpretq_s32_u32 (vandq_u32 (v, mask_hi)));
+      }
+      src += in;
+      dst += out;
+    }
+  }
+
+  *psrc = src;
+  *pdst = dst;
+  return len;
+}
+#else
+#define pad_frames_int16_neon(psrc, pdst, len, in, out) (len)
+#define pad_frames_int32_neon(psrc, pdst, len, in, out) (len)
+#define pad_frames_f32_neon(psrc, pdst, len, in, out) (len)
+#endif
+
+static inline gint32
+f32_to_s32 (gfloat v)
+{
+  if (v > -1.0f && v < 1.0f)
+    return (gint32) (v * 2147483648.0f);
+  else if (v >= 1.0f)
+    return G_MAXINT32;
+  else if (v <= -1.0f)
+    return G_MININT32;
+
+  /* NaN */
+  return 0;
+}
+
+#define transform_pad(type, in, out) \
+static void \
+transform_##in##_##out##_##type (gconstpointer psrc, gpointer pdst, guint len) \
 { \
-  g##type *src = (g##type *) psrc; \
+  const g##type *src = (const g##type *) psrc; \
   g##type *dst = (g##type *) pdst; \
+  guint i; \
+  len = pad_frames_##type##_neon (&src, &dst, len, in, out); \
   for (; len > 0; len--) { \
-    dst[0] = src[0]; \
-    dst[1] = src[1]; \
-    dst[2] = src[2]; \
-    dst[3] = src[3]; \
-    dst[4] = src[4]; \
-    dst[5] = src[5]; \
-    dst[6] = 0; \
-    dst[7] = 0; \
-    src += 6; \
-    dst += 8; \
+    for (i = 0; i < in; i++) \
+      dst[i] = src[i]; \
+    for (; i < out; i++) \
+      dst[i] = 0; \
+    src += in; \
+    dst += out; \
   } \
 }
 
-#define transform_7_8(type) \
-static inline void \
-transform_7_8_##type (gpointer psrc, gpointer pdst, guint len) \
+#define transform_f32(in, out) \
+static void \
+transform_##in##_##out##_f32 (gconstpointer psrc, gpointer pdst, guint len) \
 { \
-  g##type *src = (g##type *) psrc; \
-  g##type *dst = (g##type *) pdst; \
+  const gfloat *src = (const gfloat *) psrc; \
+  gint32 *dst = (gint32 *) pdst; \
+  guint i; \
+  len = pad_frames_f32_neon (&src, &dst, len, in, out); \
   for (; len > 0; len--) { \
-    dst[0] = src[0]; \
-    dst[1] = src[1]; \
-    dst[2] = src[2]; \
-    dst[3] = src[3]; \
-    dst[4] = src[4]; \
-    dst[5] = src[5]; \
-    dst[6] = src[6]; \
-    dst[7] = 0; \
-    src += 7; \
-    dst += 8; \
+    for (i = 0; i < in; i++) \
+      dst[i] = f32_to_s32 (src[i]); \
+    for (; i < out; i++) \
+      dst[i] = 0; \
+    src += in; \
+    dst += out; \
   } \
 }
 
-transform_3_4 (int16);
-transform_5_8 (int16);
-transform_6_8 (int16);
-transform_7_8 (int16);
+transform_pad (int16, 3, 4);
+transform_pad (int16, 5, 8);
+transform_pad (int16, 6, 8);
+transform_pad (int16, 7, 8);
+
+transform_pad (int32, 3, 4);
+transform_pad (int32, 5, 8);
+transform_pad (int32, 6, 8);
+transform_pad (int32, 7, 8);
+
+transform_f32 (1, 1);
+transform_f32 (2, 2);
+transform_f32 (3, 4);
+transform_f32 (4, 4);
+transform_f32 (5, 8);
+transform_f32 (6, 8);
+transform_f32 (7, 8);
+transform_f32 (8, 8);
+
+/* Sets func to NULL if the samples can be copied as they are and returns
+ * FALSE for layouts that can't be converted */
+static gboolean
+select_transform (guint in_chan, guint width, gboolean f32,
+    GstOMXAudioSinkTransformFunc * func)
+{
+  static const GstOMXAudioSinkTransformFunc int16_funcs[9] = {
+    NULL, NULL, NULL, transform_3_4_int16, NULL,
+    transform_5_8_int16, transform_6_8_int16, transform_7_8_int16, NULL
+  };
+  static const GstOMXAudioSinkTransformFunc int32_funcs[9] = {
+    NULL, NULL, NULL, transform_3_4_int32, NULL,
+    transform_5_8_int32, transform_6_8_int32, transform_7_8_int32, NULL
+  };
+  static const GstOMXAudioSinkTransformFunc f32_funcs[9] = {
+    NULL, transform_1_1_f32, transform_2_2_f32, transform_3_4_f32,
+    transform_4_4_f32, transform_5_8_f32, transform_6_8_f32,
+    transform_7_8_f32, transform_8_8_f32
+  };
+
+  *func = NULL;
+
+  if (in_chan < 1 || in_chan > 8)
+    return FALSE;
 
-transform_3_4 (int32);
-transform_5_8 (int32);
-transform_6_8 (int32);
-transform_7_8 (int32);
+  if (f32)
+    *func = f32_funcs[in_chan];
+  else if (in_chan == OUT_CHANNELS (in_chan))
+    return TRUE;
+  else if (width == 16)
+    *func = int16_funcs[in_chan];
+  else if (width == 32)
+    *func = int32_funcs[in_chan];
 
-static void inline
-transform (guint in_chan, guint width, gpointer psrc, gpointer pdst, guint len)
-{
-  guint out_chan = OUT_CHANNELS (in_chan);
-  if (width == 16) {
-    switch (out_chan) {
-      case 4:
-        if (in_chan == 3) {
-          transform_3_4_int16 (psrc, pdst, len);
-        } else {
-          g_assert (FALSE);
-        }
-        break;
-      case 8:
-        switch (in_chan) {
-          case 5:
-            transform_5_8_int16 (psrc, pdst, len);
-            break;
-          case 6:
-            transform_6_8_int16 (psrc, pdst, len);
-            break;
-          case 7:
-            transform_7_8_int16 (psrc, pdst, len);
-            break;
-          default:
-            g_assert (FALSE);
-        }
-        break;
-      default:
-        g_assert (FALSE);
-    }
-  } else if (width == 32) {
-    switch (out_chan) {
-      case 4:
-        if (in_chan == 3) {
-          transform_3_4_int32 (psrc, pdst, len);
-        } else {
-          g_assert (FALSE);
-        }
-        break;
-      case 8:
-        switch (in_chan) {
-          case 5:
-            transform_5_8_int32 (psrc, pdst, len);
-            break;
-          case 6:
-            transform_6_8_int32 (psrc, pdst, len);
-            break;
-          case 7:
-            transform_7_8_int32 (psrc, pdst, len);
-            break;
-          default:
-            g_assert (FALSE);
-        }
-        break;
-      default:
-        g_assert (FALSE);
-    }
-  } else {
-    g_assert (FALSE);
-  }
+  return *func != NULL;
 }
 
 static void
@@ -246,9 +327,8 @@ gst_omx_audio_sink_volume_set (GstOMXAudioSink * self, gdouble volume)
 }
 
 static gboolean
-gst_omx_audio_sink_open (GstAudioSink * audiosink)
+gst_omx_audio_sink_open (GstOMXAudioSink * self)
 {
-  GstOMXAudioSink *self = GST_OMX_AUDIO_SINK (audiosink);
   GstOMXAudioSinkClass *klass = GST_OMX_AUDIO_SINK_GET_CLASS (self);
   gint port_index;
   OMX_ERRORTYPE err;
@@ -336,9 +416,8 @@ gst_omx_audio_sink_open (GstAudioSink * audiosink)
 }
 
 static gboolean
-gst_omx_audio_sink_close (GstAudioSink * audiosink)
+gst_omx_audio_sink_close (GstOMXAudioSink * self)
 {
-  GstOMXAudioSink *self = GST_OMX_AUDIO_SINK (audiosink);
   OMX_STATETYPE state;
 
   GST_DEBUG_OBJECT (self, "Closing audio sink");
@@ -377,13 +456,27 @@ gst_omx_audio_sink_parse_spec (GstOMXAudioSink * self,
   self->width = GST_AUDIO_INFO_WIDTH (&spec->info);
   self->is_signed = GST_AUDIO_INFO_IS_SIGNED (&spec->info);
   self->is_float = GST_AUDIO_INFO_IS_FLOAT (&spec->info);
+  self->transform = NULL;
 
   switch (spec->type) {
     case GST_AUDIO_RING_BUFFER_FORMAT_TYPE_RAW:
     {
       guint out_channels = OUT_CHANNELS (self->channels);
+      gboolean f32;
 
+      f32 = GST_AUDIO_INFO_FORMAT (&spec->info) == GST_AUDIO_FORMAT_F32;
       self->samples = spec->segsize / self->channels / (self->width >> 3);
+      if (!select_transform (self->channels, self->width, f32,
+              &self->transform)) {
+        GST_ERROR_OBJECT (self, "Can't convert %u channels of %s to %u",
+            self->channels, GST_AUDIO_INFO_NAME (&spec->info), out_channels);
+        return FALSE;
+      }
+      /* F32 is converted to S32, so the component gets integer samples */
+      if (f32) {
+        self->is_float = FALSE;
+        self->is_signed = TRUE;
+      }
       if (self->channels == out_channels) {
         self->buffer_size = spec->segsize;
       } else {
@@ -545,11 +638,67 @@ gst_omx_audio_sink_configure_pcm (GstOMXAudioSink * self,
   return TRUE;
 }
 
+/* Takes all input buffers from the port after allocation or flushing,
+ * write_lock and LOCK must be held */
 static gboolean
-gst_omx_audio_sink_prepare (GstAudioSink * audiosink,
+gst_omx_audio_sink_collect_segments (GstOMXAudioSink * self,
+    GstAudioRingBuffer * buf)
+{
+  gint i;
+
+  for (i = 0; i < buf->spec.segtotal; i++) {
+    GstOMXBuffer *obuf = NULL;
+    guint seg;
+
+    if (gst_omx_port_acquire_buffer (self->in_port,
+            &obuf) != GST_OMX_ACQUIRE_BUFFER_OK)
+      return FALSE;
+
+    seg = (obuf->omx_buf->pBuffer - buf->memory) / buf->spec.segsize;
+    g_assert (seg < buf->spec.segtotal && !self->segments[seg]);
+    self->segments[seg] = obuf;
+  }
+  self->submitted = g_atomic_int_get (&buf->segdone);
+
+  return TRUE;
+}
+
+/* Passes the held input buffers back to the flushing port and waits for the
+ * component to return the others, LOCK must be held */
+static OMX_ERRORTYPE
+gst_omx_audio_sink_return_segments (GstOMXAudioSink * self)
+{
+  guint i;
+
+  for (i = 0; i < self->in_port->buffers->len; i++) {
+    if (self->segments[i]) {
+      gst_omx_port_release_buffer (self->in_port, self->segments[i]);
+      self->segments[i] = NULL;
+    }
+  }
+
+  return gst_omx_port_wait_buffers_released (self->in_port, 5 * GST_SECOND);
+}
+
+/* Configures the port for passing copies of the samples in its own
+ * buffers if the segments of our ringbuffer can't be used */
+static OMX_ERRORTYPE
+gst_omx_audio_sink_disable_in_place (GstOMXAudioSink * self)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+
+  self->in_place = FALSE;
+
+  gst_omx_port_get_port_definition (self->in_port, &port_def);
+  port_def.nBufferCountActual = self->max_submitted;
+
+  return gst_omx_port_update_port_definition (self->in_port, &port_def);
+}
+
+static gboolean
+gst_omx_audio_sink_prepare (GstOMXAudioSink * self, GstAudioRingBuffer * buf,
     GstAudioRingBufferSpec * spec)
 {
-  GstOMXAudioSink *self = GST_OMX_AUDIO_SINK (audiosink);
   OMX_PARAM_PORTDEFINITIONTYPE port_def;
   OMX_ERRORTYPE err;
 
@@ -558,10 +707,18 @@ gst_omx_audio_sink_prepare (GstAudioSink * audiosink,
 
   gst_omx_port_get_port_definition (self->in_port, &port_def);
 
+  /* Only pass a min number of buffers at once from our ringbuffer to the hw
+   * ringbuffer as we want to keep our small */
+  self->max_submitted = MAX (port_def.nBufferCountMin, 2);
+  /* Samples that don't need conversion are rendered from the segments of
+   * our ringbuffer, one segment more than passed at once keeps it
+   * writable */
+  self->in_place = !self->transform
+      && spec->segtotal > (gint) self->max_submitted;
+
   port_def.nBufferSize = self->buffer_size;
-  /* Only allocate a min number of buffers for transfers from our ringbuffer to
-   * the hw ringbuffer as we want to keep our small */
-  port_def.nBufferCountActual = MAX (port_def.nBufferCountMin, 2);
+  port_def.nBufferCountActual =
+      self->in_place ? spec->segtotal : self->max_submitted;
   port_def.format.audio.eEncoding = OMX_AUDIO_CodingPCM;
 
   GST_DEBUG_OBJECT (self, "Updating outport port definition");
@@ -578,6 +735,23 @@ gst_omx_audio_sink_prepare (GstAudioSink * audiosink,
     goto configuration;
   }
 
+  /* The segments are only usable if the component takes them as they are */
+  if (self->in_place
+      && (self->in_port->port_def.nBufferSize != spec->segsize
+          || self->in_port->port_def.nBufferCountActual != spec->segtotal)) {
+    GST_WARNING_OBJECT (self, "Component wants %u buffers of %u bytes "
+        "instead of %d segments of %d bytes, copying the samples",
+        (guint) self->in_port->port_def.nBufferCountActual,
+        (guint) self->in_port->port_def.nBufferSize, spec->segtotal,
+        spec->segsize);
+    err = gst_omx_audio_sink_disable_in_place (self);
+    if (err != OMX_ErrorNone) {
+      GST_ERROR_OBJECT (self, "Failed to configure port: %s (0x%08x)",
+          gst_omx_error_to_string (err), err);
+      goto configuration;
+    }
+  }
+
   if (!gst_omx_audio_sink_configure_pcm (self, spec)) {
     goto configuration;
   }
@@ -603,8 +777,27 @@ gst_omx_audio_sink_prepare (GstAudioSink * audiosink,
     goto activation;
   }
 
-  GST_DEBUG_OBJECT (self, "Allocate buffers");
-  err = gst_omx_port_allocate_buffers (self->in_port);
+  GST_DEBUG_OBJECT (self, "Allocate buffers, in place: %d", self->in_place);
+  if (self->in_place) {
+    GList *buffers = NULL;
+    gint i;
+
+    for (i = spec->segtotal - 1; i >= 0; i--)
+      buffers = g_list_prepend (buffers, buf->memory + i * spec->segsize);
+    err = gst_omx_port_use_buffers (self->in_port, buffers);
+    g_list_free (buffers);
+
+    if (err != OMX_ErrorNone) {
+      GST_WARNING_OBJECT (self, "Component can't use the ringbuffer "
+          "segments, copying the samples: %s (0x%08x)",
+          gst_omx_error_to_string (err), err);
+      err = gst_omx_audio_sink_disable_in_place (self);
+      if (err == OMX_ErrorNone)
+        err = gst_omx_port_allocate_buffers (self->in_port);
+    }
+  } else {
+    err = gst_omx_port_allocate_buffers (self->in_port);
+  }
   if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (self, "Failed on buffer allocation: %s (0x%08x)",
         gst_omx_error_to_string (err), err);
@@ -625,6 +818,19 @@ gst_omx_audio_sink_prepare (GstAudioSink * audiosink,
     goto activation;
   }
 
+  if (self->in_place) {
+    gboolean collected;
+
+    self->segments = g_new0 (GstOMXBuffer *, spec->segtotal);
+    g_mutex_lock (&self->write_lock);
+    GST_OMX_AUDIO_SINK_LOCK (self);
+    collected = gst_omx_audio_sink_collect_segments (self, buf);
+    GST_OMX_AUDIO_SINK_UNLOCK (self);
+    g_mutex_unlock (&self->write_lock);
+    if (!collected)
+      goto activation;
+  }
+
   err = gst_omx_component_set_state (self->comp, OMX_StatePause);
   if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (self, "Failed to set state paused: %s (0x%08x)",
@@ -690,15 +896,24 @@ activation:
 }
 
 static gboolean
-gst_omx_audio_sink_unprepare (GstAudioSink * audiosink)
+gst_omx_audio_sink_unprepare (GstOMXAudioSink * self)
 {
-  GstOMXAudioSink *self = GST_OMX_AUDIO_SINK (audiosink);
   OMX_ERRORTYPE err;
 
   if (gst_omx_component_get_state (self->comp, 0) == OMX_StateIdle)
     return TRUE;
 
+  /* The component returns its buffers when the flush completes, the ones
+   * held for the segments of the ringbuffer are given to the port after
+   * that and are waited for separately */
   err = gst_omx_port_set_flushing (self->in_port, 5 * GST_SECOND, TRUE);
+  if (err == OMX_ErrorNone && self->in_place) {
+    g_mutex_lock (&self->write_lock);
+    GST_OMX_AUDIO_SINK_LOCK (self);
+    err = gst_omx_audio_sink_return_segments (self);
+    GST_OMX_AUDIO_SINK_UNLOCK (self);
+    g_mutex_unlock (&self->write_lock);
+  }
   if (err != OMX_ErrorNone) {
     GST_ERROR_OBJECT (self, "Failed to set port flushing: %s (0x%08x)",
         gst_omx_error_to_string (err), err);
@@ -768,6 +983,10 @@ gst_omx_audio_sink_acquire_buffer (GstOMXAudioSink * self)
       goto flushing;
     } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
       GST_DEBUG_OBJECT (self, "Reconfigure...");
+      /* The buffers are the segments of the ringbuffer */
+      if (self->in_place)
+        goto reconfigure_error;
+
       /* Reallocate all buffers */
       err = gst_omx_port_set_enabled (port, FALSE);
       if (err != OMX_ErrorNone) {
@@ -839,55 +1058,156 @@ flushing:
   }
 }
 
-static gint
-gst_omx_audio_sink_write (GstAudioSink * audiosink, gpointer data, guint length)
+/* Renders the segment at the read position of the ringbuffer through a
+ * buffer of the component, returns FALSE if nothing was rendered */
+static gboolean
+gst_omx_audio_sink_render_copy (GstOMXAudioSink * self,
+    GstAudioRingBuffer * buf)
 {
-  GstOMXAudioSink *self = GST_OMX_AUDIO_SINK (audiosink);
-  GstOMXBuffer *buf;
+  GstOMXBuffer *obuf;
   OMX_ERRORTYPE err;
+  guint8 *data;
+  gint seg, len;
 
-  GST_LOG_OBJECT (self, "received audio samples buffer of %u bytes", length);
+  if (!gst_audio_ring_buffer_prepare_read (buf, &seg, &data, &len))
+    return FALSE;
+
+  GST_LOG_OBJECT (self, "rendering segment %d of %d bytes", seg, len);
 
   GST_OMX_AUDIO_SINK_LOCK (self);
 
-  if (!(buf = gst_omx_audio_sink_acquire_buffer (self))) {
-    goto beach;
+  if (!(obuf = gst_omx_audio_sink_acquire_buffer (self))) {
+    GST_OMX_AUDIO_SINK_UNLOCK (self);
+    return FALSE;
   }
 
-  if (buf->omx_buf->nAllocLen == length) {
-    memcpy (buf->omx_buf->pBuffer + buf->omx_buf->nOffset, data, length);
+  if (self->transform) {
+    self->transform (data, obuf->omx_buf->pBuffer + obuf->omx_buf->nOffset,
+        self->samples);
   } else {
-    transform (self->channels, self->width, data,
-        buf->omx_buf->pBuffer + buf->omx_buf->nOffset, self->samples);
+    memcpy (obuf->omx_buf->pBuffer + obuf->omx_buf->nOffset, data, len);
   }
-  buf->omx_buf->nFilledLen = buf->omx_buf->nAllocLen;
+  obuf->omx_buf->nFilledLen = obuf->omx_buf->nAllocLen;
 
-  err = gst_omx_port_release_buffer (self->in_port, buf);
+  err = gst_omx_port_release_buffer (self->in_port, obuf);
+  GST_OMX_AUDIO_SINK_UNLOCK (self);
   if (err != OMX_ErrorNone)
     goto release_error;
 
-beach:
+  gst_audio_ring_buffer_clear (buf, seg);
+  gst_audio_ring_buffer_advance (buf, 1);
+
+  return TRUE;
+
+  /* ERRORS */
+release_error:
+  {
+    GST_ELEMENT_ERROR (self, LIBRARY, SETTINGS, (NULL),
+        ("Failed to release input buffer to component: %s (0x%08x)",
+            gst_omx_error_to_string (err), err));
+    return FALSE;
+  }
+}
+
+/* Passes the next segments of the ringbuffer to the component and waits for
+ * the oldest to come back, returns FALSE if nothing was rendered.
+ *
+ * Like a device reading from the ringbuffer, the segments are passed in
+ * order from the read position on, whether they were written or not. Only
+ * a returned segment is cleared and given back to the ringbuffer. The
+ * segments in between are still in the writable part of the ringbuffer,
+ * gst_omx_audio_ring_buffer_commit() drops samples that arrive for them
+ * too late. */
+static gboolean
+gst_omx_audio_sink_render_in_place (GstOMXAudioSink * self,
+    GstAudioRingBuffer * buf)
+{
+  gint segtotal = buf->spec.segtotal;
+  gint segsize = buf->spec.segsize;
+  GstOMXBuffer *obuf;
+  OMX_ERRORTYPE err;
+  gint segdone, seg, submitted;
+
+  while (TRUE) {
+    g_mutex_lock (&self->write_lock);
+    GST_OMX_AUDIO_SINK_LOCK (self);
+    segdone = g_atomic_int_get (&buf->segdone);
+    if (self->submitted < segdone)
+      self->submitted = segdone;
+    submitted = self->submitted;
+    seg = submitted % segtotal;
+    obuf = self->segments[seg];
+    GST_OMX_AUDIO_SINK_UNLOCK (self);
+    g_mutex_unlock (&self->write_lock);
+
+    if (submitted - segdone >= (gint) self->max_submitted || !obuf
+        || g_atomic_int_get (&buf->state) !=
+        GST_AUDIO_RING_BUFFER_STATE_STARTED)
+      break;
+
+    /* Pull mode, fill the segment without holding our lock */
+    if (buf->callback)
+      buf->callback (buf, buf->memory + seg * segsize, segsize, buf->cb_data);
+
+    /* No commit is writing into the segment while it's passed on, later
+     * ones drop the samples for it */
+    g_mutex_lock (&self->write_lock);
+    GST_OMX_AUDIO_SINK_LOCK (self);
+    /* Flushed in the meantime */
+    if (self->submitted != submitted || self->segments[seg] != obuf) {
+      GST_OMX_AUDIO_SINK_UNLOCK (self);
+      g_mutex_unlock (&self->write_lock);
+      continue;
+    }
+
+    GST_LOG_OBJECT (self, "passing segment %d to the component", seg);
 
+    self->segments[seg] = NULL;
+    self->submitted++;
+    obuf->omx_buf->nOffset = 0;
+    obuf->omx_buf->nFilledLen = segsize;
+    err = gst_omx_port_release_buffer (self->in_port, obuf);
+    GST_OMX_AUDIO_SINK_UNLOCK (self);
+    g_mutex_unlock (&self->write_lock);
+    if (err != OMX_ErrorNone)
+      goto release_error;
+  }
+
+  GST_OMX_AUDIO_SINK_LOCK (self);
+  /* After a flush nothing is with the component, the state is checked with
+   * the lock as a flush only unblocks a thread already waiting */
+  if (g_atomic_int_get (&buf->state) != GST_AUDIO_RING_BUFFER_STATE_STARTED
+      || !(obuf = gst_omx_audio_sink_acquire_buffer (self))) {
+    GST_OMX_AUDIO_SINK_UNLOCK (self);
+    return FALSE;
+  }
+  seg = (obuf->omx_buf->pBuffer - buf->memory) / segsize;
+  self->segments[seg] = obuf;
   GST_OMX_AUDIO_SINK_UNLOCK (self);
 
-  return length;
+  if (seg != segdone % segtotal)
+    GST_WARNING_OBJECT (self, "component returned segment %d, expected %d",
+        seg, segdone % segtotal);
+
+  gst_audio_ring_buffer_clear (buf, seg);
+  gst_audio_ring_buffer_advance (buf, 1);
+
+  return TRUE;
 
   /* ERRORS */
 release_error:
   {
-    GST_OMX_AUDIO_SINK_UNLOCK (self);
     GST_ELEMENT_ERROR (self, LIBRARY, SETTINGS, (NULL),
-        ("Failed to relase input buffer to component: %s (0x%08x)",
+        ("Failed to release input buffer to component: %s (0x%08x)",
             gst_omx_error_to_string (err), err));
-    return 0;
+    return FALSE;
   }
 }
 
 static guint
-gst_omx_audio_sink_delay (GstAudioSink * audiosink)
+gst_omx_audio_sink_delay (GstOMXAudioSink * self)
 {
 #if defined (USE_OMX_TARGET_RPI)
-  GstOMXAudioSink *self = GST_OMX_AUDIO_SINK (audiosink);
   OMX_PARAM_U32TYPE param;
   OMX_ERRORTYPE err;
 
@@ -910,16 +1230,21 @@ gst_omx_audio_sink_delay (GstAudioSink * audiosink)
 }
 
 static void
-gst_omx_audio_sink_reset (GstAudioSink * audiosink)
+gst_omx_audio_sink_reset (GstOMXAudioSink * self, GstAudioRingBuffer * buf)
 {
-  GstOMXAudioSink *self = GST_OMX_AUDIO_SINK (audiosink);
   OMX_STATETYPE state;
 
   GST_DEBUG_OBJECT (self, "Flushing sink");
 
+  /* The held segments are given back once the component returned the
+   * others with the completed flush */
   gst_omx_port_set_flushing (self->in_port, 5 * GST_SECOND, TRUE);
 
+  g_mutex_lock (&self->write_lock);
   GST_OMX_AUDIO_SINK_LOCK (self);
+  if (self->in_place)
+    gst_omx_audio_sink_return_segments (self);
+
   if ((state = gst_omx_component_get_state (self->comp, 0)) > OMX_StatePause) {
     gst_omx_component_set_state (self->comp, OMX_StatePause);
     gst_omx_component_get_state (self->comp, GST_CLOCK_TIME_NONE);
@@ -930,7 +1255,364 @@ gst_omx_audio_sink_reset (GstAudioSink * audiosink)
 
   gst_omx_port_set_flushing (self->in_port, 5 * GST_SECOND, FALSE);
 
+  if (self->in_place && !gst_omx_audio_sink_collect_segments (self, buf))
+    GST_ERROR_OBJECT (self, "Failed to take back the input buffers");
+
   GST_OMX_AUDIO_SINK_UNLOCK (self);
+  g_mutex_unlock (&self->write_lock);
+}
+
+/* The ringbuffer of the sink. Its memory is allocated with the alignment
+ * the component requires, so that the segments can be used as input buffers
+ * of the component, and a thread renders the segments in order like the
+ * one of GstAudioSink does */
+typedef struct _GstOMXAudioRingBuffer GstOMXAudioRingBuffer;
+typedef struct _GstOMXAudioRingBufferClass GstOMXAudioRingBufferClass;
+
+struct _GstOMXAudioRingBuffer
+{
+  GstAudioRingBuffer parent;
+
+  GThread *thread;
+  /* TRUE while the thread should run, object lock */
+  gboolean running;
+  /* Unaligned memory of the ringbuffer */
+  guint8 *alloc;
+};
+
+struct _GstOMXAudioRingBufferClass
+{
+  GstAudioRingBufferClass parent_class;
+};
+
+GType gst_omx_audio_ring_buffer_get_type (void);
+G_DEFINE_TYPE (GstOMXAudioRingBuffer, gst_omx_audio_ring_buffer,
+    GST_TYPE_AUDIO_RING_BUFFER);
+
+#define GST_TYPE_OMX_AUDIO_RING_BUFFER (gst_omx_audio_ring_buffer_get_type())
+#define GST_OMX_AUDIO_RING_BUFFER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OMX_AUDIO_RING_BUFFER,GstOMXAudioRingBuffer))
+
+#define GST_OMX_AUDIO_RING_BUFFER_SINK(buf) \
+  (GST_OMX_AUDIO_SINK (GST_OBJECT_PARENT (buf)))
+
+static void
+gst_omx_audio_ring_buffer_thread_func (GstAudioRingBuffer * buf)
+{
+  GstOMXAudioRingBuffer *ringbuf = GST_OMX_AUDIO_RING_BUFFER (buf);
+  GstOMXAudioSink *self = GST_OMX_AUDIO_RING_BUFFER_SINK (buf);
+  gboolean rendered;
+
+  GST_DEBUG_OBJECT (self, "enter thread");
+
+  GST_OBJECT_LOCK (buf);
+  GST_AUDIO_RING_BUFFER_SIGNAL (buf);
+
+  while (ringbuf->running) {
+    if (g_atomic_int_get (&buf->state) != GST_AUDIO_RING_BUFFER_STATE_STARTED) {
+      GST_DEBUG_OBJECT (self, "waiting to be started");
+      GST_AUDIO_RING_BUFFER_WAIT (buf);
+      continue;
+    }
+    GST_OBJECT_UNLOCK (buf);
+
+    if (self->in_place)
+      rendered = gst_omx_audio_sink_render_in_place (self, buf);
+    else
+      rendered = gst_omx_audio_sink_render_copy (self, buf);
+
+    GST_OBJECT_LOCK (buf);
+    /* Don't spin on a flushed port or a failed component */
+    if (!rendered && ringbuf->running
+        && g_atomic_int_get (&buf->state) ==
+        GST_AUDIO_RING_BUFFER_STATE_STARTED)
+      GST_AUDIO_RING_BUFFER_WAIT (buf);
+  }
+  GST_OBJECT_UNLOCK (buf);
+
+  GST_DEBUG_OBJECT (self, "exit thread");
+}
+
+/* Waits for the writer's part of the ringbuffer to advance by a segment,
+ * starting the ringbuffer if allowed like the base class does. Returns
+ * FALSE if the ringbuffer is flushing or not started */
+static gboolean
+gst_omx_audio_ring_buffer_wait_segment (GstAudioRingBuffer * buf)
+{
+  if (g_atomic_int_get (&buf->state) != GST_AUDIO_RING_BUFFER_STATE_STARTED) {
+    gint segdone = g_atomic_int_get (&buf->segdone);
+
+    if (!g_atomic_int_get (&buf->may_start))
+      return FALSE;
+
+    gst_audio_ring_buffer_start (buf);
+    if (segdone != g_atomic_int_get (&buf->segdone))
+      return TRUE;
+  }
+
+  GST_OBJECT_LOCK (buf);
+  if (buf->flushing
+      || g_atomic_int_get (&buf->state) != GST_AUDIO_RING_BUFFER_STATE_STARTED)
+    goto stopped;
+
+  if (g_atomic_int_compare_and_exchange (&buf->waiting, 0, 1)) {
+    GST_AUDIO_RING_BUFFER_WAIT (buf);
+    if (buf->flushing
+        || g_atomic_int_get (&buf->state) !=
+        GST_AUDIO_RING_BUFFER_STATE_STARTED)
+      goto stopped;
+  }
+  GST_OBJECT_UNLOCK (buf);
+
+  return TRUE;
+
+stopped:
+  {
+    GST_OBJECT_UNLOCK (buf);
+    return FALSE;
+  }
+}
+
+/* The segments passed to the component in place are still part of the
+ * range the base class writes to. Samples for them are dropped as too late
+ * here and the writes are done with write_lock, so that a segment is never
+ * written while or after it's passed on. The base class writes one segment
+ * at a time, or the whole range at once in trick modes. */
+static guint
+gst_omx_audio_ring_buffer_commit (GstAudioRingBuffer * buf, guint64 * sample,
+    guint8 * data, gint in_samples, gint out_samples, gint * accum)
+{
+  GstAudioRingBufferClass *parent_class =
+      GST_AUDIO_RING_BUFFER_CLASS (gst_omx_audio_ring_buffer_parent_class);
+  GstOMXAudioSink *self = GST_OMX_AUDIO_RING_BUFFER_SINK (buf);
+  gint sps = buf->samples_per_seg;
+  gint segtotal = buf->spec.segtotal;
+  gint bpf = GST_AUDIO_INFO_BPF (&buf->spec.info);
+  gboolean by_segment = in_samples == out_samples;
+  gint done = 0;
+
+  if (!self->in_place)
+    return parent_class->commit (buf, sample, data, in_samples, out_samples,
+        accum);
+
+  while (done < in_samples) {
+    gint n_in, n_out, written;
+    gint64 first, last, segdone;
+
+    if (by_segment) {
+      n_in = n_out = MIN (in_samples - done, sps - (gint) (*sample % sps));
+    } else {
+      n_in = in_samples;
+      n_out = out_samples;
+    }
+    first = *sample / sps;
+    last = (*sample + ABS (n_out) - 1) / sps;
+
+    g_mutex_lock (&self->write_lock);
+    segdone = g_atomic_int_get (&buf->segdone) - buf->segbase;
+    if (first < self->submitted - buf->segbase || last - first >= segtotal) {
+      g_mutex_unlock (&self->write_lock);
+      GST_DEBUG_OBJECT (self, "dropping %d samples for segment %"
+          G_GINT64_FORMAT " that was passed to the component already", n_in,
+          first);
+      *sample += ABS (n_out);
+      done += n_in;
+      continue;
+    }
+
+    if (last - segdone >= segtotal) {
+      g_mutex_unlock (&self->write_lock);
+      if (!gst_omx_audio_ring_buffer_wait_segment (buf))
+        break;
+      continue;
+    }
+
+    /* Fits without waiting, so write_lock is not held for long */
+    written = parent_class->commit (buf, sample, data + done * bpf, n_in,
+        n_out, accum);
+    g_mutex_unlock (&self->write_lock);
+
+    done += written;
+    if (written < n_in)
+      break;
+  }
+
+  return done;
+}
+
+static gboolean
+gst_omx_audio_ring_buffer_open_device (GstAudioRingBuffer * buf)
+{
+  return gst_omx_audio_sink_open (GST_OMX_AUDIO_RING_BUFFER_SINK (buf));
+}
+
+static gboolean
+gst_omx_audio_ring_buffer_close_device (GstAudioRingBuffer * buf)
+{
+  return gst_omx_audio_sink_close (GST_OMX_AUDIO_RING_BUFFER_SINK (buf));
+}
+
+static gboolean
+gst_omx_audio_ring_buffer_acquire (GstAudioRingBuffer * buf,
+    GstAudioRingBufferSpec * spec)
+{
+  GstOMXAudioRingBuffer *ringbuf = GST_OMX_AUDIO_RING_BUFFER (buf);
+  GstOMXAudioSink *self = GST_OMX_AUDIO_RING_BUFFER_SINK (buf);
+  gsize align;
+
+  /* All segments can be queued in the component */
+  spec->seglatency = spec->segtotal + 1;
+  buf->size = spec->segtotal * spec->segsize;
+
+  align = MAX (self->in_port->port_def.nBufferAlignment, 1);
+  ringbuf->alloc = g_malloc (buf->size + align - 1);
+  buf->memory = (guint8 *) (((guintptr) ringbuf->alloc + align - 1)
+      & ~((guintptr) align - 1));
+
+  if (spec->type == GST_AUDIO_RING_BUFFER_FORMAT_TYPE_RAW) {
+    gst_audio_format_fill_silence (spec->info.finfo, buf->memory,
+        buf->size);
+  } else {
+    memset (buf->memory, 0, buf->size);
+  }
+
+  if (!gst_omx_audio_sink_prepare (self, buf, spec)) {
+    g_free (ringbuf->alloc);
+    ringbuf->alloc = NULL;
+    buf->memory = NULL;
+    buf->size = 0;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_audio_ring_buffer_release (GstAudioRingBuffer * buf)
+{
+  GstOMXAudioRingBuffer *ringbuf = GST_OMX_AUDIO_RING_BUFFER (buf);
+  GstOMXAudioSink *self = GST_OMX_AUDIO_RING_BUFFER_SINK (buf);
+  gboolean ret;
+
+  /* The component must not use the memory anymore before it's freed */
+  ret = gst_omx_audio_sink_unprepare (self);
+
+  g_free (self->segments);
+  self->segments = NULL;
+  self->in_place = FALSE;
+
+  g_free (ringbuf->alloc);
+  ringbuf->alloc = NULL;
+  buf->memory = NULL;
+  buf->size = 0;
+
+  return ret;
+}
+
+static gboolean
+gst_omx_audio_ring_buffer_activate (GstAudioRingBuffer * buf, gboolean active)
+{
+  GstOMXAudioRingBuffer *ringbuf = GST_OMX_AUDIO_RING_BUFFER (buf);
+  GError *error = NULL;
+
+  if (active) {
+    ringbuf->running = TRUE;
+    ringbuf->thread = g_thread_try_new ("omxaudiosink-ringbuffer",
+        (GThreadFunc) gst_omx_audio_ring_buffer_thread_func, buf, &error);
+    if (!ringbuf->thread) {
+      GST_ERROR_OBJECT (buf, "Failed to create thread: %s", error->message);
+      g_clear_error (&error);
+      ringbuf->running = FALSE;
+      return FALSE;
+    }
+    /* Wait for the thread to be running */
+    GST_AUDIO_RING_BUFFER_WAIT (buf);
+  } else {
+    ringbuf->running = FALSE;
+    GST_AUDIO_RING_BUFFER_SIGNAL (buf);
+    GST_OBJECT_UNLOCK (buf);
+
+    g_thread_join (ringbuf->thread);
+    ringbuf->thread = NULL;
+
+    GST_OBJECT_LOCK (buf);
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_audio_ring_buffer_start (GstAudioRingBuffer * buf)
+{
+  GST_AUDIO_RING_BUFFER_SIGNAL (buf);
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_audio_ring_buffer_pause (GstAudioRingBuffer * buf)
+{
+  gst_omx_audio_sink_reset (GST_OMX_AUDIO_RING_BUFFER_SINK (buf), buf);
+  GST_AUDIO_RING_BUFFER_SIGNAL (buf);
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_audio_ring_buffer_stop (GstAudioRingBuffer * buf)
+{
+  gst_omx_audio_sink_reset (GST_OMX_AUDIO_RING_BUFFER_SINK (buf), buf);
+  GST_AUDIO_RING_BUFFER_SIGNAL (buf);
+
+  return TRUE;
+}
+
+static guint
+gst_omx_audio_ring_buffer_delay (GstAudioRingBuffer * buf)
+{
+  return gst_omx_audio_sink_delay (GST_OMX_AUDIO_RING_BUFFER_SINK (buf));
+}
+
+static void
+gst_omx_audio_ring_buffer_class_init (GstOMXAudioRingBufferClass * klass)
+{
+  GstAudioRingBufferClass *ringbuffer_class =
+      GST_AUDIO_RING_BUFFER_CLASS (klass);
+
+  ringbuffer_class->open_device =
+      GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_open_device);
+  ringbuffer_class->close_device =
+      GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_close_device);
+  ringbuffer_class->acquire =
+      GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_acquire);
+  ringbuffer_class->release =
+      GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_release);
+  ringbuffer_class->activate =
+      GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_activate);
+  ringbuffer_class->start = GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_start);
+  ringbuffer_class->resume =
+      GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_start);
+  ringbuffer_class->pause = GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_pause);
+  ringbuffer_class->stop = GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_stop);
+  ringbuffer_class->delay = GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_delay);
+  ringbuffer_class->commit =
+      GST_DEBUG_FUNCPTR (gst_omx_audio_ring_buffer_commit);
+}
+
+static void
+gst_omx_audio_ring_buffer_init (GstOMXAudioRingBuffer * ringbuf)
+{
+}
+
+static GstAudioRingBuffer *
+gst_omx_audio_sink_create_ringbuffer (GstAudioBaseSink * audiobasesink)
+{
+  GstAudioRingBuffer *buf;
+
+  buf = g_object_new (GST_TYPE_OMX_AUDIO_RING_BUFFER, NULL);
+  gst_object_set_parent (GST_OBJECT (buf), GST_OBJECT (audiobasesink));
+
+  return buf;
 }
 
 static GstBuffer *
@@ -1166,6 +1848,7 @@ gst_omx_audio_sink_finalize (GObject * object)
   GstOMXAudioSink *self = GST_OMX_AUDIO_SINK (object);
 
   g_mutex_clear (&self->lock);
+  g_mutex_clear (&self->write_lock);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -1177,7 +1860,6 @@ gst_omx_audio_sink_class_init (GstOMXAudioSinkClass * klass)
   GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
   GstBaseSinkClass *basesink_class = GST_BASE_SINK_CLASS (klass);
   GstAudioBaseSinkClass *baudiosink_class = GST_AUDIO_BASE_SINK_CLASS (klass);
-  GstAudioSinkClass *audiosink_class = GST_AUDIO_SINK_CLASS (klass);
 
   gobject_class->set_property = gst_omx_audio_sink_set_property;
   gobject_class->get_property = gst_omx_audio_sink_get_property;
@@ -1199,14 +1881,8 @@ gst_omx_audio_sink_class_init (GstOMXAudioSinkClass * klass)
 
   baudiosink_class->payload = GST_DEBUG_FUNCPTR (gst_omx_audio_sink_payload);
 
-  audiosink_class->open = GST_DEBUG_FUNCPTR (gst_omx_audio_sink_open);
-  audiosink_class->close = GST_DEBUG_FUNCPTR (gst_omx_audio_sink_close);
-  audiosink_class->prepare = GST_DEBUG_FUNCPTR (gst_omx_audio_sink_prepare);
-  audiosink_class->unprepare = GST_DEBUG_FUNCPTR (gst_omx_audio_sink_unprepare);
-  audiosink_class->write = GST_DEBUG_FUNCPTR (gst_omx_audio_sink_write);
-  audiosink_class->delay = GST_DEBUG_FUNCPTR (gst_omx_audio_sink_delay);
-  audiosink_class->reset = GST_DEBUG_FUNCPTR (gst_omx_audio_sink_reset);
-
+  baudiosink_class->create_ringbuffer =
+      GST_DEBUG_FUNCPTR (gst_omx_audio_sink_create_ringbuffer);
 
   klass->cdata.type = GST_OMX_COMPONENT_TYPE_SINK;
 }
@@ -1215,6 +1891,7 @@ static void
 gst_omx_audio_sink_init (GstOMXAudioSink * self)
 {
   g_mutex_init (&self->lock);
+  g_mutex_init (&self->write_lock);
 
   self->mute = DEFAULT_PROP_MUTE;
   self->volume = DEFAULT_PROP_VOLUME;
@@ -62,9 +62,12 @@ G_BEGIN_DECLS
 typedef struct _GstOMXAudioSink GstOMXAudioSink;
 typedef struct _GstOMXAudioSinkClass GstOMXAudioSinkClass;
 
+typedef void (*GstOMXAudioSinkTransformFunc) (gconstpointer src, gpointer dst,
+    guint frames);
+
 struct _GstOMXAudioSink
 {
-  GstAudioSink parent;
+  GstAudioBaseSink parent;
 
   /* < protected > */
   GstOMXComponent *comp;
@@ -83,13 +86,29 @@ struct _GstOMXAudioSink
 
   guint buffer_size;
   guint samples;
+  /* Pads the channels and converts F32 input, NULL to copy */
+  GstOMXAudioSinkTransformFunc transform;
+
+  /* TRUE if the segments of the ring buffer are the input buffers of the
+   * component and are rendered without a copy */
+  gboolean in_place;
+  /* Input buffer of every segment while it's not with the component, the
+   * number of segments passed to the component so far and how many of them
+   * may be with it at once, LOCK. submitted is only changed with
+   * write_lock held too */
+  GstOMXBuffer **segments;
+  gint submitted;
+  guint max_submitted;
 
   GMutex lock;
+  /* Taken around writes into the ringbuffer and around passing segments to
+   * the component. Locking order: write_lock -> LOCK */
+  GMutex write_lock;
 };
 
 struct _GstOMXAudioSinkClass
 {
-  GstAudioSinkClass parent_class;
+  GstAudioBaseSinkClass parent_class;
 
   GstOMXClassData cdata;
   const gchar * destination;
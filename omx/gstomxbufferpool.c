@@ -337,6 +337,48 @@ wrong_video_caps:
   }
 }
 
+/* Plane layout of raw video in the OMX buffers of the port */
+static void
+gst_omx_buffer_pool_get_video_layout (GstOMXBufferPool * pool,
+    gsize offset[GST_VIDEO_MAX_PLANES], gint stride[GST_VIDEO_MAX_PLANES])
+{
+  const guint nstride = pool->port->port_def.format.video.nStride;
+  const guint nslice = pool->port->port_def.format.video.nSliceHeight;
+  gint i;
+
+  for (i = 0; i < GST_VIDEO_MAX_PLANES; i++) {
+    offset[i] = 0;
+    stride[i] = 0;
+  }
+  stride[0] = nstride;
+
+  switch (GST_VIDEO_INFO_FORMAT (&pool->video_info)) {
+    case GST_VIDEO_FORMAT_ABGR:
+    case GST_VIDEO_FORMAT_ARGB:
+    case GST_VIDEO_FORMAT_RGB16:
+    case GST_VIDEO_FORMAT_BGR16:
+    case GST_VIDEO_FORMAT_YUY2:
+    case GST_VIDEO_FORMAT_UYVY:
+    case GST_VIDEO_FORMAT_YVYU:
+    case GST_VIDEO_FORMAT_GRAY8:
+      break;
+    case GST_VIDEO_FORMAT_I420:
+      stride[1] = nstride / 2;
+      offset[1] = offset[0] + stride[0] * nslice;
+      stride[2] = nstride / 2;
+      offset[2] = offset[1] + (stride[1] * nslice / 2);
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_NV16:
+      stride[1] = nstride;
+      offset[1] = offset[0] + stride[0] * nslice;
+      break;
+    default:
+      g_assert_not_reached ();
+      break;
+  }
+}
+
 static GstFlowReturn
 gst_omx_buffer_pool_alloc_buffer (GstBufferPool * bpool,
     GstBuffer ** buffer, GstBufferPoolAcquireParams * params)
@@ -384,41 +426,15 @@ gst_omx_buffer_pool_alloc_buffer (GstBufferPool * bpool,
     pool->need_copy = FALSE;
   } else {
     GstMemory *mem;
-    const guint nstride = pool->port->port_def.format.video.nStride;
-    const guint nslice = pool->port->port_def.format.video.nSliceHeight;
-    gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
-    gint stride[GST_VIDEO_MAX_PLANES] = { nstride, 0, };
+    gsize offset[GST_VIDEO_MAX_PLANES];
+    gint stride[GST_VIDEO_MAX_PLANES];
 
     mem = gst_omx_memory_allocator_alloc (pool->allocator, 0, omx_buf);
     buf = gst_buffer_new ();
     gst_buffer_append_memory (buf, mem);
     g_ptr_array_add (pool->buffers, buf);
 
-    switch (GST_VIDEO_INFO_FORMAT (&pool->video_info)) {
-      case GST_VIDEO_FORMAT_ABGR:
-      case GST_VIDEO_FORMAT_ARGB:
-      case GST_VIDEO_FORMAT_RGB16:
-      case GST_VIDEO_FORMAT_BGR16:
-      case GST_VIDEO_FORMAT_YUY2:
-      case GST_VIDEO_FORMAT_UYVY:
-      case GST_VIDEO_FORMAT_YVYU:
-      case GST_VIDEO_FORMAT_GRAY8:
-        break;
-      case GST_VIDEO_FORMAT_I420:
-        stride[1] = nstride / 2;
-        offset[1] = offset[0] + stride[0] * nslice;
-        stride[2] = nstride / 2;
-        offset[2] = offset[1] + (stride[1] * nslice / 2);
-        break;
-      case GST_VIDEO_FORMAT_NV12:
-      case GST_VIDEO_FORMAT_NV16:
-        stride[1] = nstride;
-        offset[1] = offset[0] + stride[0] * nslice;
-        break;
-      default:
-        g_assert_not_reached ();
-        break;
-    }
+    gst_omx_buffer_pool_get_video_layout (pool, offset, stride);
 
     if (pool->add_videometa) {
       pool->need_copy = FALSE;
@@ -510,6 +526,23 @@ gst_omx_buffer_pool_acquire_buffer (GstBufferPool * bpool,
           && g_strcmp0 (mem->allocator->mem_type, GST_OMX_MEMORY_TYPE) == 0);
       mem->size = ((GstOMXMemory *) mem)->buf->omx_buf->nFilledLen;
       mem->offset = ((GstOMXMemory *) mem)->buf->omx_buf->nOffset;
+
+      /* The port settings might have changed in place since the
+       * buffer was allocated, make sure the meta is up to date */
+      if (pool->add_videometa) {
+        GstVideoMeta *meta = gst_buffer_get_video_meta (*buffer);
+
+        if (meta) {
+          GST_OBJECT_LOCK (pool);
+          meta->format = GST_VIDEO_INFO_FORMAT (&pool->video_info);
+          meta->width = GST_VIDEO_INFO_WIDTH (&pool->video_info);
+          meta->height = GST_VIDEO_INFO_HEIGHT (&pool->video_info);
+          meta->n_planes = GST_VIDEO_INFO_N_PLANES (&pool->video_info);
+          gst_omx_buffer_pool_get_video_layout (pool, meta->offset,
+              meta->stride);
+          GST_OBJECT_UNLOCK (pool);
+        }
+      }
     }
   } else {
     /* Acquire any buffer that is available to be filled by upstream */
@@ -631,3 +664,21 @@ gst_omx_buffer_pool_new (GstElement * element, GstOMXComponent * component,
 
   return GST_BUFFER_POOL (pool);
 }
+
+/* Updates the video info of a pool wrapping the buffers of a raw video
+ * output port after its settings changed without reallocating the buffers.
+ * Only valid if the buffers are big enough for the new settings. */
+void
+gst_omx_buffer_pool_set_video_info (GstOMXBufferPool * pool,
+    const GstVideoInfo * info)
+{
+  g_return_if_fail (GST_IS_OMX_BUFFER_POOL (pool));
+  g_return_if_fail (info != NULL);
+
+  GST_OBJECT_LOCK (pool);
+  pool->video_info = *info;
+  if (pool->caps)
+    gst_caps_unref (pool->caps);
+  pool->caps = gst_video_info_to_caps (&pool->video_info);
+  GST_OBJECT_UNLOCK (pool);
+}
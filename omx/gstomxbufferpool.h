@@ -88,6 +88,7 @@ struct _GstOMXBufferPoolClass
 GType gst_omx_buffer_pool_get_type (void);
 
 GstBufferPool *gst_omx_buffer_pool_new (GstElement * element, GstOMXComponent * component, GstOMXPort * port);
+void gst_omx_buffer_pool_set_video_info (GstOMXBufferPool * pool, const GstVideoInfo * info);
 
 G_END_DECLS
 
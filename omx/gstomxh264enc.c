@@ -23,6 +23,7 @@
 #endif
 
 #include <gst/gst.h>
+#include <gst/base/gstbitreader.h>
 
 #include "gstomxh264enc.h"
 
@@ -43,6 +44,10 @@ static GstFlowReturn gst_omx_h264_enc_handle_output_frame (GstOMXVideoEnc *
     self, GstOMXPort * port, GstOMXBuffer * buf, GstVideoCodecFrame * frame);
 static gboolean gst_omx_h264_enc_flush (GstVideoEncoder * enc);
 static gboolean gst_omx_h264_enc_stop (GstVideoEncoder * enc);
+static GstFlowReturn gst_omx_h264_enc_pre_push (GstVideoEncoder * enc,
+    GstVideoCodecFrame * frame);
+static GstOMXVideoEncFrameType gst_omx_h264_enc_get_frame_type (GstOMXVideoEnc
+    * enc, GstOMXBuffer * buf);
 static void gst_omx_h264_enc_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_omx_h264_enc_get_property (GObject * object, guint prop_id,
@@ -55,7 +60,8 @@ enum
   PROP_INLINESPSPPSHEADERS,
 #endif
   PROP_PERIODICITYOFIDRFRAMES,
-  PROP_INTERVALOFCODINGINTRAFRAMES
+  PROP_INTERVALOFCODINGINTRAFRAMES,
+  PROP_REPEAT_HEADERS
 };
 
 #ifdef USE_OMX_TARGET_RPI
@@ -63,6 +69,7 @@ enum
 #endif
 #define GST_OMX_H264_VIDEO_ENC_PERIODICITY_OF_IDR_FRAMES_DEFAULT    (0xffffffff)
 #define GST_OMX_H264_VIDEO_ENC_INTERVAL_OF_CODING_INTRA_FRAMES_DEFAULT (0xffffffff)
+#define GST_OMX_H264_VIDEO_ENC_REPEAT_HEADERS_DEFAULT (FALSE)
 
 
 /* class initialization */
@@ -117,13 +124,24 @@ gst_omx_h264_enc_class_init (GstOMXH264EncClass * klass)
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
           GST_PARAM_MUTABLE_READY));
 
+  g_object_class_install_property (gobject_class, PROP_REPEAT_HEADERS,
+      g_param_spec_boolean ("repeat-headers", "Repeat SPS/PPS headers",
+          "Put the last SPS/PPS headers in front of every IDR frame of "
+          "byte-stream output that doesn't follow new headers",
+          GST_OMX_H264_VIDEO_ENC_REPEAT_HEADERS_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
   basevideoenc_class->flush = gst_omx_h264_enc_flush;
   basevideoenc_class->stop = gst_omx_h264_enc_stop;
+  basevideoenc_class->pre_push = GST_DEBUG_FUNCPTR (gst_omx_h264_enc_pre_push);
 
   videoenc_class->cdata.default_src_template_caps = "video/x-h264, "
       "width=(int) [ 16, 4096 ], " "height=(int) [ 16, 4096 ]";
   videoenc_class->handle_output_frame =
       GST_DEBUG_FUNCPTR (gst_omx_h264_enc_handle_output_frame);
+  videoenc_class->get_frame_type =
+      GST_DEBUG_FUNCPTR (gst_omx_h264_enc_get_frame_type);
 
   gst_element_class_set_static_metadata (element_class,
       "OpenMAX H.264 Video Encoder",
@@ -152,6 +170,9 @@ gst_omx_h264_enc_set_property (GObject * object, guint prop_id,
     case PROP_INTERVALOFCODINGINTRAFRAMES:
       self->interval_intraframes = g_value_get_uint (value);
       break;
+    case PROP_REPEAT_HEADERS:
+      self->repeat_headers = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -176,6 +197,9 @@ gst_omx_h264_enc_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_INTERVALOFCODINGINTRAFRAMES:
       g_value_set_uint (value, self->interval_intraframes);
       break;
+    case PROP_REPEAT_HEADERS:
+      g_value_set_boolean (value, self->repeat_headers);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -193,6 +217,7 @@ gst_omx_h264_enc_init (GstOMXH264Enc * self)
       GST_OMX_H264_VIDEO_ENC_PERIODICITY_OF_IDR_FRAMES_DEFAULT;
   self->interval_intraframes =
       GST_OMX_H264_VIDEO_ENC_INTERVAL_OF_CODING_INTRA_FRAMES_DEFAULT;
+  self->repeat_headers = GST_OMX_H264_VIDEO_ENC_REPEAT_HEADERS_DEFAULT;
 }
 
 static gboolean
@@ -213,6 +238,8 @@ gst_omx_h264_enc_stop (GstVideoEncoder * enc)
 
   g_list_free_full (self->headers, (GDestroyNotify) gst_buffer_unref);
   self->headers = NULL;
+  gst_buffer_replace (&self->cached_headers, NULL);
+  self->headers_pending = FALSE;
 
   return GST_VIDEO_ENCODER_CLASS (parent_class)->stop (enc);
 }
@@ -263,10 +290,19 @@ gst_omx_h264_enc_set_format (GstOMXVideoEnc * enc, GstOMXPort * port,
   }
 #endif
 
+  if (enc->keyframe_schedule > 0
+      && (self->periodicty_idr !=
+          GST_OMX_H264_VIDEO_ENC_PERIODICITY_OF_IDR_FRAMES_DEFAULT
+          || self->interval_intraframes !=
+          GST_OMX_H264_VIDEO_ENC_INTERVAL_OF_CODING_INTRA_FRAMES_DEFAULT))
+    GST_WARNING_OBJECT (self, "Ignoring periodicty-idr and "
+        "interval-intraframes, keyframes are set by keyframe-schedule");
+
   if (self->periodicty_idr !=
       GST_OMX_H264_VIDEO_ENC_PERIODICITY_OF_IDR_FRAMES_DEFAULT
       || self->interval_intraframes !=
-      GST_OMX_H264_VIDEO_ENC_INTERVAL_OF_CODING_INTRA_FRAMES_DEFAULT) {
+      GST_OMX_H264_VIDEO_ENC_INTERVAL_OF_CODING_INTRA_FRAMES_DEFAULT
+      || enc->keyframe_schedule > 0) {
 
 
     GST_OMX_INIT_STRUCT (&config_avcintraperiod);
@@ -296,6 +332,13 @@ gst_omx_h264_enc_set_format (GstOMXVideoEnc * enc, GstOMXPort * port,
       config_avcintraperiod.nPFrames = self->interval_intraframes;
     }
 
+    /* Only the scheduled keyframes are wanted, the component shouldn't
+     * insert its own ones */
+    if (enc->keyframe_schedule > 0) {
+      config_avcintraperiod.nIDRPeriod = G_MAXINT32;
+      config_avcintraperiod.nPFrames = G_MAXINT32;
+    }
+
     err =
         gst_omx_component_set_parameter (GST_OMX_VIDEO_ENC (self)->enc,
         OMX_IndexConfigVideoAVCIntraPeriod, &config_avcintraperiod);
@@ -438,9 +481,10 @@ gst_omx_h264_enc_get_caps (GstOMXVideoEnc * enc, GstOMXPort * port,
   OMX_VIDEO_PARAM_PROFILELEVELTYPE param;
   const gchar *profile, *level;
 
+  /* Slices are pushed as they are produced with slice-output */
   caps = gst_caps_new_simple ("video/x-h264",
       "stream-format", G_TYPE_STRING, "byte-stream",
-      "alignment", G_TYPE_STRING, "au", NULL);
+      "alignment", G_TYPE_STRING, enc->slice_output ? "nal" : "au", NULL);
 
   GST_OMX_INIT_STRUCT (&param);
   param.nPortIndex = GST_OMX_VIDEO_ENC (self)->enc_out_port->index;
@@ -573,6 +617,18 @@ gst_omx_h264_enc_handle_output_frame (GstOMXVideoEnc * enc, GstOMXPort * port,
       return GST_FLOW_OK;
     }
   } else if (self->headers) {
+    GList *l;
+
+    /* Keep the memory of the headers around to repeat them, the base
+     * class pushes them before the next frame */
+    gst_buffer_replace (&self->cached_headers, NULL);
+    self->cached_headers = gst_buffer_new ();
+    for (l = self->headers; l; l = l->next)
+      self->cached_headers =
+          gst_buffer_append (self->cached_headers,
+          gst_buffer_ref (l->data));
+    self->headers_pending = TRUE;
+
     gst_video_encoder_set_headers (GST_VIDEO_ENCODER (self), self->headers);
     self->headers = NULL;
   }
@@ -582,3 +638,108 @@ gst_omx_h264_enc_handle_output_frame (GstOMXVideoEnc * enc, GstOMXPort * port,
       (gst_omx_h264_enc_parent_class)->handle_output_frame (enc, port, buf,
       frame);
 }
+
+static GstFlowReturn
+gst_omx_h264_enc_pre_push (GstVideoEncoder * enc, GstVideoCodecFrame * frame)
+{
+  GstOMXH264Enc *self = GST_OMX_H264_ENC (enc);
+  GstBuffer *outbuf;
+  guint i;
+
+  /* The base class just pushed the headers itself */
+  if (self->headers_pending) {
+    self->headers_pending = FALSE;
+    return GST_FLOW_OK;
+  }
+
+  if (!self->repeat_headers || !self->cached_headers
+      || !GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame) || !frame->output_buffer)
+    return GST_FLOW_OK;
+
+  GST_LOG_OBJECT (self, "Repeating headers before IDR frame %u",
+      frame->system_frame_number);
+
+  /* Only the memory of the headers is shared, the frame
+   * is not copied */
+  outbuf = gst_buffer_make_writable (frame->output_buffer);
+  for (i = gst_buffer_n_memory (self->cached_headers); i > 0; i--)
+    gst_buffer_prepend_memory (outbuf,
+        gst_buffer_get_memory (self->cached_headers, i - 1));
+  frame->output_buffer = outbuf;
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_omx_h264_enc_read_ue (GstBitReader * br, guint * value)
+{
+  guint zeros = 0;
+  guint32 bits = 0;
+  guint8 bit;
+
+  while (TRUE) {
+    if (!gst_bit_reader_get_bits_uint8 (br, &bit, 1))
+      return FALSE;
+    if (bit)
+      break;
+    if (++zeros > 31)
+      return FALSE;
+  }
+
+  if (zeros > 0 && !gst_bit_reader_get_bits_uint32 (br, &bits, zeros))
+    return FALSE;
+
+  *value = (1u << zeros) - 1 + bits;
+
+  return TRUE;
+}
+
+/* Reads the slice_type of the first slice of the byte-stream access unit */
+static GstOMXVideoEncFrameType
+gst_omx_h264_enc_get_frame_type (GstOMXVideoEnc * enc, GstOMXBuffer * buf)
+{
+  const guint8 *data = buf->omx_buf->pBuffer + buf->omx_buf->nOffset;
+  gsize size = buf->omx_buf->nFilledLen;
+  guint8 header[16];
+  guint n, zeros, first_mb, slice_type;
+  GstBitReader br;
+  gsize i;
+
+  for (i = 0; i + 3 < size; i++) {
+    guint nal_type;
+
+    if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1)
+      continue;
+
+    nal_type = data[i + 3] & 0x1f;
+    if (nal_type == 1 || nal_type == 5)
+      break;
+  }
+  if (i + 3 >= size)
+    return GST_OMX_VIDEO_ENC_FRAME_TYPE_UNKNOWN;
+
+  /* The start of the slice header without emulation prevention bytes */
+  for (i += 4, n = 0, zeros = 0; i < size && n < sizeof (header); i++) {
+    if (zeros >= 2 && data[i] == 0x03) {
+      zeros = 0;
+      continue;
+    }
+    zeros = data[i] == 0 ? zeros + 1 : 0;
+    header[n++] = data[i];
+  }
+
+  gst_bit_reader_init (&br, header, n);
+  if (!gst_omx_h264_enc_read_ue (&br, &first_mb)
+      || !gst_omx_h264_enc_read_ue (&br, &slice_type))
+    return GST_OMX_VIDEO_ENC_FRAME_TYPE_UNKNOWN;
+
+  switch (slice_type % 5) {
+    case 0:
+    case 3:
+      return GST_OMX_VIDEO_ENC_FRAME_TYPE_P;
+    case 1:
+      return GST_OMX_VIDEO_ENC_FRAME_TYPE_B;
+    default:
+      return GST_OMX_VIDEO_ENC_FRAME_TYPE_I;
+  }
+}
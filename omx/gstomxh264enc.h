@@ -51,8 +51,13 @@ struct _GstOMXH264Enc
 #endif
   guint32 periodicty_idr;
   guint32 interval_intraframes;
+  gboolean repeat_headers;
 
   GList *headers;
+  /* SPS/PPS last passed to the base class, repeated before IDR frames */
+  GstBuffer *cached_headers;
+  /* TRUE if the base class pushes new headers before the next frame */
+  gboolean headers_pending;
 };
 
 struct _GstOMXH264EncClass
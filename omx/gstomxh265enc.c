@@ -0,0 +1,357 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <string.h>
+
+#include "gstomxh265enc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_omx_h265_enc_debug_category);
+#define GST_CAT_DEFAULT gst_omx_h265_enc_debug_category
+
+/* prototypes */
+static gboolean gst_omx_h265_enc_set_format (GstOMXVideoEnc * enc,
+    GstOMXPort * port, GstVideoCodecState * state);
+static GstCaps *gst_omx_h265_enc_get_caps (GstOMXVideoEnc * enc,
+    GstOMXPort * port, GstVideoCodecState * state);
+static GstFlowReturn gst_omx_h265_enc_handle_output_frame (GstOMXVideoEnc *
+    self, GstOMXPort * port, GstOMXBuffer * buf, GstVideoCodecFrame * frame);
+static gboolean gst_omx_h265_enc_flush (GstVideoEncoder * enc);
+static gboolean gst_omx_h265_enc_stop (GstVideoEncoder * enc);
+
+enum
+{
+  PROP_0
+};
+
+/* Caps level and tier for every OMX_VIDEO_HEVCLEVELTYPE */
+static const struct
+{
+  const gchar *level;
+  OMX_U32 main_tier;
+  OMX_U32 high_tier;
+} h265_levels[] = {
+  {"1", OMX_VIDEO_HEVCMainTierLevel1, OMX_VIDEO_HEVCHighTierLevel1},
+  {"2", OMX_VIDEO_HEVCMainTierLevel2, OMX_VIDEO_HEVCHighTierLevel2},
+  {"2.1", OMX_VIDEO_HEVCMainTierLevel21, OMX_VIDEO_HEVCHighTierLevel21},
+  {"3", OMX_VIDEO_HEVCMainTierLevel3, OMX_VIDEO_HEVCHighTierLevel3},
+  {"3.1", OMX_VIDEO_HEVCMainTierLevel31, OMX_VIDEO_HEVCHighTierLevel31},
+  {"4", OMX_VIDEO_HEVCMainTierLevel4, OMX_VIDEO_HEVCHighTierLevel4},
+  {"4.1", OMX_VIDEO_HEVCMainTierLevel41, OMX_VIDEO_HEVCHighTierLevel41},
+  {"5", OMX_VIDEO_HEVCMainTierLevel5, OMX_VIDEO_HEVCHighTierLevel5},
+  {"5.1", OMX_VIDEO_HEVCMainTierLevel51, OMX_VIDEO_HEVCHighTierLevel51},
+  {"5.2", OMX_VIDEO_HEVCMainTierLevel52, OMX_VIDEO_HEVCHighTierLevel52},
+  {"6", OMX_VIDEO_HEVCMainTierLevel6, OMX_VIDEO_HEVCHighTierLevel6},
+  {"6.1", OMX_VIDEO_HEVCMainTierLevel61, OMX_VIDEO_HEVCHighTierLevel61},
+  {"6.2", OMX_VIDEO_HEVCMainTierLevel62, OMX_VIDEO_HEVCHighTierLevel62},
+};
+
+/* class initialization */
+
+#define DEBUG_INIT \
+  GST_DEBUG_CATEGORY_INIT (gst_omx_h265_enc_debug_category, "omxh265enc", 0, \
+      "debug category for gst-omx H.265 video encoder");
+
+#define parent_class gst_omx_h265_enc_parent_class
+G_DEFINE_TYPE_WITH_CODE (GstOMXH265Enc, gst_omx_h265_enc,
+    GST_TYPE_OMX_VIDEO_ENC, DEBUG_INIT);
+
+static void
+gst_omx_h265_enc_class_init (GstOMXH265EncClass * klass)
+{
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+  GstVideoEncoderClass *basevideoenc_class = GST_VIDEO_ENCODER_CLASS (klass);
+  GstOMXVideoEncClass *videoenc_class = GST_OMX_VIDEO_ENC_CLASS (klass);
+
+  videoenc_class->set_format = GST_DEBUG_FUNCPTR (gst_omx_h265_enc_set_format);
+  videoenc_class->get_caps = GST_DEBUG_FUNCPTR (gst_omx_h265_enc_get_caps);
+
+  basevideoenc_class->flush = gst_omx_h265_enc_flush;
+  basevideoenc_class->stop = gst_omx_h265_enc_stop;
+
+  videoenc_class->cdata.default_src_template_caps = "video/x-h265, "
+      "width=(int) [ 16, 4096 ], " "height=(int) [ 16, 4096 ]";
+  videoenc_class->handle_output_frame =
+      GST_DEBUG_FUNCPTR (gst_omx_h265_enc_handle_output_frame);
+
+  gst_element_class_set_static_metadata (element_class,
+      "OpenMAX H.265 Video Encoder",
+      "Codec/Encoder/Video",
+      "Encode H.265 video streams",
+      "gst-omx developers");
+
+  gst_omx_set_default_role (&videoenc_class->cdata, "video_encoder.hevc");
+}
+
+static void
+gst_omx_h265_enc_init (GstOMXH265Enc * self)
+{
+}
+
+static gboolean
+gst_omx_h265_enc_flush (GstVideoEncoder * enc)
+{
+  GstOMXH265Enc *self = GST_OMX_H265_ENC (enc);
+
+  g_list_free_full (self->headers, (GDestroyNotify) gst_buffer_unref);
+  self->headers = NULL;
+
+  return GST_VIDEO_ENCODER_CLASS (parent_class)->flush (enc);
+}
+
+static gboolean
+gst_omx_h265_enc_stop (GstVideoEncoder * enc)
+{
+  GstOMXH265Enc *self = GST_OMX_H265_ENC (enc);
+
+  g_list_free_full (self->headers, (GDestroyNotify) gst_buffer_unref);
+  self->headers = NULL;
+  self->packetized = FALSE;
+
+  return GST_VIDEO_ENCODER_CLASS (parent_class)->stop (enc);
+}
+
+static gboolean
+gst_omx_h265_enc_set_format (GstOMXVideoEnc * enc, GstOMXPort * port,
+    GstVideoCodecState * state)
+{
+  GstOMXH265Enc *self = GST_OMX_H265_ENC (enc);
+  GstCaps *peercaps;
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+  OMX_VIDEO_PARAM_PROFILELEVELTYPE param;
+  OMX_ERRORTYPE err;
+  const gchar *profile_string, *level_string, *tier_string;
+
+  gst_omx_port_get_port_definition (GST_OMX_VIDEO_ENC (self)->enc_out_port,
+      &port_def);
+  port_def.format.video.eCompressionFormat = OMX_VIDEO_CodingHEVC;
+  err =
+      gst_omx_port_update_port_definition (GST_OMX_VIDEO_ENC
+      (self)->enc_out_port, &port_def);
+  if (err != OMX_ErrorNone)
+    return FALSE;
+
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = GST_OMX_VIDEO_ENC (self)->enc_out_port->index;
+
+  err =
+      gst_omx_component_get_parameter (GST_OMX_VIDEO_ENC (self)->enc,
+      OMX_IndexParamVideoProfileLevelCurrent, &param);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (self,
+        "Setting profile/level not supported by component");
+    return TRUE;
+  }
+
+  peercaps = gst_pad_peer_query_caps (GST_VIDEO_ENCODER_SRC_PAD (enc),
+      gst_pad_get_pad_template_caps (GST_VIDEO_ENCODER_SRC_PAD (enc)));
+  if (peercaps) {
+    GstStructure *s;
+
+    if (gst_caps_is_empty (peercaps)) {
+      gst_caps_unref (peercaps);
+      GST_ERROR_OBJECT (self, "Empty caps");
+      return FALSE;
+    }
+
+    s = gst_caps_get_structure (peercaps, 0);
+    profile_string = gst_structure_get_string (s, "profile");
+    if (profile_string) {
+      if (g_str_equal (profile_string, "main")) {
+        param.eProfile = OMX_VIDEO_HEVCProfileMain;
+      } else if (g_str_equal (profile_string, "main-10")) {
+        param.eProfile = OMX_VIDEO_HEVCProfileMain10;
+      } else {
+        goto unsupported_profile;
+      }
+    }
+    level_string = gst_structure_get_string (s, "level");
+    tier_string = gst_structure_get_string (s, "tier");
+    if (tier_string && !g_str_equal (tier_string, "main")
+        && !g_str_equal (tier_string, "high"))
+      goto unsupported_tier;
+    if (level_string) {
+      gboolean high_tier = tier_string && g_str_equal (tier_string, "high");
+      guint i;
+
+      for (i = 0; i < G_N_ELEMENTS (h265_levels); i++) {
+        if (g_str_equal (level_string, h265_levels[i].level))
+          break;
+      }
+      if (i == G_N_ELEMENTS (h265_levels))
+        goto unsupported_level;
+
+      param.eLevel =
+          high_tier ? h265_levels[i].high_tier : h265_levels[i].main_tier;
+    }
+    gst_caps_unref (peercaps);
+  }
+
+  err =
+      gst_omx_component_set_parameter (GST_OMX_VIDEO_ENC (self)->enc,
+      OMX_IndexParamVideoProfileLevelCurrent, &param);
+  if (err == OMX_ErrorUnsupportedIndex) {
+    GST_WARNING_OBJECT (self,
+        "Setting profile/level not supported by component");
+  } else if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (self,
+        "Error setting profile %u and level %u: %s (0x%08x)",
+        (guint) param.eProfile, (guint) param.eLevel,
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  return TRUE;
+
+unsupported_profile:
+  GST_ERROR_OBJECT (self, "Unsupported profile %s", profile_string);
+  gst_caps_unref (peercaps);
+  return FALSE;
+
+unsupported_level:
+  GST_ERROR_OBJECT (self, "Unsupported level %s", level_string);
+  gst_caps_unref (peercaps);
+  return FALSE;
+
+unsupported_tier:
+  GST_ERROR_OBJECT (self, "Unsupported tier %s", tier_string);
+  gst_caps_unref (peercaps);
+  return FALSE;
+}
+
+static GstCaps *
+gst_omx_h265_enc_get_caps (GstOMXVideoEnc * enc, GstOMXPort * port,
+    GstVideoCodecState * state)
+{
+  GstOMXH265Enc *self = GST_OMX_H265_ENC (enc);
+  GstCaps *caps;
+  OMX_ERRORTYPE err;
+  OMX_VIDEO_PARAM_PROFILELEVELTYPE param;
+  const gchar *profile = NULL, *level = NULL, *tier = NULL;
+  guint i;
+
+  /* hvcC codec data means length prefixed access units, otherwise slices
+   * are pushed as they are produced with slice-output */
+  if (self->packetized)
+    caps = gst_caps_new_simple ("video/x-h265",
+        "stream-format", G_TYPE_STRING, "hvc1",
+        "alignment", G_TYPE_STRING, "au", NULL);
+  else
+    caps = gst_caps_new_simple ("video/x-h265",
+        "stream-format", G_TYPE_STRING, "byte-stream",
+        "alignment", G_TYPE_STRING, enc->slice_output ? "nal" : "au", NULL);
+
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = GST_OMX_VIDEO_ENC (self)->enc_out_port->index;
+
+  err =
+      gst_omx_component_get_parameter (GST_OMX_VIDEO_ENC (self)->enc,
+      OMX_IndexParamVideoProfileLevelCurrent, &param);
+  if (err != OMX_ErrorNone && err != OMX_ErrorUnsupportedIndex) {
+    gst_caps_unref (caps);
+    return NULL;
+  }
+
+  if (err == OMX_ErrorNone) {
+    switch (param.eProfile) {
+      case OMX_VIDEO_HEVCProfileMain:
+        profile = "main";
+        break;
+      case OMX_VIDEO_HEVCProfileMain10:
+        profile = "main-10";
+        break;
+      default:
+        break;
+    }
+
+    for (i = 0; i < G_N_ELEMENTS (h265_levels); i++) {
+      if (param.eLevel == h265_levels[i].main_tier) {
+        level = h265_levels[i].level;
+        tier = "main";
+        break;
+      } else if (param.eLevel == h265_levels[i].high_tier) {
+        level = h265_levels[i].level;
+        tier = "high";
+        break;
+      }
+    }
+
+    /* Vendor specific values are left to h265parse */
+    if (profile && level) {
+      gst_caps_set_simple (caps,
+          "profile", G_TYPE_STRING, profile, "level", G_TYPE_STRING, level,
+          "tier", G_TYPE_STRING, tier, NULL);
+    } else {
+      GST_DEBUG_OBJECT (self, "Unknown profile %u or level %u",
+          (guint) param.eProfile, (guint) param.eLevel);
+    }
+  }
+
+  return caps;
+}
+
+static GstFlowReturn
+gst_omx_h265_enc_handle_output_frame (GstOMXVideoEnc * enc, GstOMXPort * port,
+    GstOMXBuffer * buf, GstVideoCodecFrame * frame)
+{
+  GstOMXH265Enc *self = GST_OMX_H265_ENC (enc);
+
+  if (buf->omx_buf->nFlags & OMX_BUFFERFLAG_CODECCONFIG) {
+    /* The codec data is VPS/SPS/PPS with a startcode => bytestream stream
+     * format. For bytestream stream format the headers are only in-stream
+     * and not in the caps!
+     */
+    if (buf->omx_buf->nFilledLen >= 4 &&
+        GST_READ_UINT32_BE (buf->omx_buf->pBuffer +
+            buf->omx_buf->nOffset) == 0x00000001) {
+      GstBuffer *hdrs;
+      GstMapInfo map = GST_MAP_INFO_INIT;
+
+      GST_DEBUG_OBJECT (self, "got codecconfig in byte-stream format");
+
+      hdrs = gst_buffer_new_and_alloc (buf->omx_buf->nFilledLen);
+
+      gst_buffer_map (hdrs, &map, GST_MAP_WRITE);
+      memcpy (map.data,
+          buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
+          buf->omx_buf->nFilledLen);
+      gst_buffer_unmap (hdrs, &map);
+      self->headers = g_list_append (self->headers, hdrs);
+
+      if (frame)
+        gst_video_codec_frame_unref (frame);
+
+      return GST_FLOW_OK;
+    } else if (buf->omx_buf->nFilledLen > 0) {
+      /* hvcC, the base class puts it into the caps as codec_data */
+      GST_DEBUG_OBJECT (self, "got codecconfig in hvc1 format");
+      self->packetized = TRUE;
+    }
+  } else if (self->headers) {
+    gst_video_encoder_set_headers (GST_VIDEO_ENCODER (self), self->headers);
+    self->headers = NULL;
+  }
+
+  return
+      GST_OMX_VIDEO_ENC_CLASS
+      (gst_omx_h265_enc_parent_class)->handle_output_frame (enc, port, buf,
+      frame);
+}
@@ -0,0 +1,1410 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/*
+ * Decodes many H.264 streams with a limited number of components.
+ *
+ * Every requested sink pad is a stream with its own source pad. Incoming
+ * buffers are collected per stream into groups of pictures, from one
+ * keyframe up to the next one. As no decoder state has to be kept between
+ * two GOPs, each complete GOP can be decoded by any free component. The
+ * components are flushed between GOPs, and their ports are only
+ * reallocated if the next GOP has a different resolution.
+ *
+ * Free components pick the GOP with the earliest running time. Each
+ * component is driven by two threads: one feeds the GOP and waits for the
+ * EOS at its end, the other one outputs the decoded pictures.
+ *
+ * As a GOP is only scheduled once the next keyframe arrived, the latency is
+ * at least one keyframe interval. This is meant for many low frame rate
+ * streams, e.g. 64 cameras at 5 fps on 8 components.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gstomxvideo.h"
+#include "gstomxmultidec.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_omx_multi_dec_debug_category);
+#define GST_CAT_DEFAULT gst_omx_multi_dec_debug_category
+
+/* A group of pictures from one keyframe up to the next one */
+typedef struct
+{
+  GstOMXMultiDecStream *stream;
+  GQueue buffers;
+
+  /* Running time of the keyframe */
+  GstClockTime deadline;
+
+  /* Stream configuration when the GOP started */
+  gint width, height, fps_n, fps_d;
+  GstBuffer *codec_data;
+  GstSegment segment;
+
+  /* Set if the stream was flushed or released, LOCK */
+  gboolean aborted;
+} GstOMXMultiDecJob;
+
+struct _GstOMXMultiDecStream
+{
+  GstOMXMultiDec *self;
+  GstPad *sinkpad, *srcpad;
+
+  /* Input configuration, LOCK */
+  gint width, height, fps_n, fps_d;
+  GstBuffer *codec_data;
+  GstSegment segment;
+
+  /* GOP that is currently collected, LOCK */
+  GstOMXMultiDecJob *gop;
+  /* Number of queued and running GOPs, LOCK */
+  guint n_jobs;
+  /* TRUE while a component decodes a GOP of this stream, LOCK */
+  gboolean busy;
+  /* Last scheduling pass that looked at this stream, LOCK */
+  guint sched_pass;
+
+  gboolean flushing;
+  gboolean eos;
+  GstFlowReturn flow_ret;
+
+  /* Only used by the component that is decoding this stream */
+  GstVideoInfo out_info;
+  GstSegment out_segment;
+  gboolean segment_sent;
+};
+
+struct _GstOMXMultiDecInstance
+{
+  GstOMXMultiDec *self;
+  guint index;
+
+  GstOMXComponent *comp;
+  GstOMXPort *in_port, *out_port;
+
+  GThread *worker, *output;
+
+  /* Input resolution the ports are configured for, 0 if the
+   * component is in Loaded state. Only used by the worker thread */
+  gint width, height;
+
+  /* GOP that is currently decoded, LOCK */
+  GstOMXMultiDecJob *job;
+  /* TRUE once the output thread saw the EOS at the end of the GOP, LOCK */
+  gboolean job_eos;
+  /* TRUE if the component failed while decoding the GOP, LOCK */
+  gboolean failed;
+
+  /* Incremented whenever the ports are ready for a new GOP. The output
+   * thread waits for this after EOS and flushing and reports the cycle
+   * it is waiting in, LOCK */
+  guint cycle;
+  guint parked_cycle;
+};
+
+/* prototypes */
+static void gst_omx_multi_dec_finalize (GObject * object);
+static void gst_omx_multi_dec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_omx_multi_dec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+
+static GstStateChangeReturn
+gst_omx_multi_dec_change_state (GstElement * element,
+    GstStateChange transition);
+static GstPad *gst_omx_multi_dec_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_omx_multi_dec_release_pad (GstElement * element,
+    GstPad * pad);
+
+static GstFlowReturn gst_omx_multi_dec_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static gboolean gst_omx_multi_dec_sink_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+
+enum
+{
+  PROP_0,
+  PROP_MAX_INSTANCES,
+  PROP_MAX_QUEUED_GOPS
+};
+
+#define GST_OMX_MULTI_DEC_MAX_INSTANCES_DEFAULT (8)
+#define GST_OMX_MULTI_DEC_MAX_QUEUED_GOPS_DEFAULT (2)
+
+/* class initialization */
+
+#define DEBUG_INIT \
+  GST_DEBUG_CATEGORY_INIT (gst_omx_multi_dec_debug_category, "omxmultidec", 0, \
+      "debug category for gst-omx multi-stream video decoder");
+
+G_DEFINE_TYPE_WITH_CODE (GstOMXMultiDec, gst_omx_multi_dec,
+    GST_TYPE_ELEMENT, DEBUG_INIT);
+
+static void
+gst_omx_multi_dec_class_init (GstOMXMultiDecClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->finalize = gst_omx_multi_dec_finalize;
+  gobject_class->set_property = gst_omx_multi_dec_set_property;
+  gobject_class->get_property = gst_omx_multi_dec_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MAX_INSTANCES,
+      g_param_spec_uint ("max-instances", "Maximum Instances",
+          "Maximum number of components that are shared by all streams",
+          1, 64, GST_OMX_MULTI_DEC_MAX_INSTANCES_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_QUEUED_GOPS,
+      g_param_spec_uint ("max-queued-gops", "Maximum Queued GOPs",
+          "Number of complete GOPs per stream that can wait for a component "
+          "before the stream is blocked. Every queued GOP adds up to one "
+          "keyframe interval of latency",
+          1, 16, GST_OMX_MULTI_DEC_MAX_QUEUED_GOPS_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_omx_multi_dec_change_state);
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_omx_multi_dec_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_omx_multi_dec_release_pad);
+
+  klass->cdata.type = GST_OMX_COMPONENT_TYPE_MULTI_FILTER;
+  klass->cdata.default_sink_template_caps = "video/x-h264, "
+      "parsed=(boolean) true, "
+      "alignment=(string) au, "
+      "stream-format=(string) byte-stream, "
+      "width=(int) [1,MAX], " "height=(int) [1,MAX]";
+  klass->cdata.default_src_template_caps =
+      "video/x-raw, "
+      "format = (string) { I420, NV12 }, "
+      "width = " GST_VIDEO_SIZE_RANGE ", "
+      "height = " GST_VIDEO_SIZE_RANGE ", " "framerate = " GST_VIDEO_FPS_RANGE;
+
+  gst_element_class_set_static_metadata (element_class,
+      "OpenMAX Multi-Stream H.264 Video Decoder",
+      "Codec/Decoder/Video",
+      "Decode many H.264 streams with a limited number of components. "
+      "Streams are decoded GOP by GOP, which adds at least one keyframe "
+      "interval of latency",
+      "gst-omx developers");
+
+  gst_omx_set_default_role (&klass->cdata, "video_decoder.avc");
+}
+
+static void
+gst_omx_multi_dec_init (GstOMXMultiDec * self)
+{
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+  g_queue_init (&self->jobs);
+
+  self->max_instances = GST_OMX_MULTI_DEC_MAX_INSTANCES_DEFAULT;
+  self->max_queued_gops = GST_OMX_MULTI_DEC_MAX_QUEUED_GOPS_DEFAULT;
+}
+
+static void
+gst_omx_multi_dec_finalize (GObject * object)
+{
+  GstOMXMultiDec *self = GST_OMX_MULTI_DEC (object);
+
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->cond);
+
+  G_OBJECT_CLASS (gst_omx_multi_dec_parent_class)->finalize (object);
+}
+
+static void
+gst_omx_multi_dec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXMultiDec *self = GST_OMX_MULTI_DEC (object);
+
+  switch (prop_id) {
+    case PROP_MAX_INSTANCES:
+      self->max_instances = g_value_get_uint (value);
+      break;
+    case PROP_MAX_QUEUED_GOPS:
+      self->max_queued_gops = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_multi_dec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXMultiDec *self = GST_OMX_MULTI_DEC (object);
+
+  switch (prop_id) {
+    case PROP_MAX_INSTANCES:
+      g_value_set_uint (value, self->max_instances);
+      break;
+    case PROP_MAX_QUEUED_GOPS:
+      g_value_set_uint (value, self->max_queued_gops);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_multi_dec_job_free (GstOMXMultiDecJob * job)
+{
+  g_queue_foreach (&job->buffers, (GFunc) gst_buffer_unref, NULL);
+  g_queue_clear (&job->buffers);
+  gst_buffer_replace (&job->codec_data, NULL);
+  g_slice_free (GstOMXMultiDecJob, job);
+}
+
+/* Must be called with LOCK */
+static GstOMXMultiDecJob *
+gst_omx_multi_dec_job_new (GstOMXMultiDecStream * stream, GstBuffer * buffer)
+{
+  GstOMXMultiDecJob *job;
+  GstClockTime ts;
+
+  job = g_slice_new0 (GstOMXMultiDecJob);
+  job->stream = stream;
+  g_queue_init (&job->buffers);
+  job->width = stream->width;
+  job->height = stream->height;
+  job->fps_n = stream->fps_n;
+  job->fps_d = stream->fps_d;
+  gst_buffer_replace (&job->codec_data, stream->codec_data);
+  gst_segment_copy_into (&stream->segment, &job->segment);
+
+  ts = GST_BUFFER_PTS (buffer);
+  if (!GST_CLOCK_TIME_IS_VALID (ts))
+    ts = GST_BUFFER_DTS (buffer);
+  job->deadline =
+      gst_segment_to_running_time (&stream->segment, GST_FORMAT_TIME, ts);
+
+  return job;
+}
+
+/* Queues the GOP that is currently collected. Must be called with LOCK */
+static void
+gst_omx_multi_dec_close_gop (GstOMXMultiDec * self,
+    GstOMXMultiDecStream * stream)
+{
+  GstOMXMultiDecJob *job = stream->gop;
+
+  if (!job)
+    return;
+
+  stream->gop = NULL;
+
+  if (g_queue_is_empty (&job->buffers)) {
+    gst_omx_multi_dec_job_free (job);
+    return;
+  }
+
+  GST_LOG_OBJECT (stream->sinkpad, "Queueing GOP of %u buffers, deadline %"
+      GST_TIME_FORMAT, g_queue_get_length (&job->buffers),
+      GST_TIME_ARGS (job->deadline));
+
+  g_queue_push_tail (&self->jobs, job);
+  stream->n_jobs++;
+  g_cond_broadcast (&self->cond);
+}
+
+/* Drops everything that is queued for @stream and aborts the GOP that is
+ * currently decoded. Must be called with LOCK */
+static void
+gst_omx_multi_dec_drop_stream_jobs (GstOMXMultiDec * self,
+    GstOMXMultiDecStream * stream)
+{
+  GList *l, *next;
+  guint i;
+
+  for (l = self->jobs.head; l; l = next) {
+    GstOMXMultiDecJob *job = l->data;
+
+    next = l->next;
+    if (job->stream != stream)
+      continue;
+
+    g_queue_delete_link (&self->jobs, l);
+    stream->n_jobs--;
+    gst_omx_multi_dec_job_free (job);
+  }
+
+  if (stream->gop) {
+    gst_omx_multi_dec_job_free (stream->gop);
+    stream->gop = NULL;
+  }
+
+  for (i = 0; i < self->n_instances; i++) {
+    GstOMXMultiDecInstance *inst = &self->instances[i];
+
+    if (inst->job && inst->job->stream == stream)
+      inst->job->aborted = TRUE;
+  }
+
+  g_cond_broadcast (&self->cond);
+}
+
+/* Picks the GOP with the earliest deadline. Only the oldest GOP of each
+ * stream is a candidate and only if no other component is decoding the
+ * same stream, so that the pictures of a stream stay in order. On equal
+ * deadlines GOPs that can reuse the ports of @inst are preferred.
+ * Must be called with LOCK */
+static GstOMXMultiDecJob *
+gst_omx_multi_dec_pick_job (GstOMXMultiDec * self,
+    GstOMXMultiDecInstance * inst)
+{
+  GstOMXMultiDecJob *best = NULL;
+  GList *best_link = NULL;
+  gboolean best_matches = FALSE;
+  GList *l;
+
+  self->sched_pass++;
+
+  for (l = self->jobs.head; l; l = l->next) {
+    GstOMXMultiDecJob *job = l->data;
+    GstOMXMultiDecStream *stream = job->stream;
+    gboolean matches;
+
+    if (stream->sched_pass == self->sched_pass)
+      continue;
+    stream->sched_pass = self->sched_pass;
+
+    if (stream->busy)
+      continue;
+
+    matches = job->width == inst->width && job->height == inst->height;
+
+    if (!best || job->deadline < best->deadline
+        || (job->deadline == best->deadline && matches && !best_matches)) {
+      best = job;
+      best_link = l;
+      best_matches = matches;
+    }
+  }
+
+  if (best)
+    g_queue_delete_link (&self->jobs, best_link);
+
+  return best;
+}
+
+static gboolean
+gst_omx_multi_dec_open_instance (GstOMXMultiDec * self,
+    GstOMXMultiDecInstance * inst)
+{
+  GstOMXMultiDecClass *klass = GST_OMX_MULTI_DEC_GET_CLASS (self);
+
+  inst->comp =
+      gst_omx_component_new (GST_OBJECT_CAST (self), klass->cdata.core_name,
+      klass->cdata.component_name, klass->cdata.component_role,
+      klass->cdata.hacks);
+
+  if (!inst->comp)
+    return FALSE;
+
+  if (gst_omx_component_get_state (inst->comp,
+          GST_CLOCK_TIME_NONE) != OMX_StateLoaded)
+    goto error;
+
+  if (!gst_omx_video_add_ports (inst->comp, &klass->cdata, &inst->in_port,
+          &inst->out_port))
+    goto error;
+
+  inst->width = inst->height = 0;
+  inst->job = NULL;
+  inst->job_eos = FALSE;
+  inst->failed = FALSE;
+  inst->cycle = 0;
+  inst->parked_cycle = G_MAXUINT;
+
+  return TRUE;
+
+error:
+  gst_omx_component_free (inst->comp);
+  inst->comp = NULL;
+  inst->in_port = inst->out_port = NULL;
+  return FALSE;
+}
+
+/* Puts the component back into Loaded state and frees all buffers */
+static void
+gst_omx_multi_dec_shutdown_instance (GstOMXMultiDecInstance * inst)
+{
+  OMX_STATETYPE state;
+
+  state = gst_omx_component_get_state (inst->comp, 0);
+  if (state > OMX_StateLoaded || state == OMX_StateInvalid) {
+    if (state > OMX_StateIdle) {
+      gst_omx_component_set_state (inst->comp, OMX_StateIdle);
+      gst_omx_component_get_state (inst->comp, 5 * GST_SECOND);
+    }
+    gst_omx_component_set_state (inst->comp, OMX_StateLoaded);
+    gst_omx_port_deallocate_buffers (inst->in_port);
+    gst_omx_port_deallocate_buffers (inst->out_port);
+    if (state > OMX_StateLoaded)
+      gst_omx_component_get_state (inst->comp, 5 * GST_SECOND);
+  }
+
+  inst->width = inst->height = 0;
+}
+
+/* Brings the component into Executing state for the input format of @job.
+ * If it already decoded a GOP of the same resolution, the ports are
+ * reused as they are. Both ports are flushing when this is called */
+static gboolean
+gst_omx_multi_dec_configure_instance (GstOMXMultiDecInstance * inst,
+    GstOMXMultiDecJob * job)
+{
+  GstOMXMultiDec *self = inst->self;
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+
+  if (inst->width == job->width && inst->height == job->height) {
+    GST_LOG_OBJECT (self, "Instance %u: reusing ports for %dx%d",
+        inst->index, job->width, job->height);
+    return TRUE;
+  }
+
+  if (inst->width != 0) {
+    GST_DEBUG_OBJECT (self, "Instance %u: switching from %dx%d to %dx%d",
+        inst->index, inst->width, inst->height, job->width, job->height);
+    gst_omx_multi_dec_shutdown_instance (inst);
+  }
+
+  gst_omx_port_get_port_definition (inst->in_port, &port_def);
+  port_def.format.video.eCompressionFormat = OMX_VIDEO_CodingAVC;
+  port_def.format.video.nFrameWidth = job->width;
+  port_def.format.video.nFrameHeight = job->height;
+  if (job->fps_n == 0)
+    port_def.format.video.xFramerate = 0;
+  else
+    port_def.format.video.xFramerate = (job->fps_n << 16) / (job->fps_d);
+
+  if (gst_omx_port_update_port_definition (inst->in_port,
+          &port_def) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_update_port_definition (inst->out_port,
+          NULL) != OMX_ErrorNone)
+    return FALSE;
+
+  if (gst_omx_component_set_state (inst->comp, OMX_StateIdle) != OMX_ErrorNone)
+    return FALSE;
+
+  /* Need to allocate buffers to reach Idle state */
+  if (gst_omx_port_allocate_buffers (inst->in_port) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_allocate_buffers (inst->out_port) != OMX_ErrorNone)
+    return FALSE;
+
+  if (gst_omx_component_get_state (inst->comp,
+          5 * GST_SECOND) != OMX_StateIdle)
+    return FALSE;
+
+  if (gst_omx_component_set_state (inst->comp,
+          OMX_StateExecuting) != OMX_ErrorNone)
+    return FALSE;
+
+  if (gst_omx_component_get_state (inst->comp,
+          5 * GST_SECOND) != OMX_StateExecuting)
+    return FALSE;
+
+  inst->width = job->width;
+  inst->height = job->height;
+
+  return TRUE;
+}
+
+/* Passes @inbuf to the component, or an empty buffer if @inbuf is NULL */
+static gboolean
+gst_omx_multi_dec_submit (GstOMXMultiDecInstance * inst, GstBuffer * inbuf,
+    OMX_U32 flags)
+{
+  GstOMXAcquireBufferReturn acq_ret;
+  GstOMXBuffer *buf;
+  GstClockTime timestamp = GST_CLOCK_TIME_NONE;
+  gsize size = 0, offset = 0;
+
+  if (inbuf) {
+    size = gst_buffer_get_size (inbuf);
+    timestamp = GST_BUFFER_PTS (inbuf);
+  }
+
+  do {
+    acq_ret = gst_omx_port_acquire_buffer (inst->in_port, &buf);
+    if (acq_ret != GST_OMX_ACQUIRE_BUFFER_OK)
+      return FALSE;
+
+    buf->omx_buf->nFilledLen =
+        MIN (size - offset, buf->omx_buf->nAllocLen - buf->omx_buf->nOffset);
+    if (buf->omx_buf->nFilledLen > 0)
+      gst_buffer_extract (inbuf, offset,
+          buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
+          buf->omx_buf->nFilledLen);
+
+    if (GST_CLOCK_TIME_IS_VALID (timestamp))
+      GST_OMX_SET_TICKS (buf->omx_buf->nTimeStamp,
+          gst_util_uint64_scale (timestamp, OMX_TICKS_PER_SECOND, GST_SECOND));
+    else
+      GST_OMX_SET_TICKS (buf->omx_buf->nTimeStamp, G_GUINT64_CONSTANT (0));
+
+    if (inbuf && offset == 0 && GST_BUFFER_DURATION_IS_VALID (inbuf))
+      buf->omx_buf->nTickCount =
+          gst_util_uint64_scale (GST_BUFFER_DURATION (inbuf),
+          OMX_TICKS_PER_SECOND, GST_SECOND);
+    else
+      buf->omx_buf->nTickCount = 0;
+
+    if (offset == 0)
+      buf->omx_buf->nFlags |= flags;
+
+    offset += buf->omx_buf->nFilledLen;
+
+    if (inbuf && offset == size)
+      buf->omx_buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+
+    if (gst_omx_port_release_buffer (inst->in_port, buf) != OMX_ErrorNone)
+      return FALSE;
+  } while (offset < size);
+
+  return TRUE;
+}
+
+/* Decodes all buffers of @job and waits until the last picture was output */
+static gboolean
+gst_omx_multi_dec_run_job (GstOMXMultiDecInstance * inst,
+    GstOMXMultiDecJob * job)
+{
+  GstOMXMultiDec *self = inst->self;
+  OMX_ERRORTYPE err;
+  gint64 wait_until;
+  GList *l;
+
+  if (!gst_omx_multi_dec_configure_instance (inst, job))
+    return FALSE;
+
+  /* Let the output thread continue with the new GOP */
+  gst_omx_port_set_flushing (inst->in_port, 5 * GST_SECOND, FALSE);
+  gst_omx_port_set_flushing (inst->out_port, 5 * GST_SECOND, FALSE);
+
+  err = gst_omx_port_populate (inst->out_port);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (self, "Instance %u: failed to populate output port: "
+        "%s (0x%08x)", inst->index, gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  g_mutex_lock (&self->lock);
+  inst->cycle++;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  if (job->codec_data
+      && !gst_omx_multi_dec_submit (inst, job->codec_data,
+          OMX_BUFFERFLAG_CODECCONFIG))
+    return FALSE;
+
+  for (l = job->buffers.head; l; l = l->next) {
+    gboolean aborted;
+
+    g_mutex_lock (&self->lock);
+    aborted = job->aborted || !self->running;
+    g_mutex_unlock (&self->lock);
+    if (aborted)
+      return TRUE;
+
+    if (!gst_omx_multi_dec_submit (inst, l->data,
+            l == job->buffers.head ? OMX_BUFFERFLAG_SYNCFRAME : 0))
+      return FALSE;
+  }
+
+  /* Mark the end of the GOP */
+  if (!gst_omx_multi_dec_submit (inst, NULL, OMX_BUFFERFLAG_EOS))
+    return FALSE;
+
+  if (inst->comp->hacks & GST_OMX_HACK_DRAIN_MAY_NOT_RETURN)
+    wait_until = g_get_monotonic_time () + G_TIME_SPAN_SECOND / 2;
+  else
+    wait_until = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&self->lock);
+  while (!inst->job_eos && !inst->failed && !job->aborted && self->running) {
+    if (!g_cond_wait_until (&self->cond, &self->lock, wait_until)) {
+      GST_WARNING_OBJECT (self, "Instance %u: timeout waiting for the end "
+          "of the GOP", inst->index);
+      break;
+    }
+  }
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+
+/* Flushes both ports after a GOP and waits until the output thread
+ * does not use the output port anymore */
+static void
+gst_omx_multi_dec_recycle_instance (GstOMXMultiDecInstance * inst)
+{
+  GstOMXMultiDec *self = inst->self;
+  GstOMXPort *ports[2];
+  OMX_ERRORTYPE err;
+
+  ports[0] = inst->in_port;
+  ports[1] = inst->out_port;
+
+  if (gst_omx_component_get_state (inst->comp, 0) == OMX_StateExecuting) {
+    err = gst_omx_component_flush_ports (inst->comp, ports,
+        G_N_ELEMENTS (ports), 5 * GST_SECOND);
+    if (err != OMX_ErrorNone)
+      GST_WARNING_OBJECT (self, "Instance %u: failed to flush ports: "
+          "%s (0x%08x)", inst->index, gst_omx_error_to_string (err), err);
+  } else {
+    gst_omx_port_set_flushing (inst->in_port, 5 * GST_SECOND, TRUE);
+    gst_omx_port_set_flushing (inst->out_port, 5 * GST_SECOND, TRUE);
+  }
+
+  g_mutex_lock (&self->lock);
+  while (inst->parked_cycle != inst->cycle && self->running)
+    g_cond_wait (&self->cond, &self->lock);
+  g_mutex_unlock (&self->lock);
+}
+
+static gpointer
+gst_omx_multi_dec_worker (GstOMXMultiDecInstance * inst)
+{
+  GstOMXMultiDec *self = inst->self;
+
+  g_mutex_lock (&self->lock);
+  while (self->running) {
+    GstOMXMultiDecJob *job;
+    GstOMXMultiDecStream *stream;
+    gboolean ok, failed, push_eos;
+
+    job = gst_omx_multi_dec_pick_job (self, inst);
+    if (!job) {
+      g_cond_wait (&self->cond, &self->lock);
+      continue;
+    }
+
+    stream = job->stream;
+    stream->busy = TRUE;
+    inst->job = job;
+    inst->job_eos = FALSE;
+    inst->failed = FALSE;
+    g_mutex_unlock (&self->lock);
+
+    GST_LOG_OBJECT (self, "Instance %u: decoding GOP of %s, deadline %"
+        GST_TIME_FORMAT, inst->index, GST_PAD_NAME (stream->sinkpad),
+        GST_TIME_ARGS (job->deadline));
+
+    ok = gst_omx_multi_dec_run_job (inst, job);
+    gst_omx_multi_dec_recycle_instance (inst);
+
+    g_mutex_lock (&self->lock);
+    failed = inst->failed || (!ok && !job->aborted && self->running);
+    inst->job = NULL;
+    stream->n_jobs--;
+    push_eos = stream->eos && stream->n_jobs == 0 && !stream->gop
+        && !stream->flushing && !job->aborted;
+    g_mutex_unlock (&self->lock);
+
+    if (failed) {
+      GST_ELEMENT_WARNING (self, LIBRARY, FAILED, (NULL),
+          ("Instance %u failed to decode a GOP of %s: %s (0x%08x)",
+              inst->index, GST_PAD_NAME (stream->sinkpad),
+              gst_omx_component_get_last_error_string (inst->comp),
+              gst_omx_component_get_last_error (inst->comp)));
+      /* Start again from Loaded state with the next GOP */
+      gst_omx_multi_dec_shutdown_instance (inst);
+    }
+
+    if (push_eos)
+      gst_pad_push_event (stream->srcpad, gst_event_new_eos ());
+
+    gst_omx_multi_dec_job_free (job);
+
+    g_mutex_lock (&self->lock);
+    stream->busy = FALSE;
+    g_cond_broadcast (&self->cond);
+  }
+  g_mutex_unlock (&self->lock);
+
+  return NULL;
+}
+
+static gboolean
+gst_omx_multi_dec_reconfigure_output (GstOMXMultiDecInstance * inst)
+{
+  GstOMXPort *port = inst->out_port;
+
+  if (gst_omx_port_is_enabled (port)) {
+    if (gst_omx_port_set_enabled (port, FALSE) != OMX_ErrorNone)
+      return FALSE;
+    if (gst_omx_port_wait_buffers_released (port,
+            5 * GST_SECOND) != OMX_ErrorNone)
+      return FALSE;
+    if (gst_omx_port_deallocate_buffers (port) != OMX_ErrorNone)
+      return FALSE;
+    if (gst_omx_port_wait_enabled (port, 1 * GST_SECOND) != OMX_ErrorNone)
+      return FALSE;
+  }
+
+  if (gst_omx_port_update_port_definition (port, NULL) != OMX_ErrorNone)
+    return FALSE;
+
+  if (gst_omx_port_set_enabled (port, TRUE) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_allocate_buffers (port) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_wait_enabled (port, 5 * GST_SECOND) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_populate (port) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_mark_reconfigured (port) != OMX_ErrorNone)
+    return FALSE;
+
+  GST_DEBUG_OBJECT (inst->self, "Instance %u: output port reconfigured to "
+      "%ux%u", inst->index, (guint) port->port_def.format.video.nFrameWidth,
+      (guint) port->port_def.format.video.nFrameHeight);
+
+  return TRUE;
+}
+
+/* Copies the decoded picture into a new buffer, taking the stride and
+ * slice height of the output port into account */
+static GstBuffer *
+gst_omx_multi_dec_copy_output (GstOMXMultiDecInstance * inst,
+    GstVideoInfo * vinfo, GstOMXBuffer * inbuf)
+{
+  GstVideoFrame frame;
+  GstBuffer *outbuf;
+  gboolean ret;
+
+  outbuf = gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (vinfo), NULL);
+  if (!gst_video_frame_map (&frame, vinfo, outbuf, GST_MAP_WRITE)) {
+    gst_buffer_unref (outbuf);
+    return NULL;
+  }
+
+  ret = gst_omx_video_copy_frame (inbuf, &inst->out_port->port_def, 0, 0,
+      &frame);
+  gst_video_frame_unmap (&frame);
+  if (!ret) {
+    GST_ERROR_OBJECT (inst->self, "Instance %u: failed to copy the picture",
+        inst->index);
+    gst_buffer_unref (outbuf);
+    return NULL;
+  }
+
+  gst_omx_video_set_buffer_times (inbuf, outbuf);
+
+  return outbuf;
+}
+
+/* Pushes a decoded picture on the source pad of @job's stream. Caps and
+ * segment are sent first whenever they changed */
+static GstFlowReturn
+gst_omx_multi_dec_push_output (GstOMXMultiDecInstance * inst,
+    GstOMXMultiDecJob * job, GstOMXBuffer * buf)
+{
+  GstOMXMultiDecStream *stream = job->stream;
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &inst->out_port->port_def;
+  GstVideoFormat format;
+  GstBuffer *outbuf;
+
+  format = gst_omx_video_get_format_from_omx (port_def->format.video.
+      eColorFormat);
+  if (format != GST_VIDEO_FORMAT_I420 && format != GST_VIDEO_FORMAT_NV12) {
+    GST_ERROR_OBJECT (inst->self, "Unsupported color format: %d",
+        port_def->format.video.eColorFormat);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  if (GST_VIDEO_INFO_FORMAT (&stream->out_info) != format
+      || GST_VIDEO_INFO_WIDTH (&stream->out_info) !=
+      port_def->format.video.nFrameWidth
+      || GST_VIDEO_INFO_HEIGHT (&stream->out_info) !=
+      port_def->format.video.nFrameHeight
+      || GST_VIDEO_INFO_FPS_N (&stream->out_info) != job->fps_n
+      || GST_VIDEO_INFO_FPS_D (&stream->out_info) != job->fps_d) {
+    GstVideoInfo info;
+    GstCaps *caps;
+
+    gst_video_info_set_format (&info, format,
+        port_def->format.video.nFrameWidth,
+        port_def->format.video.nFrameHeight);
+    GST_VIDEO_INFO_FPS_N (&info) = job->fps_n;
+    GST_VIDEO_INFO_FPS_D (&info) = job->fps_d;
+
+    caps = gst_video_info_to_caps (&info);
+    GST_DEBUG_OBJECT (stream->srcpad, "Setting caps %" GST_PTR_FORMAT, caps);
+    if (!gst_pad_push_event (stream->srcpad, gst_event_new_caps (caps))) {
+      gst_caps_unref (caps);
+      return GST_FLOW_NOT_NEGOTIATED;
+    }
+    gst_caps_unref (caps);
+    stream->out_info = info;
+  }
+
+  if (!stream->segment_sent
+      || !gst_segment_is_equal (&stream->out_segment, &job->segment)) {
+    gst_segment_copy_into (&job->segment, &stream->out_segment);
+    gst_pad_push_event (stream->srcpad,
+        gst_event_new_segment (&stream->out_segment));
+    stream->segment_sent = TRUE;
+  }
+
+  outbuf = gst_omx_multi_dec_copy_output (inst, &stream->out_info, buf);
+  if (!outbuf)
+    return GST_FLOW_ERROR;
+
+  return gst_pad_push (stream->srcpad, outbuf);
+}
+
+static gpointer
+gst_omx_multi_dec_output_loop (GstOMXMultiDecInstance * inst)
+{
+  GstOMXMultiDec *self = inst->self;
+  guint cookie;
+
+  g_mutex_lock (&self->lock);
+  cookie = inst->cycle;
+  while (self->running) {
+    GstOMXAcquireBufferReturn acq_ret;
+    GstOMXBuffer *buf = NULL;
+    GstOMXMultiDecJob *job;
+    GstFlowReturn flow_ret;
+    gboolean aborted;
+
+    /* Wait until the worker prepared the ports for the next GOP */
+    if (inst->cycle == cookie) {
+      inst->parked_cycle = cookie;
+      g_cond_broadcast (&self->cond);
+      g_cond_wait (&self->cond, &self->lock);
+      continue;
+    }
+    inst->parked_cycle = G_MAXUINT;
+    g_mutex_unlock (&self->lock);
+
+    acq_ret = gst_omx_port_acquire_buffer (inst->out_port, &buf);
+
+    switch (acq_ret) {
+      case GST_OMX_ACQUIRE_BUFFER_OK:
+        g_mutex_lock (&self->lock);
+        job = inst->job;
+        aborted = !job || job->aborted;
+        g_mutex_unlock (&self->lock);
+
+        flow_ret = GST_FLOW_OK;
+        if (!aborted && buf->omx_buf->nFilledLen > 0)
+          flow_ret = gst_omx_multi_dec_push_output (inst, job, buf);
+
+        gst_omx_port_release_buffer (inst->out_port, buf);
+
+        g_mutex_lock (&self->lock);
+        if (flow_ret != GST_FLOW_OK) {
+          GST_DEBUG_OBJECT (job->stream->srcpad, "Flow return %s",
+              gst_flow_get_name (flow_ret));
+          job->stream->flow_ret = flow_ret;
+          job->aborted = TRUE;
+          g_cond_broadcast (&self->cond);
+        }
+        break;
+      case GST_OMX_ACQUIRE_BUFFER_RECONFIGURE:
+        if (!gst_omx_multi_dec_reconfigure_output (inst)) {
+          g_mutex_lock (&self->lock);
+          inst->failed = TRUE;
+          cookie = inst->cycle;
+          g_cond_broadcast (&self->cond);
+        } else {
+          g_mutex_lock (&self->lock);
+        }
+        break;
+      case GST_OMX_ACQUIRE_BUFFER_EOS:
+        g_mutex_lock (&self->lock);
+        inst->job_eos = TRUE;
+        cookie = inst->cycle;
+        g_cond_broadcast (&self->cond);
+        break;
+      case GST_OMX_ACQUIRE_BUFFER_FLUSHING:
+        g_mutex_lock (&self->lock);
+        cookie = inst->cycle;
+        break;
+      case GST_OMX_ACQUIRE_BUFFER_ERROR:
+      default:
+        g_mutex_lock (&self->lock);
+        inst->failed = TRUE;
+        cookie = inst->cycle;
+        g_cond_broadcast (&self->cond);
+        break;
+    }
+  }
+  inst->parked_cycle = inst->cycle;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  return NULL;
+}
+
+static gboolean
+gst_omx_multi_dec_start (GstOMXMultiDec * self)
+{
+  GList *l;
+  guint i;
+
+  self->instances = g_new0 (GstOMXMultiDecInstance, self->max_instances);
+  self->n_instances = 0;
+
+  /* The hardware might support fewer instances than requested */
+  for (i = 0; i < self->max_instances; i++) {
+    GstOMXMultiDecInstance *inst = &self->instances[i];
+
+    inst->self = self;
+    inst->index = i;
+    if (!gst_omx_multi_dec_open_instance (self, inst))
+      break;
+    self->n_instances++;
+  }
+
+  if (self->n_instances == 0) {
+    GST_ERROR_OBJECT (self, "Failed to create any component");
+    g_free (self->instances);
+    self->instances = NULL;
+    return FALSE;
+  }
+
+  if (self->n_instances < self->max_instances)
+    GST_WARNING_OBJECT (self, "Only %u of %u components could be created",
+        self->n_instances, self->max_instances);
+  else
+    GST_DEBUG_OBJECT (self, "Created %u components", self->n_instances);
+
+  g_mutex_lock (&self->lock);
+  self->running = TRUE;
+  for (l = self->streams; l; l = l->next) {
+    GstOMXMultiDecStream *stream = l->data;
+
+    stream->flushing = FALSE;
+    stream->eos = FALSE;
+    stream->flow_ret = GST_FLOW_OK;
+    stream->segment_sent = FALSE;
+    gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+    gst_video_info_init (&stream->out_info);
+  }
+  g_mutex_unlock (&self->lock);
+
+  for (i = 0; i < self->n_instances; i++) {
+    GstOMXMultiDecInstance *inst = &self->instances[i];
+    gchar *name;
+
+    name = g_strdup_printf ("omxmultidec-%u", i);
+    inst->worker =
+        g_thread_new (name, (GThreadFunc) gst_omx_multi_dec_worker, inst);
+    g_free (name);
+
+    name = g_strdup_printf ("omxmultidec-out-%u", i);
+    inst->output =
+        g_thread_new (name, (GThreadFunc) gst_omx_multi_dec_output_loop, inst);
+    g_free (name);
+  }
+
+  return TRUE;
+}
+
+/* Wakes up all threads, called before the pads are deactivated */
+static void
+gst_omx_multi_dec_unblock (GstOMXMultiDec * self)
+{
+  GList *l;
+  guint i;
+
+  g_mutex_lock (&self->lock);
+  self->running = FALSE;
+  for (l = self->streams; l; l = l->next) {
+    GstOMXMultiDecStream *stream = l->data;
+
+    stream->flushing = TRUE;
+  }
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  for (i = 0; i < self->n_instances; i++) {
+    gst_omx_port_set_flushing (self->instances[i].in_port, 5 * GST_SECOND,
+        TRUE);
+    gst_omx_port_set_flushing (self->instances[i].out_port, 5 * GST_SECOND,
+        TRUE);
+  }
+}
+
+static void
+gst_omx_multi_dec_stop (GstOMXMultiDec * self)
+{
+  GstOMXMultiDecJob *job;
+  GList *l;
+  guint i;
+
+  for (i = 0; i < self->n_instances; i++) {
+    GstOMXMultiDecInstance *inst = &self->instances[i];
+
+    if (inst->worker)
+      g_thread_join (inst->worker);
+    if (inst->output)
+      g_thread_join (inst->output);
+    inst->worker = inst->output = NULL;
+
+    gst_omx_multi_dec_shutdown_instance (inst);
+    gst_omx_component_free (inst->comp);
+    inst->comp = NULL;
+  }
+
+  g_free (self->instances);
+  self->instances = NULL;
+  self->n_instances = 0;
+
+  g_mutex_lock (&self->lock);
+  while ((job = g_queue_pop_head (&self->jobs)))
+    gst_omx_multi_dec_job_free (job);
+  for (l = self->streams; l; l = l->next) {
+    GstOMXMultiDecStream *stream = l->data;
+
+    if (stream->gop)
+      gst_omx_multi_dec_job_free (stream->gop);
+    stream->gop = NULL;
+    stream->n_jobs = 0;
+    stream->busy = FALSE;
+  }
+  g_mutex_unlock (&self->lock);
+}
+
+static GstStateChangeReturn
+gst_omx_multi_dec_change_state (GstElement * element, GstStateChange transition)
+{
+  GstOMXMultiDec *self = GST_OMX_MULTI_DEC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      if (!gst_omx_multi_dec_start (self))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_omx_multi_dec_unblock (self);
+      break;
+    default:
+      break;
+  }
+
+  ret =
+      GST_ELEMENT_CLASS (gst_omx_multi_dec_parent_class)->change_state
+      (element, transition);
+
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_omx_multi_dec_stop (self);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static GstPad *
+gst_omx_multi_dec_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstOMXMultiDec *self = GST_OMX_MULTI_DEC (element);
+  GstPadTemplate *src_templ;
+  GstOMXMultiDecStream *stream;
+  gchar *pad_name;
+  guint id;
+
+  src_templ =
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (element),
+      "src_%u");
+  g_return_val_if_fail (src_templ != NULL, NULL);
+
+  g_mutex_lock (&self->lock);
+  if (name && sscanf (name, "sink_%u", &id) == 1) {
+    GList *l;
+
+    for (l = self->streams; l; l = l->next) {
+      GstOMXMultiDecStream *other = l->data;
+
+      if (g_str_equal (GST_PAD_NAME (other->sinkpad), name)) {
+        g_mutex_unlock (&self->lock);
+        GST_WARNING_OBJECT (self, "Pad %s already exists", name);
+        return NULL;
+      }
+    }
+    self->next_stream_id = MAX (self->next_stream_id, id + 1);
+  } else {
+    id = self->next_stream_id++;
+  }
+  g_mutex_unlock (&self->lock);
+
+  stream = g_slice_new0 (GstOMXMultiDecStream);
+  stream->self = self;
+  stream->flow_ret = GST_FLOW_OK;
+  gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+  gst_segment_init (&stream->out_segment, GST_FORMAT_TIME);
+  gst_video_info_init (&stream->out_info);
+
+  pad_name = g_strdup_printf ("sink_%u", id);
+  stream->sinkpad = gst_pad_new_from_template (templ, pad_name);
+  g_free (pad_name);
+  gst_pad_set_chain_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_multi_dec_chain));
+  gst_pad_set_event_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_multi_dec_sink_event));
+  gst_pad_set_element_private (stream->sinkpad, stream);
+
+  pad_name = g_strdup_printf ("src_%u", id);
+  stream->srcpad = gst_pad_new_from_template (src_templ, pad_name);
+  g_free (pad_name);
+  gst_pad_use_fixed_caps (stream->srcpad);
+  gst_pad_set_element_private (stream->srcpad, stream);
+
+  g_mutex_lock (&self->lock);
+  self->streams = g_list_append (self->streams, stream);
+  g_mutex_unlock (&self->lock);
+
+  gst_element_add_pad (element, stream->srcpad);
+  gst_element_add_pad (element, stream->sinkpad);
+
+  return stream->sinkpad;
+}
+
+static void
+gst_omx_multi_dec_release_pad (GstElement * element, GstPad * pad)
+{
+  GstOMXMultiDec *self = GST_OMX_MULTI_DEC (element);
+  GstOMXMultiDecStream *stream = gst_pad_get_element_private (pad);
+
+  g_mutex_lock (&self->lock);
+  stream->flushing = TRUE;
+  gst_omx_multi_dec_drop_stream_jobs (self, stream);
+  while (stream->busy)
+    g_cond_wait (&self->cond, &self->lock);
+  g_mutex_unlock (&self->lock);
+
+  /* Waits until the chain function returned */
+  gst_pad_set_active (stream->sinkpad, FALSE);
+
+  g_mutex_lock (&self->lock);
+  self->streams = g_list_remove (self->streams, stream);
+  g_mutex_unlock (&self->lock);
+
+  gst_pad_set_active (stream->srcpad, FALSE);
+  gst_element_remove_pad (element, stream->srcpad);
+  gst_element_remove_pad (element, stream->sinkpad);
+
+  gst_buffer_replace (&stream->codec_data, NULL);
+  g_slice_free (GstOMXMultiDecStream, stream);
+}
+
+static gboolean
+gst_omx_multi_dec_set_caps (GstOMXMultiDec * self,
+    GstOMXMultiDecStream * stream, GstCaps * caps)
+{
+  GstStructure *s = gst_caps_get_structure (caps, 0);
+  const GValue *codec_data;
+  gint width, height, fps_n = 0, fps_d = 1;
+
+  if (!gst_structure_get_int (s, "width", &width)
+      || !gst_structure_get_int (s, "height", &height)) {
+    GST_ERROR_OBJECT (stream->sinkpad, "No resolution in caps %"
+        GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+  gst_structure_get_fraction (s, "framerate", &fps_n, &fps_d);
+
+  GST_DEBUG_OBJECT (stream->sinkpad, "Setting caps %" GST_PTR_FORMAT, caps);
+
+  g_mutex_lock (&self->lock);
+  /* The pictures of the current GOP belong to the old configuration */
+  gst_omx_multi_dec_close_gop (self, stream);
+
+  stream->width = width;
+  stream->height = height;
+  stream->fps_n = fps_n;
+  stream->fps_d = fps_d;
+
+  codec_data = gst_structure_get_value (s, "codec_data");
+  if (codec_data && G_VALUE_TYPE (codec_data) == GST_TYPE_BUFFER)
+    gst_buffer_replace (&stream->codec_data, gst_value_get_buffer (codec_data));
+  else
+    gst_buffer_replace (&stream->codec_data, NULL);
+  g_mutex_unlock (&self->lock);
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_multi_dec_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstOMXMultiDec *self = GST_OMX_MULTI_DEC (parent);
+  GstOMXMultiDecStream *stream = gst_pad_get_element_private (pad);
+  gboolean ret = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      ret = gst_omx_multi_dec_set_caps (self, stream, caps);
+      gst_event_unref (event);
+      break;
+    }
+    case GST_EVENT_SEGMENT:{
+      GstSegment segment;
+
+      gst_event_copy_segment (event, &segment);
+      gst_event_unref (event);
+
+      if (segment.format != GST_FORMAT_TIME) {
+        GST_ERROR_OBJECT (pad, "Only TIME segments are supported");
+        ret = FALSE;
+        break;
+      }
+
+      /* Sent downstream together with the next decoded picture */
+      g_mutex_lock (&self->lock);
+      gst_omx_multi_dec_close_gop (self, stream);
+      stream->segment = segment;
+      g_mutex_unlock (&self->lock);
+      break;
+    }
+    case GST_EVENT_EOS:{
+      gboolean push_eos;
+
+      g_mutex_lock (&self->lock);
+      gst_omx_multi_dec_close_gop (self, stream);
+      stream->eos = TRUE;
+      push_eos = stream->n_jobs == 0;
+      g_mutex_unlock (&self->lock);
+
+      /* Otherwise sent after the last GOP was decoded */
+      if (push_eos)
+        ret = gst_pad_push_event (stream->srcpad, event);
+      else
+        gst_event_unref (event);
+      break;
+    }
+    case GST_EVENT_FLUSH_START:
+      g_mutex_lock (&self->lock);
+      stream->flushing = TRUE;
+      gst_omx_multi_dec_drop_stream_jobs (self, stream);
+      g_mutex_unlock (&self->lock);
+
+      ret = gst_pad_push_event (stream->srcpad, event);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      g_mutex_lock (&self->lock);
+      /* Wait until a GOP that was aborted is done with the source pad */
+      while (stream->busy)
+        g_cond_wait (&self->cond, &self->lock);
+      stream->flushing = FALSE;
+      stream->eos = FALSE;
+      stream->flow_ret = GST_FLOW_OK;
+      stream->segment_sent = FALSE;
+      gst_segment_init (&stream->segment, GST_FORMAT_TIME);
+      g_mutex_unlock (&self->lock);
+
+      ret = gst_pad_push_event (stream->srcpad, event);
+      break;
+    default:
+      ret = gst_pad_push_event (stream->srcpad, event);
+      break;
+  }
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_omx_multi_dec_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  GstOMXMultiDec *self = GST_OMX_MULTI_DEC (parent);
+  GstOMXMultiDecStream *stream = gst_pad_get_element_private (pad);
+  GstFlowReturn ret;
+  gboolean keyframe;
+
+  keyframe = !GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  g_mutex_lock (&self->lock);
+  if (stream->flushing) {
+    ret = GST_FLOW_FLUSHING;
+    goto drop;
+  }
+  if (stream->flow_ret != GST_FLOW_OK) {
+    ret = stream->flow_ret;
+    goto drop;
+  }
+  if (stream->width == 0) {
+    ret = GST_FLOW_NOT_NEGOTIATED;
+    goto drop;
+  }
+
+  /* A keyframe ends the previous GOP */
+  if (keyframe)
+    gst_omx_multi_dec_close_gop (self, stream);
+
+  if (!stream->gop) {
+    if (!keyframe) {
+      GST_LOG_OBJECT (pad, "Waiting for a keyframe, dropping buffer");
+      ret = GST_FLOW_OK;
+      goto drop;
+    }
+    stream->gop = gst_omx_multi_dec_job_new (stream, buffer);
+  }
+
+  g_queue_push_tail (&stream->gop->buffers, buffer);
+
+  /* Don't let a stream run too far ahead of the components */
+  while (stream->n_jobs >= self->max_queued_gops && !stream->flushing
+      && self->running)
+    g_cond_wait (&self->cond, &self->lock);
+
+  ret = stream->flushing ? GST_FLOW_FLUSHING : stream->flow_ret;
+  g_mutex_unlock (&self->lock);
+
+  return ret;
+
+drop:
+  g_mutex_unlock (&self->lock);
+  gst_buffer_unref (buffer);
+  return ret;
+}
@@ -0,0 +1,90 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_OMX_MULTI_DEC_H__
+#define __GST_OMX_MULTI_DEC_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstomx.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_OMX_MULTI_DEC \
+  (gst_omx_multi_dec_get_type())
+#define GST_OMX_MULTI_DEC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OMX_MULTI_DEC,GstOMXMultiDec))
+#define GST_OMX_MULTI_DEC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OMX_MULTI_DEC,GstOMXMultiDecClass))
+#define GST_OMX_MULTI_DEC_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS((obj),GST_TYPE_OMX_MULTI_DEC,GstOMXMultiDecClass))
+#define GST_IS_OMX_MULTI_DEC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OMX_MULTI_DEC))
+#define GST_IS_OMX_MULTI_DEC_CLASS(obj) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OMX_MULTI_DEC))
+
+typedef struct _GstOMXMultiDec GstOMXMultiDec;
+typedef struct _GstOMXMultiDecClass GstOMXMultiDecClass;
+typedef struct _GstOMXMultiDecStream GstOMXMultiDecStream;
+typedef struct _GstOMXMultiDecInstance GstOMXMultiDecInstance;
+
+struct _GstOMXMultiDec
+{
+  GstElement parent;
+
+  /* < private > */
+  GMutex lock;
+  GCond cond;
+
+  /* TRUE while the instance threads should run, LOCK */
+  gboolean running;
+
+  /* One stream per requested sink pad, LOCK */
+  GList *streams;
+  guint next_stream_id;
+  /* Incremented on every scheduling decision, LOCK */
+  guint sched_pass;
+
+  /* GOPs waiting for a component, in arrival order, LOCK */
+  GQueue jobs;
+
+  /* Components, only created between READY and PAUSED */
+  GstOMXMultiDecInstance *instances;
+  guint n_instances;
+
+  /* properties */
+  guint max_instances;
+  guint max_queued_gops;
+};
+
+struct _GstOMXMultiDecClass
+{
+  GstElementClass parent_class;
+
+  GstOMXClassData cdata;
+};
+
+GType gst_omx_multi_dec_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_OMX_MULTI_DEC_H__ */
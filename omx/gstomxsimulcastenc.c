@@ -0,0 +1,1453 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/*
+ * Encodes one raw video stream into several H.264 renditions, e.g. for
+ * an adaptive bitrate ladder.
+ *
+ * Every rendition has its own component and source pad. The input ports
+ * of all components use the same buffer memory: each frame is copied (or
+ * converted) once into the next slot, and the buffer of that slot is then
+ * passed to every component. A slot is only reused once all components
+ * returned it. If the input ports don't agree on the stride, slice height
+ * and color format, each component gets its own copy of every frame
+ * instead. The renditions are scaled by the components if they
+ * support a different output size, otherwise they are encoded at the
+ * input size.
+ *
+ * IDR frames are always requested from all components for the same input
+ * frame, every key-int-max frames and for force-key-unit events, so that
+ * the renditions can be segmented at the same positions.
+ *
+ * A GstVideoEncoder only has a single source pad, so this is a plain
+ * element. It uses the port setup, input conversion and output buffer
+ * wrapping of omxvideoenc instead.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "gstomxvideo.h"
+#include "gstomxvideoenc.h"
+#include "gstomxsimulcastenc.h"
+
+#ifdef USE_OMX_TARGET_RPI
+#include <OMX_Broadcom.h>
+#include <OMX_Index.h>
+#endif
+
+GST_DEBUG_CATEGORY_STATIC (gst_omx_simulcast_enc_debug_category);
+#define GST_CAT_DEFAULT gst_omx_simulcast_enc_debug_category
+
+struct _GstOMXSimulcastEncRendition
+{
+  GstOMXSimulcastEnc *self;
+  guint index;
+  GstPad *srcpad;
+
+  /* Requested size, 0 for the input size, and bitrate */
+  gint width, height;
+  guint32 bitrate;
+
+  GstOMXComponent *comp;
+  GstOMXPort *in_port, *out_port;
+
+  GThread *output;
+  /* TRUE if the output thread should exit, LOCK */
+  gboolean quit;
+  /* TRUE while the output thread waits for the end of
+   * flushing, LOCK */
+  gboolean parked;
+  /* TRUE once the EOS buffer came out of the component, LOCK */
+  gboolean eos;
+
+  /* Input buffers returned by the component, by slot. Only used by
+   * the streaming thread */
+  GstOMXBuffer **held;
+};
+
+/* prototypes */
+static void gst_omx_simulcast_enc_finalize (GObject * object);
+static void gst_omx_simulcast_enc_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_omx_simulcast_enc_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+
+static GstStateChangeReturn
+gst_omx_simulcast_enc_change_state (GstElement * element,
+    GstStateChange transition);
+
+static GstFlowReturn gst_omx_simulcast_enc_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static gboolean gst_omx_simulcast_enc_sink_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+static gboolean gst_omx_simulcast_enc_src_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+
+enum
+{
+  PROP_0,
+  PROP_RENDITIONS,
+  PROP_KEY_INT_MAX
+};
+
+#define GST_OMX_SIMULCAST_ENC_RENDITIONS_DEFAULT (NULL)
+#define GST_OMX_SIMULCAST_ENC_KEY_INT_MAX_DEFAULT (0)
+
+/* class initialization */
+
+#define DEBUG_INIT \
+  GST_DEBUG_CATEGORY_INIT (gst_omx_simulcast_enc_debug_category, \
+      "omxsimulcastenc", 0, "debug category for gst-omx simulcast encoder");
+
+G_DEFINE_TYPE_WITH_CODE (GstOMXSimulcastEnc, gst_omx_simulcast_enc,
+    GST_TYPE_ELEMENT, DEBUG_INIT);
+
+static void
+gst_omx_simulcast_enc_class_init (GstOMXSimulcastEncClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->finalize = gst_omx_simulcast_enc_finalize;
+  gobject_class->set_property = gst_omx_simulcast_enc_set_property;
+  gobject_class->get_property = gst_omx_simulcast_enc_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_RENDITIONS,
+      g_param_spec_string ("renditions", "Renditions",
+          "Comma separated list of WIDTHxHEIGHT[:BITRATE], one source pad "
+          "per entry (NULL=one rendition at the input size)",
+          GST_OMX_SIMULCAST_ENC_RENDITIONS_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_KEY_INT_MAX,
+      g_param_spec_uint ("key-int-max", "Maximum Keyframe Interval",
+          "Number of frames between the IDR frames of all renditions "
+          "(0=component default)",
+          0, G_MAXINT, GST_OMX_SIMULCAST_ENC_KEY_INT_MAX_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_enc_change_state);
+
+  klass->cdata.type = GST_OMX_COMPONENT_TYPE_SPLIT_FILTER;
+  klass->cdata.default_sink_template_caps = "video/x-raw, "
+      "format = (string) { I420, NV12, YUY2, UYVY, BGRx }, "
+      "width = " GST_VIDEO_SIZE_RANGE ", "
+      "height = " GST_VIDEO_SIZE_RANGE ", " "framerate = " GST_VIDEO_FPS_RANGE;
+  klass->cdata.default_src_template_caps = "video/x-h264, "
+      "width=(int) [ 16, 4096 ], " "height=(int) [ 16, 4096 ], "
+      "framerate = " GST_VIDEO_FPS_RANGE ", "
+      "stream-format=(string) byte-stream, alignment=(string) au";
+
+  gst_element_class_set_static_metadata (element_class,
+      "OpenMAX H.264 Simulcast Video Encoder",
+      "Codec/Encoder/Video",
+      "Encode one video stream into several H.264 renditions",
+      "gst-omx developers");
+
+  gst_omx_set_default_role (&klass->cdata, "video_encoder.avc");
+}
+
+static void
+gst_omx_simulcast_enc_init (GstOMXSimulcastEnc * self)
+{
+  GstPadTemplate *templ;
+
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+  self->flow_combiner = gst_flow_combiner_new ();
+
+  self->renditions_desc = g_strdup (GST_OMX_SIMULCAST_ENC_RENDITIONS_DEFAULT);
+  self->key_int_max = GST_OMX_SIMULCAST_ENC_KEY_INT_MAX_DEFAULT;
+
+  templ =
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (self),
+      "sink");
+  self->sinkpad = gst_pad_new_from_template (templ, "sink");
+  gst_pad_set_chain_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_enc_chain));
+  gst_pad_set_event_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_enc_sink_event));
+  gst_element_add_pad (GST_ELEMENT (self), self->sinkpad);
+}
+
+static void
+gst_omx_simulcast_enc_finalize (GObject * object)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (object);
+
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->cond);
+  gst_flow_combiner_free (self->flow_combiner);
+  g_free (self->renditions_desc);
+
+  G_OBJECT_CLASS (gst_omx_simulcast_enc_parent_class)->finalize (object);
+}
+
+static void
+gst_omx_simulcast_enc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (object);
+
+  switch (prop_id) {
+    case PROP_RENDITIONS:
+      g_free (self->renditions_desc);
+      self->renditions_desc = g_value_dup_string (value);
+      break;
+    case PROP_KEY_INT_MAX:
+      self->key_int_max = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_simulcast_enc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (object);
+
+  switch (prop_id) {
+    case PROP_RENDITIONS:
+      g_value_set_string (value, self->renditions_desc);
+      break;
+    case PROP_KEY_INT_MAX:
+      g_value_set_uint (value, self->key_int_max);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Creates the renditions from the renditions property */
+static gboolean
+gst_omx_simulcast_enc_parse_renditions (GstOMXSimulcastEnc * self)
+{
+  gchar **entries;
+  guint i, n;
+
+  entries =
+      g_strsplit (self->renditions_desc ? self->renditions_desc : "", ",", -1);
+  n = g_strv_length (entries);
+
+  self->renditions = g_new0 (GstOMXSimulcastEncRendition, MAX (n, 1));
+  self->n_renditions = MAX (n, 1);
+
+  for (i = 0; i < self->n_renditions; i++) {
+    GstOMXSimulcastEncRendition *r = &self->renditions[i];
+    guint width = 0, height = 0, bitrate = 0xffffffff;
+
+    r->self = self;
+    r->index = i;
+
+    if (i < n && sscanf (g_strstrip (entries[i]), "%ux%u:%u", &width,
+            &height, &bitrate) < 2) {
+      GST_ERROR_OBJECT (self, "Invalid rendition '%s'", entries[i]);
+      g_strfreev (entries);
+      return FALSE;
+    }
+
+    r->width = width;
+    r->height = height;
+    r->bitrate = bitrate;
+
+    GST_DEBUG_OBJECT (self, "Rendition %u: %ux%u, bitrate %u", i, width,
+        height, bitrate);
+  }
+  g_strfreev (entries);
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_simulcast_enc_open_rendition (GstOMXSimulcastEnc * self,
+    GstOMXSimulcastEncRendition * r)
+{
+  GstOMXSimulcastEncClass *klass = GST_OMX_SIMULCAST_ENC_GET_CLASS (self);
+
+  r->comp =
+      gst_omx_component_new (GST_OBJECT_CAST (self), klass->cdata.core_name,
+      klass->cdata.component_name, klass->cdata.component_role,
+      klass->cdata.hacks);
+
+  if (!r->comp)
+    return FALSE;
+
+  if (gst_omx_component_get_state (r->comp,
+          GST_CLOCK_TIME_NONE) != OMX_StateLoaded)
+    goto error;
+
+  if (!gst_omx_video_add_ports (r->comp, &klass->cdata, &r->in_port,
+          &r->out_port))
+    goto error;
+
+  return TRUE;
+
+error:
+  gst_omx_component_free (r->comp);
+  r->comp = NULL;
+  r->in_port = r->out_port = NULL;
+  return FALSE;
+}
+
+/* Configures both ports of @r's component for the current input format.
+ * The component is in Loaded state */
+static gboolean
+gst_omx_simulcast_enc_configure_rendition (GstOMXSimulcastEnc * self,
+    GstOMXSimulcastEncRendition * r)
+{
+  GstOMXSimulcastEncClass *klass = GST_OMX_SIMULCAST_ENC_GET_CLASS (self);
+  GstVideoInfo *info = &self->info;
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+  OMX_ERRORTYPE err;
+  gint width, height;
+
+  gst_omx_port_get_port_definition (r->in_port, &port_def);
+
+  /* The formats that are not supported by the port are converted
+   * into I420 while copying */
+  if (GST_VIDEO_INFO_FORMAT (info) == GST_VIDEO_FORMAT_NV12)
+    port_def.format.video.eColorFormat = OMX_COLOR_FormatYUV420SemiPlanar;
+  else
+    port_def.format.video.eColorFormat = OMX_COLOR_FormatYUV420Planar;
+
+  port_def.format.video.nFrameWidth = info->width;
+  port_def.format.video.nFrameHeight = info->height;
+  if (port_def.nBufferAlignment)
+    port_def.format.video.nStride =
+        GST_ROUND_UP_N (info->width, port_def.nBufferAlignment);
+  else
+    port_def.format.video.nStride = GST_ROUND_UP_4 (info->width);
+
+  if (klass->cdata.hacks & GST_OMX_HACK_HEIGHT_MULTIPLE_16)
+    port_def.format.video.nSliceHeight = GST_ROUND_UP_16 (info->height);
+  else
+    port_def.format.video.nSliceHeight = info->height;
+
+  if (info->fps_n == 0) {
+    port_def.format.video.xFramerate = 0;
+  } else {
+    if (!(klass->cdata.hacks & GST_OMX_HACK_VIDEO_FRAMERATE_INTEGER))
+      port_def.format.video.xFramerate = (info->fps_n << 16) / (info->fps_d);
+    else
+      port_def.format.video.xFramerate = (info->fps_n) / (info->fps_d);
+  }
+
+  if (gst_omx_port_update_port_definition (r->in_port,
+          &port_def) != OMX_ErrorNone)
+    return FALSE;
+
+  /* Let the component scale if it can, otherwise
+   * encode at the input size */
+  width = r->width > 0 ? r->width : info->width;
+  height = r->height > 0 ? r->height : info->height;
+
+  gst_omx_port_get_port_definition (r->out_port, &port_def);
+  port_def.format.video.eCompressionFormat = OMX_VIDEO_CodingAVC;
+  port_def.format.video.nFrameWidth = width;
+  port_def.format.video.nFrameHeight = height;
+  err = gst_omx_port_update_port_definition (r->out_port, &port_def);
+  if (err != OMX_ErrorNone
+      || r->out_port->port_def.format.video.nFrameWidth != width
+      || r->out_port->port_def.format.video.nFrameHeight != height) {
+    GST_WARNING_OBJECT (self, "Component %u can't scale to %dx%d, encoding "
+        "at %dx%d", r->index, width, height, info->width, info->height);
+    port_def.format.video.nFrameWidth = info->width;
+    port_def.format.video.nFrameHeight = info->height;
+    if (gst_omx_port_update_port_definition (r->out_port,
+            &port_def) != OMX_ErrorNone)
+      return FALSE;
+  }
+
+  if (r->bitrate != 0xffffffff) {
+    OMX_VIDEO_PARAM_BITRATETYPE param;
+
+    GST_OMX_INIT_STRUCT (&param);
+    param.nPortIndex = r->out_port->index;
+    param.eControlRate = OMX_Video_ControlRateVariable;
+    param.nTargetBitrate = r->bitrate;
+    err = gst_omx_component_set_parameter (r->comp,
+        OMX_IndexParamVideoBitrate, &param);
+    if (err != OMX_ErrorNone)
+      GST_ERROR_OBJECT (self, "Failed to set bitrate of rendition %u: "
+          "%s (0x%08x)", r->index, gst_omx_error_to_string (err), err);
+  }
+
+  /* B-frames would make the components hold on to more input
+   * slots, and without them all renditions stay in sync */
+  {
+    OMX_VIDEO_PARAM_AVCTYPE param;
+
+    GST_OMX_INIT_STRUCT (&param);
+    param.nPortIndex = r->out_port->index;
+    err = gst_omx_component_get_parameter (r->comp,
+        OMX_IndexParamVideoAvc, &param);
+    if (err == OMX_ErrorNone) {
+      param.nBFrames = 0;
+      if (self->key_int_max > 0)
+        param.nPFrames = self->key_int_max - 1;
+      err = gst_omx_component_set_parameter (r->comp,
+          OMX_IndexParamVideoAvc, &param);
+    }
+
+    if (err == OMX_ErrorUnsupportedIndex) {
+      GST_WARNING_OBJECT (self,
+          "Setting AVC parameters not supported by the component");
+    } else if (err != OMX_ErrorNone) {
+      GST_ERROR_OBJECT (self, "Failed to set AVC parameters of rendition %u: "
+          "%s (0x%08x)", r->index, gst_omx_error_to_string (err), err);
+    }
+  }
+
+  gst_omx_port_set_wrap_buffers (r->out_port, TRUE);
+
+  return gst_omx_port_update_port_definition (r->out_port,
+      NULL) == OMX_ErrorNone;
+}
+
+/* Checks that the input ports of all components expect the frames in the
+ * same layout, which is needed for sharing the input buffers */
+static gboolean
+gst_omx_simulcast_enc_same_input_layout (GstOMXSimulcastEnc * self)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE first, port_def;
+  guint i;
+
+  if (gst_omx_port_get_port_definition (self->renditions[0].in_port,
+          &first) != OMX_ErrorNone)
+    return FALSE;
+
+  for (i = 1; i < self->n_renditions; i++) {
+    if (gst_omx_port_get_port_definition (self->renditions[i].in_port,
+            &port_def) != OMX_ErrorNone)
+      return FALSE;
+
+    if (port_def.format.video.nFrameWidth != first.format.video.nFrameWidth
+        || port_def.format.video.nFrameHeight !=
+        first.format.video.nFrameHeight
+        || port_def.format.video.nStride != first.format.video.nStride
+        || port_def.format.video.nSliceHeight !=
+        first.format.video.nSliceHeight
+        || port_def.format.video.eColorFormat !=
+        first.format.video.eColorFormat) {
+      GST_WARNING_OBJECT (self, "Input port of component %u uses stride %d, "
+          "slice height %u and color format 0x%08x, component 0 uses %d, %u "
+          "and 0x%08x", i, (gint) port_def.format.video.nStride,
+          (guint) port_def.format.video.nSliceHeight,
+          (guint) port_def.format.video.eColorFormat,
+          (gint) first.format.video.nStride,
+          (guint) first.format.video.nSliceHeight,
+          (guint) first.format.video.eColorFormat);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+static void
+gst_omx_simulcast_enc_free_slots (GstOMXSimulcastEnc * self)
+{
+  guint i;
+
+  for (i = 0; i < self->n_slots; i++) {
+    gst_memory_unmap (self->slots[i], &self->slot_maps[i]);
+    gst_memory_unref (self->slots[i]);
+  }
+  g_free (self->slots);
+  g_free (self->slot_maps);
+  self->slots = NULL;
+  self->slot_maps = NULL;
+  self->n_slots = 0;
+
+  for (i = 0; i < self->n_renditions; i++) {
+    g_free (self->renditions[i].held);
+    self->renditions[i].held = NULL;
+  }
+}
+
+/* Allocates the input buffer memory that is shared by all components.
+ * Every input port needs the same number and size of buffers for that,
+ * and must keep the same layout with them */
+static gboolean
+gst_omx_simulcast_enc_allocate_slots (GstOMXSimulcastEnc * self)
+{
+  GstAllocationParams params;
+  OMX_U32 size = 0, count = 0, align = 0;
+  guint i;
+
+  for (i = 0; i < self->n_renditions; i++) {
+    OMX_PARAM_PORTDEFINITIONTYPE *port_def =
+        &self->renditions[i].in_port->port_def;
+
+    size = MAX (size, port_def->nBufferSize);
+    count = MAX (count, port_def->nBufferCountActual);
+    align = MAX (align, port_def->nBufferAlignment);
+  }
+
+  for (i = 0; i < self->n_renditions; i++) {
+    GstOMXPort *port = self->renditions[i].in_port;
+    OMX_PARAM_PORTDEFINITIONTYPE port_def;
+
+    gst_omx_port_get_port_definition (port, &port_def);
+    port_def.nBufferSize = size;
+    port_def.nBufferCountActual = count;
+    if (gst_omx_port_update_port_definition (port, &port_def) != OMX_ErrorNone
+        || port->port_def.nBufferSize != size
+        || port->port_def.nBufferCountActual != count) {
+      GST_WARNING_OBJECT (self, "Component %u doesn't accept %u input "
+          "buffers of %u bytes", i, (guint) count, (guint) size);
+      return FALSE;
+    }
+  }
+
+  if (!gst_omx_simulcast_enc_same_input_layout (self))
+    return FALSE;
+
+  GST_DEBUG_OBJECT (self, "Allocating %u input slots of %u bytes",
+      (guint) count, (guint) size);
+
+  gst_allocation_params_init (&params);
+  if (align > 1)
+    params.align = align - 1;
+
+  self->slots = g_new0 (GstMemory *, count);
+  self->slot_maps = g_new0 (GstMapInfo, count);
+  for (i = 0; i < count; i++) {
+    GstMemory *mem = gst_allocator_alloc (NULL, size, &params);
+
+    if (!mem)
+      goto error;
+    if (!gst_memory_map (mem, &self->slot_maps[i], GST_MAP_READWRITE)) {
+      gst_memory_unref (mem);
+      goto error;
+    }
+    self->slots[i] = mem;
+    self->n_slots++;
+  }
+
+  for (i = 0; i < self->n_renditions; i++)
+    self->renditions[i].held = g_new0 (GstOMXBuffer *, count);
+
+  return TRUE;
+
+error:
+  GST_ERROR_OBJECT (self, "Failed to allocate input slots");
+  gst_omx_simulcast_enc_free_slots (self);
+  return FALSE;
+}
+
+/* Returns the slot of an input buffer of any component */
+static gint
+gst_omx_simulcast_enc_get_slot (GstOMXSimulcastEnc * self, GstOMXBuffer * buf)
+{
+  guint i;
+
+  for (i = 0; i < self->n_slots; i++) {
+    if (buf->omx_buf->pBuffer == self->slot_maps[i].data)
+      return i;
+  }
+
+  return -1;
+}
+
+static gboolean
+gst_omx_simulcast_enc_reconfigure_output (GstOMXSimulcastEncRendition * r)
+{
+  GstOMXPort *port = r->out_port;
+
+  if (gst_omx_port_is_enabled (port)) {
+    if (gst_omx_port_set_enabled (port, FALSE) != OMX_ErrorNone)
+      return FALSE;
+    if (gst_omx_port_wait_buffers_released (port,
+            5 * GST_SECOND) != OMX_ErrorNone)
+      return FALSE;
+    if (gst_omx_port_deallocate_buffers (port) != OMX_ErrorNone)
+      return FALSE;
+    if (gst_omx_port_wait_enabled (port, 1 * GST_SECOND) != OMX_ErrorNone)
+      return FALSE;
+  }
+
+  if (gst_omx_port_update_port_definition (port, NULL) != OMX_ErrorNone)
+    return FALSE;
+
+  gst_omx_port_set_wrap_buffers (port, TRUE);
+
+  if (gst_omx_port_set_enabled (port, TRUE) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_allocate_buffers (port) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_wait_enabled (port, 5 * GST_SECOND) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_populate (port) != OMX_ErrorNone)
+    return FALSE;
+  if (gst_omx_port_mark_reconfigured (port) != OMX_ErrorNone)
+    return FALSE;
+
+  return TRUE;
+}
+
+/* Pushes the data of @buf on @r's source pad, @buf is released */
+static GstFlowReturn
+gst_omx_simulcast_enc_push_output (GstOMXSimulcastEncRendition * r,
+    GstOMXBuffer * buf)
+{
+  GstBuffer *outbuf;
+  gboolean wrapped;
+
+  /* If the data is wrapped, buf belongs to outbuf now */
+  outbuf = gst_omx_port_wrap_or_copy_buffer (r->out_port, buf, &wrapped);
+
+  if (buf->omx_buf->nFlags & OMX_BUFFERFLAG_CODECCONFIG)
+    GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_HEADER);
+  else if (!(buf->omx_buf->nFlags & OMX_BUFFERFLAG_SYNCFRAME))
+    GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  gst_omx_video_set_buffer_times (buf, outbuf);
+
+  if (!wrapped)
+    gst_omx_port_release_buffer (r->out_port, buf);
+
+  return gst_pad_push (r->srcpad, outbuf);
+}
+
+static gpointer
+gst_omx_simulcast_enc_output_loop (GstOMXSimulcastEncRendition * r)
+{
+  GstOMXSimulcastEnc *self = r->self;
+
+  g_mutex_lock (&self->lock);
+  while (self->running && !r->quit) {
+    GstOMXAcquireBufferReturn acq_ret;
+    GstOMXBuffer *buf = NULL;
+    GstFlowReturn flow_ret = GST_FLOW_OK;
+    gboolean pushed = FALSE, eos = FALSE, push_eos = FALSE;
+    guint cycle = self->cycle;
+
+    g_mutex_unlock (&self->lock);
+
+    acq_ret = gst_omx_port_acquire_buffer (r->out_port, &buf);
+    if (acq_ret == GST_OMX_ACQUIRE_BUFFER_OK) {
+      eos = (buf->omx_buf->nFlags & OMX_BUFFERFLAG_EOS) != 0;
+      if (buf->omx_buf->nFilledLen > 0) {
+        flow_ret = gst_omx_simulcast_enc_push_output (r, buf);
+        pushed = TRUE;
+      } else {
+        gst_omx_port_release_buffer (r->out_port, buf);
+      }
+    } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
+      if (!gst_omx_simulcast_enc_reconfigure_output (r))
+        acq_ret = GST_OMX_ACQUIRE_BUFFER_ERROR;
+    }
+
+    if (acq_ret == GST_OMX_ACQUIRE_BUFFER_ERROR) {
+      GST_ELEMENT_ERROR (self, LIBRARY, FAILED, (NULL),
+          ("OpenMAX component of rendition %u in error state %s (0x%08x)",
+              r->index, gst_omx_component_get_last_error_string (r->comp),
+              gst_omx_component_get_last_error (r->comp)));
+      flow_ret = GST_FLOW_ERROR;
+      pushed = TRUE;
+    }
+
+    g_mutex_lock (&self->lock);
+    /* Keep taking the output of unlinked renditions so that
+     * the component doesn't block the other ones */
+    if (pushed)
+      self->flow_ret =
+          gst_flow_combiner_update_pad_flow (self->flow_combiner, r->srcpad,
+          flow_ret);
+
+    if (eos) {
+      r->eos = TRUE;
+      push_eos = !self->draining;
+      g_cond_broadcast (&self->cond);
+    }
+
+    if (push_eos) {
+      g_mutex_unlock (&self->lock);
+      gst_pad_push_event (r->srcpad, gst_event_new_eos ());
+      g_mutex_lock (&self->lock);
+    }
+
+    /* Nothing to do until the ports are usable again */
+    if (acq_ret == GST_OMX_ACQUIRE_BUFFER_FLUSHING
+        || acq_ret == GST_OMX_ACQUIRE_BUFFER_EOS
+        || acq_ret == GST_OMX_ACQUIRE_BUFFER_ERROR) {
+      r->parked = TRUE;
+      g_cond_broadcast (&self->cond);
+      while (self->running && !r->quit && self->cycle == cycle)
+        g_cond_wait (&self->cond, &self->lock);
+      r->parked = FALSE;
+    }
+  }
+  r->parked = TRUE;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  return NULL;
+}
+
+/* Brings @r's component into Executing state with the shared input
+ * buffers, or its own ones, and starts its output thread */
+static gboolean
+gst_omx_simulcast_enc_start_rendition (GstOMXSimulcastEnc * self,
+    GstOMXSimulcastEncRendition * r)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &r->out_port->port_def;
+  GList *buffers = NULL;
+  OMX_ERRORTYPE err;
+  GstCaps *caps;
+  gchar *name;
+  guint i;
+
+  for (i = self->n_slots; i > 0; i--)
+    buffers = g_list_prepend (buffers, self->slot_maps[i - 1].data);
+
+  if (gst_omx_component_set_state (r->comp, OMX_StateIdle) != OMX_ErrorNone) {
+    g_list_free (buffers);
+    return FALSE;
+  }
+
+  /* Need to allocate buffers to reach Idle state */
+  if (self->shared_input) {
+    err = gst_omx_port_use_buffers (r->in_port, buffers);
+    g_list_free (buffers);
+    if (err != OMX_ErrorNone) {
+      GST_ERROR_OBJECT (self, "Component %u can't use the shared input "
+          "buffers: %s (0x%08x)", r->index, gst_omx_error_to_string (err),
+          err);
+      return FALSE;
+    }
+  } else if (gst_omx_port_allocate_buffers (r->in_port) != OMX_ErrorNone) {
+    return FALSE;
+  }
+  if (gst_omx_port_allocate_buffers (r->out_port) != OMX_ErrorNone)
+    return FALSE;
+
+  if (gst_omx_component_get_state (r->comp,
+          5 * GST_SECOND) != OMX_StateIdle)
+    return FALSE;
+
+  if (gst_omx_component_set_state (r->comp,
+          OMX_StateExecuting) != OMX_ErrorNone)
+    return FALSE;
+
+  if (gst_omx_component_get_state (r->comp,
+          5 * GST_SECOND) != OMX_StateExecuting)
+    return FALSE;
+
+  gst_omx_port_set_flushing (r->in_port, 5 * GST_SECOND, FALSE);
+  gst_omx_port_set_flushing (r->out_port, 5 * GST_SECOND, FALSE);
+
+  err = gst_omx_port_populate (r->out_port);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (self, "Failed to populate output port of rendition "
+        "%u: %s (0x%08x)", r->index, gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  caps = gst_caps_new_simple ("video/x-h264",
+      "stream-format", G_TYPE_STRING, "byte-stream",
+      "alignment", G_TYPE_STRING, "au",
+      "width", G_TYPE_INT, (gint) port_def->format.video.nFrameWidth,
+      "height", G_TYPE_INT, (gint) port_def->format.video.nFrameHeight,
+      "framerate", GST_TYPE_FRACTION, GST_VIDEO_INFO_FPS_N (&self->info),
+      GST_VIDEO_INFO_FPS_D (&self->info), NULL);
+  GST_DEBUG_OBJECT (r->srcpad, "Setting caps %" GST_PTR_FORMAT, caps);
+  gst_pad_set_caps (r->srcpad, caps);
+  gst_caps_unref (caps);
+
+  g_mutex_lock (&self->lock);
+  r->quit = FALSE;
+  r->parked = FALSE;
+  r->eos = FALSE;
+  g_mutex_unlock (&self->lock);
+
+  name = g_strdup_printf ("omxsimulcastenc-out-%u", r->index);
+  r->output =
+      g_thread_new (name, (GThreadFunc) gst_omx_simulcast_enc_output_loop, r);
+  g_free (name);
+
+  return TRUE;
+}
+
+/* Stops the output threads, puts all components back into Loaded state
+ * and frees the shared input buffers */
+static void
+gst_omx_simulcast_enc_shutdown (GstOMXSimulcastEnc * self)
+{
+  guint i;
+
+  for (i = 0; i < self->n_renditions; i++) {
+    GstOMXSimulcastEncRendition *r = &self->renditions[i];
+    OMX_STATETYPE state;
+
+    if (!r->comp)
+      continue;
+
+    g_mutex_lock (&self->lock);
+    r->quit = TRUE;
+    g_cond_broadcast (&self->cond);
+    g_mutex_unlock (&self->lock);
+
+    state = gst_omx_component_get_state (r->comp, 0);
+    if (state == OMX_StateExecuting) {
+      gst_omx_port_set_flushing (r->in_port, 5 * GST_SECOND, TRUE);
+      gst_omx_port_set_flushing (r->out_port, 5 * GST_SECOND, TRUE);
+    }
+
+    if (r->output)
+      g_thread_join (r->output);
+    r->output = NULL;
+
+    if (state > OMX_StateLoaded || state == OMX_StateInvalid) {
+      if (state > OMX_StateIdle) {
+        gst_omx_component_set_state (r->comp, OMX_StateIdle);
+        gst_omx_component_get_state (r->comp, 5 * GST_SECOND);
+      }
+      gst_omx_component_set_state (r->comp, OMX_StateLoaded);
+      gst_omx_port_deallocate_buffers (r->in_port);
+      gst_omx_port_deallocate_buffers (r->out_port);
+      if (state > OMX_StateLoaded)
+        gst_omx_component_get_state (r->comp, 5 * GST_SECOND);
+    }
+  }
+
+  /* The held buffers were freed together with the ports' buffers */
+  gst_omx_simulcast_enc_free_slots (self);
+
+  self->configured = FALSE;
+  self->started = FALSE;
+}
+
+/* Passes an empty buffer with the EOS flag to @r's component */
+static gboolean
+gst_omx_simulcast_enc_send_eos (GstOMXSimulcastEnc * self,
+    GstOMXSimulcastEncRendition * r)
+{
+  GstOMXBuffer *buf = NULL;
+  guint i, n_held = self->shared_input ? self->n_slots : 1;
+
+  /* Any input buffer will do, the EOS buffer has no data */
+  for (i = 0; i < n_held && !buf; i++) {
+    buf = r->held[i];
+    r->held[i] = NULL;
+  }
+
+  if (!buf && gst_omx_port_acquire_buffer (r->in_port,
+          &buf) != GST_OMX_ACQUIRE_BUFFER_OK)
+    return FALSE;
+
+  buf->omx_buf->nFilledLen = 0;
+  GST_OMX_SET_TICKS (buf->omx_buf->nTimeStamp,
+      gst_util_uint64_scale (self->last_upstream_ts, OMX_TICKS_PER_SECOND,
+          GST_SECOND));
+  buf->omx_buf->nTickCount = 0;
+  buf->omx_buf->nFlags |= OMX_BUFFERFLAG_EOS;
+
+  return gst_omx_port_release_buffer (r->in_port, buf) == OMX_ErrorNone;
+}
+
+/* Sends EOS to all components. If @wait is TRUE this waits until all of
+ * them output the EOS buffer, which is not forwarded downstream then */
+static void
+gst_omx_simulcast_enc_drain (GstOMXSimulcastEnc * self, gboolean wait)
+{
+  gint64 wait_until;
+  guint i;
+
+  if (!self->started)
+    return;
+  self->started = FALSE;
+
+  GST_DEBUG_OBJECT (self, "Draining components");
+
+  g_mutex_lock (&self->lock);
+  self->draining = wait;
+  for (i = 0; i < self->n_renditions; i++)
+    self->renditions[i].eos = FALSE;
+  g_mutex_unlock (&self->lock);
+
+  for (i = 0; i < self->n_renditions; i++) {
+    if (!gst_omx_simulcast_enc_send_eos (self, &self->renditions[i]))
+      GST_WARNING_OBJECT (self, "Failed to send EOS to rendition %u", i);
+  }
+
+  if (!wait)
+    return;
+
+  wait_until = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&self->lock);
+  for (i = 0; i < self->n_renditions && self->running; i++) {
+    while (!self->renditions[i].eos && self->running) {
+      if (!g_cond_wait_until (&self->cond, &self->lock, wait_until)) {
+        GST_WARNING_OBJECT (self, "Timeout waiting for rendition %u to be "
+            "drained", i);
+        break;
+      }
+    }
+  }
+  self->draining = FALSE;
+  g_mutex_unlock (&self->lock);
+
+  GST_DEBUG_OBJECT (self, "Drained components");
+}
+
+static gboolean
+gst_omx_simulcast_enc_set_caps (GstOMXSimulcastEnc * self, GstCaps * caps)
+{
+  GstVideoInfo info;
+  guint i;
+
+  if (!gst_video_info_from_caps (&info, caps)) {
+    GST_ERROR_OBJECT (self, "Invalid caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+
+  if (self->configured && gst_video_info_is_equal (&info, &self->info))
+    return TRUE;
+
+  GST_DEBUG_OBJECT (self, "Setting caps %" GST_PTR_FORMAT, caps);
+
+  if (self->configured) {
+    gst_omx_simulcast_enc_drain (self, TRUE);
+    gst_omx_simulcast_enc_shutdown (self);
+  }
+
+  self->info = info;
+
+  for (i = 0; i < self->n_renditions; i++) {
+    if (!gst_omx_simulcast_enc_configure_rendition (self,
+            &self->renditions[i])) {
+      GST_ERROR_OBJECT (self, "Failed to configure rendition %u", i);
+      goto error;
+    }
+  }
+
+  /* Every frame is copied once if all components can use the same
+   * input buffers, otherwise once for each rendition */
+  self->shared_input = gst_omx_simulcast_enc_same_input_layout (self)
+      && gst_omx_simulcast_enc_allocate_slots (self);
+  if (!self->shared_input) {
+    GST_WARNING_OBJECT (self, "Can't share the input buffers between the "
+        "components, copying every frame for each rendition");
+    for (i = 0; i < self->n_renditions; i++)
+      self->renditions[i].held = g_new0 (GstOMXBuffer *, 1);
+  }
+
+  for (i = 0; i < self->n_renditions; i++) {
+    if (!gst_omx_simulcast_enc_start_rendition (self, &self->renditions[i])) {
+      GST_ERROR_OBJECT (self, "Failed to start rendition %u", i);
+      goto error;
+    }
+  }
+
+  self->configured = TRUE;
+  self->started = FALSE;
+  self->frames_since_idr = 0;
+  self->next_slot = 0;
+
+  return TRUE;
+
+error:
+  gst_omx_simulcast_enc_shutdown (self);
+  return FALSE;
+}
+
+/* Waits until @r's component returned the input buffer of @slot. Buffers
+ * of other slots that are returned meanwhile are kept for later frames.
+ * Without shared input buffers there is only slot 0, for any buffer */
+static GstOMXAcquireBufferReturn
+gst_omx_simulcast_enc_acquire_slot (GstOMXSimulcastEnc * self,
+    GstOMXSimulcastEncRendition * r, guint slot)
+{
+  if (!self->shared_input) {
+    if (r->held[0])
+      return GST_OMX_ACQUIRE_BUFFER_OK;
+    return gst_omx_port_acquire_buffer (r->in_port, &r->held[0]);
+  }
+
+  while (!r->held[slot]) {
+    GstOMXAcquireBufferReturn acq_ret;
+    GstOMXBuffer *buf;
+    gint index;
+
+    acq_ret = gst_omx_port_acquire_buffer (r->in_port, &buf);
+    if (acq_ret != GST_OMX_ACQUIRE_BUFFER_OK)
+      return acq_ret;
+
+    index = gst_omx_simulcast_enc_get_slot (self, buf);
+    if (index < 0) {
+      GST_ERROR_OBJECT (self, "Component %u returned an unknown input "
+          "buffer %p", r->index, buf->omx_buf->pBuffer);
+      return GST_OMX_ACQUIRE_BUFFER_ERROR;
+    }
+    r->held[index] = buf;
+  }
+
+  return GST_OMX_ACQUIRE_BUFFER_OK;
+}
+
+static void
+gst_omx_simulcast_enc_request_idr (GstOMXSimulcastEnc * self,
+    GstOMXSimulcastEncRendition * r)
+{
+  OMX_ERRORTYPE err;
+#ifdef USE_OMX_TARGET_RPI
+  OMX_CONFIG_BOOLEANTYPE config;
+
+  GST_OMX_INIT_STRUCT (&config);
+  config.bEnabled = OMX_TRUE;
+
+  err =
+      gst_omx_component_set_config (r->comp,
+      OMX_IndexConfigBrcmVideoRequestIFrame, &config);
+#else
+  OMX_CONFIG_INTRAREFRESHVOPTYPE config;
+
+  GST_OMX_INIT_STRUCT (&config);
+  config.nPortIndex = r->out_port->index;
+  config.IntraRefreshVOP = OMX_TRUE;
+
+  err =
+      gst_omx_component_set_config (r->comp,
+      OMX_IndexConfigVideoIntraVOPRefresh, &config);
+#endif
+  if (err != OMX_ErrorNone)
+    GST_ERROR_OBJECT (self, "Failed to force a keyframe on rendition %u: "
+        "%s (0x%08x)", r->index, gst_omx_error_to_string (err), err);
+}
+
+static GstFlowReturn
+gst_omx_simulcast_enc_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (parent);
+  GstOMXAcquireBufferReturn acq_ret;
+  GstFlowReturn ret;
+  OMX_U32 filled_len;
+  gboolean idr;
+  guint slot, n_fill, i;
+
+  if (!self->configured) {
+    gst_buffer_unref (buffer);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  g_mutex_lock (&self->lock);
+  ret = self->flushing ? GST_FLOW_FLUSHING : self->flow_ret;
+  idr = self->force_idr || !self->started || (self->key_int_max > 0
+      && self->frames_since_idr >= self->key_int_max);
+  g_mutex_unlock (&self->lock);
+
+  if (ret != GST_FLOW_OK)
+    goto done;
+
+  /* Slots are reused in the order in which they were passed
+   * to the components, which is the order they return them */
+  slot = self->shared_input ? self->next_slot : 0;
+  for (i = 0; i < self->n_renditions; i++) {
+    acq_ret =
+        gst_omx_simulcast_enc_acquire_slot (self, &self->renditions[i], slot);
+    if (acq_ret == GST_OMX_ACQUIRE_BUFFER_FLUSHING) {
+      ret = GST_FLOW_FLUSHING;
+      goto done;
+    } else if (acq_ret != GST_OMX_ACQUIRE_BUFFER_OK) {
+      GST_ELEMENT_ERROR (self, LIBRARY, FAILED, (NULL),
+          ("OpenMAX component of rendition %u in error state %s (0x%08x)",
+              i, gst_omx_component_get_last_error_string
+              (self->renditions[i].comp),
+              gst_omx_component_get_last_error (self->renditions[i].comp)));
+      ret = GST_FLOW_ERROR;
+      goto done;
+    }
+  }
+
+  /* All components see the same memory if it is shared, copy only once
+   * then. Otherwise each buffer gets the layout of its own port */
+  n_fill = self->shared_input ? 1 : self->n_renditions;
+  for (i = 0; i < n_fill; i++) {
+    GstOMXSimulcastEncRendition *r = &self->renditions[i];
+
+    if (!gst_omx_video_enc_fill_omx_buffer (GST_OBJECT (self),
+            &r->in_port->port_def, &self->info, buffer, r->held[slot])) {
+      GST_ELEMENT_ERROR (self, RESOURCE, WRITE, (NULL),
+          ("Failed to write input into the OpenMAX buffer"));
+      ret = GST_FLOW_ERROR;
+      goto done;
+    }
+  }
+  filled_len = self->renditions[0].held[slot]->omx_buf->nFilledLen;
+
+  if (idr)
+    GST_DEBUG_OBJECT (self, "Requesting an IDR frame on all renditions");
+
+  for (i = 0; i < self->n_renditions; i++) {
+    GstOMXSimulcastEncRendition *r = &self->renditions[i];
+    GstOMXBuffer *buf = r->held[slot];
+    OMX_ERRORTYPE err;
+
+    r->held[slot] = NULL;
+
+    if (self->shared_input)
+      buf->omx_buf->nFilledLen = filled_len;
+    if (GST_BUFFER_PTS_IS_VALID (buffer))
+      GST_OMX_SET_TICKS (buf->omx_buf->nTimeStamp,
+          gst_util_uint64_scale (GST_BUFFER_PTS (buffer),
+              OMX_TICKS_PER_SECOND, GST_SECOND));
+    else
+      GST_OMX_SET_TICKS (buf->omx_buf->nTimeStamp, G_GUINT64_CONSTANT (0));
+    if (GST_BUFFER_DURATION_IS_VALID (buffer))
+      buf->omx_buf->nTickCount =
+          gst_util_uint64_scale (GST_BUFFER_DURATION (buffer),
+          OMX_TICKS_PER_SECOND, GST_SECOND);
+    else
+      buf->omx_buf->nTickCount = 0;
+
+    if (idr)
+      gst_omx_simulcast_enc_request_idr (self, r);
+
+    err = gst_omx_port_release_buffer (r->in_port, buf);
+    if (err != OMX_ErrorNone) {
+      GST_ELEMENT_ERROR (self, LIBRARY, SETTINGS, (NULL),
+          ("Failed to release input buffer to component %u: %s (0x%08x)",
+              i, gst_omx_error_to_string (err), err));
+      ret = GST_FLOW_ERROR;
+      goto done;
+    }
+  }
+
+  if (self->shared_input)
+    self->next_slot = (slot + 1) % self->n_slots;
+  self->started = TRUE;
+  if (GST_BUFFER_PTS_IS_VALID (buffer)) {
+    self->last_upstream_ts = GST_BUFFER_PTS (buffer);
+    if (GST_BUFFER_DURATION_IS_VALID (buffer))
+      self->last_upstream_ts += GST_BUFFER_DURATION (buffer);
+  }
+
+  g_mutex_lock (&self->lock);
+  if (idr) {
+    self->force_idr = FALSE;
+    self->frames_since_idr = 0;
+  }
+  self->frames_since_idr++;
+  ret = self->flow_ret;
+  g_mutex_unlock (&self->lock);
+
+done:
+  gst_buffer_unref (buffer);
+
+  return ret;
+}
+
+static gboolean
+gst_omx_simulcast_enc_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (parent);
+  gboolean ret = TRUE;
+  guint i;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstCaps *caps;
+
+      gst_event_parse_caps (event, &caps);
+      ret = gst_omx_simulcast_enc_set_caps (self, caps);
+      gst_event_unref (event);
+      break;
+    }
+    case GST_EVENT_STREAM_START:{
+      GstStreamFlags flags;
+      gboolean have_group_id;
+      guint group_id;
+
+      /* Every rendition is a stream of its own, derive its stream-id from
+       * the upstream one. That is taken from the sticky event */
+      gst_pad_store_sticky_event (pad, event);
+      gst_event_parse_stream_flags (event, &flags);
+      have_group_id = gst_event_parse_group_id (event, &group_id);
+
+      for (i = 0; i < self->n_renditions; i++) {
+        GstOMXSimulcastEncRendition *r = &self->renditions[i];
+        GstEvent *stream_start;
+        gchar *stream_id;
+
+        stream_id = gst_pad_create_stream_id_printf (r->srcpad,
+            GST_ELEMENT_CAST (self), "%u", r->index);
+        stream_start = gst_event_new_stream_start (stream_id);
+        g_free (stream_id);
+
+        gst_event_set_stream_flags (stream_start, flags);
+        if (have_group_id)
+          gst_event_set_group_id (stream_start, group_id);
+        gst_event_set_seqnum (stream_start, gst_event_get_seqnum (event));
+
+        gst_pad_push_event (r->srcpad, stream_start);
+      }
+      gst_event_unref (event);
+      break;
+    }
+    case GST_EVENT_EOS:
+      if (self->started) {
+        /* Forwarded by the output threads after the last frame */
+        gst_omx_simulcast_enc_drain (self, FALSE);
+        gst_event_unref (event);
+      } else {
+        ret = gst_pad_event_default (pad, parent, event);
+      }
+      break;
+    case GST_EVENT_FLUSH_START:
+      g_mutex_lock (&self->lock);
+      self->flushing = TRUE;
+      g_mutex_unlock (&self->lock);
+
+      if (self->configured) {
+        for (i = 0; i < self->n_renditions; i++) {
+          gst_omx_port_set_flushing (self->renditions[i].in_port,
+              5 * GST_SECOND, TRUE);
+          gst_omx_port_set_flushing (self->renditions[i].out_port,
+              5 * GST_SECOND, TRUE);
+        }
+      }
+
+      ret = gst_pad_event_default (pad, parent, event);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      if (self->configured) {
+        /* Wait until no output thread pushes anymore */
+        g_mutex_lock (&self->lock);
+        for (i = 0; i < self->n_renditions; i++) {
+          while (!self->renditions[i].parked && self->running)
+            g_cond_wait (&self->cond, &self->lock);
+        }
+        g_mutex_unlock (&self->lock);
+
+        for (i = 0; i < self->n_renditions; i++) {
+          gst_omx_port_set_flushing (self->renditions[i].in_port,
+              5 * GST_SECOND, FALSE);
+          gst_omx_port_set_flushing (self->renditions[i].out_port,
+              5 * GST_SECOND, FALSE);
+          gst_omx_port_populate (self->renditions[i].out_port);
+        }
+      }
+
+      self->started = FALSE;
+
+      g_mutex_lock (&self->lock);
+      self->flushing = FALSE;
+      self->force_idr = TRUE;
+      gst_flow_combiner_reset (self->flow_combiner);
+      self->flow_ret = GST_FLOW_OK;
+      for (i = 0; i < self->n_renditions; i++)
+        self->renditions[i].eos = FALSE;
+      self->cycle++;
+      g_cond_broadcast (&self->cond);
+      g_mutex_unlock (&self->lock);
+
+      ret = gst_pad_event_default (pad, parent, event);
+      break;
+    default:
+      if (gst_video_event_is_force_key_unit (event)) {
+        GST_DEBUG_OBJECT (self, "Forcing an IDR frame on all renditions");
+        g_mutex_lock (&self->lock);
+        self->force_idr = TRUE;
+        g_mutex_unlock (&self->lock);
+        gst_event_unref (event);
+        break;
+      }
+      ret = gst_pad_event_default (pad, parent, event);
+      break;
+  }
+
+  return ret;
+}
+
+static gboolean
+gst_omx_simulcast_enc_src_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (parent);
+
+  /* Keyframes are always requested from all renditions together,
+   * otherwise they couldn't be switched at the keyframes */
+  if (gst_video_event_is_force_key_unit (event)) {
+    GST_DEBUG_OBJECT (pad, "Forcing an IDR frame on all renditions");
+    g_mutex_lock (&self->lock);
+    self->force_idr = TRUE;
+    g_mutex_unlock (&self->lock);
+    gst_event_unref (event);
+    return TRUE;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_omx_simulcast_enc_start (GstOMXSimulcastEnc * self)
+{
+  GstPadTemplate *templ;
+  guint i;
+
+  if (!gst_omx_simulcast_enc_parse_renditions (self))
+    goto error;
+
+  for (i = 0; i < self->n_renditions; i++) {
+    if (!gst_omx_simulcast_enc_open_rendition (self, &self->renditions[i])) {
+      GST_ERROR_OBJECT (self, "Failed to create component %u of %u", i,
+          self->n_renditions);
+      goto error;
+    }
+  }
+
+  templ =
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS (self),
+      "src_%u");
+
+  for (i = 0; i < self->n_renditions; i++) {
+    GstOMXSimulcastEncRendition *r = &self->renditions[i];
+    gchar *name;
+
+    name = g_strdup_printf ("src_%u", i);
+    r->srcpad = gst_pad_new_from_template (templ, name);
+    g_free (name);
+    gst_pad_set_event_function (r->srcpad,
+        GST_DEBUG_FUNCPTR (gst_omx_simulcast_enc_src_event));
+    gst_pad_use_fixed_caps (r->srcpad);
+    gst_pad_set_element_private (r->srcpad, r);
+    gst_flow_combiner_add_pad (self->flow_combiner, r->srcpad);
+    gst_element_add_pad (GST_ELEMENT (self), r->srcpad);
+  }
+  gst_element_no_more_pads (GST_ELEMENT (self));
+
+  g_mutex_lock (&self->lock);
+  self->running = TRUE;
+  self->flushing = FALSE;
+  self->draining = FALSE;
+  self->force_idr = FALSE;
+  self->flow_ret = GST_FLOW_OK;
+  g_mutex_unlock (&self->lock);
+
+  self->configured = FALSE;
+  self->started = FALSE;
+  self->last_upstream_ts = 0;
+
+  return TRUE;
+
+error:
+  for (i = 0; self->renditions && i < self->n_renditions; i++) {
+    if (self->renditions[i].comp)
+      gst_omx_component_free (self->renditions[i].comp);
+  }
+  g_free (self->renditions);
+  self->renditions = NULL;
+  self->n_renditions = 0;
+  return FALSE;
+}
+
+/* Wakes up all threads, called before the pads are deactivated */
+static void
+gst_omx_simulcast_enc_unblock (GstOMXSimulcastEnc * self)
+{
+  guint i;
+
+  g_mutex_lock (&self->lock);
+  self->running = FALSE;
+  self->flushing = TRUE;
+  g_cond_broadcast (&self->cond);
+  g_mutex_unlock (&self->lock);
+
+  for (i = 0; i < self->n_renditions; i++) {
+    gst_omx_port_set_flushing (self->renditions[i].in_port, 5 * GST_SECOND,
+        TRUE);
+    gst_omx_port_set_flushing (self->renditions[i].out_port, 5 * GST_SECOND,
+        TRUE);
+  }
+}
+
+static void
+gst_omx_simulcast_enc_stop (GstOMXSimulcastEnc * self)
+{
+  guint i;
+
+  gst_omx_simulcast_enc_shutdown (self);
+
+  for (i = 0; i < self->n_renditions; i++) {
+    GstOMXSimulcastEncRendition *r = &self->renditions[i];
+
+    gst_omx_component_free (r->comp);
+    r->comp = NULL;
+
+    gst_flow_combiner_remove_pad (self->flow_combiner, r->srcpad);
+    gst_element_remove_pad (GST_ELEMENT (self), r->srcpad);
+  }
+
+  g_free (self->renditions);
+  self->renditions = NULL;
+  self->n_renditions = 0;
+}
+
+static GstStateChangeReturn
+gst_omx_simulcast_enc_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      if (!gst_omx_simulcast_enc_start (self))
+        return GST_STATE_CHANGE_FAILURE;
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_omx_simulcast_enc_unblock (self);
+      break;
+    default:
+      break;
+  }
+
+  ret =
+      GST_ELEMENT_CLASS (gst_omx_simulcast_enc_parent_class)->change_state
+      (element, transition);
+
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    return ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_omx_simulcast_enc_stop (self);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
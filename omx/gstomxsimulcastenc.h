@@ -0,0 +1,114 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_OMX_SIMULCAST_ENC_H__
+#define __GST_OMX_SIMULCAST_ENC_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstflowcombiner.h>
+#include <gst/video/video.h>
+
+#include "gstomx.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_OMX_SIMULCAST_ENC \
+  (gst_omx_simulcast_enc_get_type())
+#define GST_OMX_SIMULCAST_ENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OMX_SIMULCAST_ENC,GstOMXSimulcastEnc))
+#define GST_OMX_SIMULCAST_ENC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OMX_SIMULCAST_ENC,GstOMXSimulcastEncClass))
+#define GST_OMX_SIMULCAST_ENC_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS((obj),GST_TYPE_OMX_SIMULCAST_ENC,GstOMXSimulcastEncClass))
+#define GST_IS_OMX_SIMULCAST_ENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OMX_SIMULCAST_ENC))
+#define GST_IS_OMX_SIMULCAST_ENC_CLASS(obj) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OMX_SIMULCAST_ENC))
+
+typedef struct _GstOMXSimulcastEnc GstOMXSimulcastEnc;
+typedef struct _GstOMXSimulcastEncClass GstOMXSimulcastEncClass;
+typedef struct _GstOMXSimulcastEncRendition GstOMXSimulcastEncRendition;
+
+struct _GstOMXSimulcastEnc
+{
+  GstElement parent;
+
+  /* < private > */
+  GstPad *sinkpad;
+
+  GMutex lock;
+  GCond cond;
+
+  /* TRUE while the output threads should run, LOCK */
+  gboolean running;
+  /* TRUE between flush-start and flush-stop, LOCK */
+  gboolean flushing;
+  /* Incremented whenever the output ports are usable again
+   * after flushing, LOCK */
+  guint cycle;
+  /* TRUE while draining for a format change, the EOS buffers
+   * are not forwarded then, LOCK */
+  gboolean draining;
+  /* TRUE if all renditions should start with an IDR frame, LOCK */
+  gboolean force_idr;
+  /* Flow returns of the source pads, LOCK */
+  GstFlowCombiner *flow_combiner;
+  GstFlowReturn flow_ret;
+
+  /* One component per rendition, only created between READY and PAUSED */
+  GstOMXSimulcastEncRendition *renditions;
+  guint n_renditions;
+
+  /* Only used by the streaming thread */
+  GstVideoInfo info;
+  gboolean configured;
+  /* TRUE if the components got a frame since the last drain or flush */
+  gboolean started;
+  guint frames_since_idr;
+  GstClockTime last_upstream_ts;
+
+  /* TRUE if the input ports of all components have the same layout and
+   * use the slots, otherwise each port has its own buffers */
+  gboolean shared_input;
+  /* Input buffer memory shared by the input ports of all components,
+   * every frame is copied once into the next slot */
+  GstMemory **slots;
+  GstMapInfo *slot_maps;
+  guint n_slots;
+  guint next_slot;
+
+  /* properties */
+  gchar *renditions_desc;
+  guint key_int_max;
+};
+
+struct _GstOMXSimulcastEncClass
+{
+  GstElementClass parent_class;
+
+  GstOMXClassData cdata;
+};
+
+GType gst_omx_simulcast_enc_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_OMX_SIMULCAST_ENC_H__ */
@@ -26,6 +26,8 @@
 #include "config.h"
 #endif
 
+#include <string.h>
+
 #include "gstomxvideo.h"
 
 GST_DEBUG_CATEGORY (gst_omx_video_debug_category);
@@ -200,3 +202,252 @@ gst_omx_video_find_nearest_frame (GstOMXBuffer * buf, GList * frames)
 
   return best;
 }
+
+/* Adds the input and output port of @comp. The port indices of @cdata
+ * are used if configured, otherwise the first two video ports */
+gboolean
+gst_omx_video_add_ports (GstOMXComponent * comp,
+    const GstOMXClassData * cdata, GstOMXPort ** in_port,
+    GstOMXPort ** out_port)
+{
+  gint in_port_index = cdata->in_port_index;
+  gint out_port_index = cdata->out_port_index;
+
+  if (in_port_index == -1 || out_port_index == -1) {
+    OMX_PORT_PARAM_TYPE param;
+    OMX_ERRORTYPE err;
+
+    GST_OMX_INIT_STRUCT (&param);
+
+    err =
+        gst_omx_component_get_parameter (comp, OMX_IndexParamVideoInit,
+        &param);
+    if (err != OMX_ErrorNone) {
+      GST_WARNING_OBJECT (comp->parent, "Couldn't get port information: "
+          "%s (0x%08x)", gst_omx_error_to_string (err), err);
+      /* Fallback */
+      in_port_index = 0;
+      out_port_index = 1;
+    } else {
+      GST_DEBUG_OBJECT (comp->parent, "Detected %u ports, starting at %u",
+          (guint) param.nPorts, (guint) param.nStartPortNumber);
+      in_port_index = param.nStartPortNumber + 0;
+      out_port_index = param.nStartPortNumber + 1;
+    }
+  }
+
+  *in_port = gst_omx_component_add_port (comp, in_port_index);
+  *out_port = gst_omx_component_add_port (comp, out_port_index);
+
+  return *in_port != NULL && *out_port != NULL;
+}
+
+/* Copies the picture in @inbuf, laid out with the stride and slice height
+ * of @port_def, into @frame. @x and @y are the top-left corner of the
+ * region to copy, the size of @frame is the size of the region. Returns
+ * FALSE if the format is not supported or @inbuf is too small */
+gboolean
+gst_omx_video_copy_frame (GstOMXBuffer * inbuf,
+    const OMX_PARAM_PORTDEFINITIONTYPE * port_def, guint x, guint y,
+    GstVideoFrame * frame)
+{
+  const GstVideoInfo *vinfo = &frame->info;
+  const guint nstride = port_def->format.video.nStride;
+  const guint nslice = port_def->format.video.nSliceHeight;
+  const guint width = GST_VIDEO_INFO_WIDTH (vinfo);
+  const guint height = GST_VIDEO_INFO_HEIGHT (vinfo);
+  guint src_stride[GST_VIDEO_MAX_PLANES] = { nstride, 0, };
+  guint src_size[GST_VIDEO_MAX_PLANES] = { nstride * nslice, 0, };
+  gint dst_width[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint dst_height[GST_VIDEO_MAX_PLANES] = { height, 0, };
+  const guint8 *src, *end;
+  guint p;
+
+  switch (GST_VIDEO_INFO_FORMAT (vinfo)) {
+    case GST_VIDEO_FORMAT_ABGR:
+    case GST_VIDEO_FORMAT_ARGB:
+      dst_width[0] = width * 4;
+      break;
+    case GST_VIDEO_FORMAT_RGB16:
+    case GST_VIDEO_FORMAT_BGR16:
+    case GST_VIDEO_FORMAT_YUY2:
+    case GST_VIDEO_FORMAT_UYVY:
+    case GST_VIDEO_FORMAT_YVYU:
+      dst_width[0] = width * 2;
+      break;
+    case GST_VIDEO_FORMAT_GRAY8:
+      dst_width[0] = width;
+      break;
+    case GST_VIDEO_FORMAT_I420:
+      dst_width[0] = width;
+      src_stride[1] = nstride / 2;
+      src_size[1] = (src_stride[1] * nslice) / 2;
+      dst_width[1] = width / 2;
+      dst_height[1] = height / 2;
+      src_stride[2] = nstride / 2;
+      src_size[2] = (src_stride[1] * nslice) / 2;
+      dst_width[2] = width / 2;
+      dst_height[2] = height / 2;
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+      dst_width[0] = width;
+      src_stride[1] = nstride;
+      src_size[1] = src_stride[1] * nslice / 2;
+      dst_width[1] = width;
+      dst_height[1] = height / 2;
+      break;
+    case GST_VIDEO_FORMAT_NV16:
+      dst_width[0] = width;
+      src_stride[1] = nstride;
+      src_size[1] = src_stride[1] * nslice;
+      dst_width[1] = width;
+      dst_height[1] = height;
+      break;
+    default:
+      GST_ERROR ("Unsupported format %s",
+          gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (vinfo)));
+      return FALSE;
+  }
+
+  src = inbuf->omx_buf->pBuffer + inbuf->omx_buf->nOffset;
+  end = inbuf->omx_buf->pBuffer + inbuf->omx_buf->nAllocLen;
+  for (p = 0; p < GST_VIDEO_INFO_N_PLANES (vinfo); p++) {
+    const guint8 *data;
+    guint8 *dst;
+    gint h;
+
+    dst = GST_VIDEO_FRAME_PLANE_DATA (frame, p);
+    data = src;
+    /* Skip to the top-left corner of the region, the plane sizes relative
+     * to the frame give the subsampling */
+    data += (y * dst_height[p] / height) * src_stride[p] +
+        x * dst_width[p] / width;
+
+    if (dst_height[p] > 0
+        && data + (dst_height[p] - 1) * src_stride[p] + dst_width[p] > end) {
+      GST_ERROR ("OpenMAX buffer too small for plane %u: %u bytes", p,
+          (guint) inbuf->omx_buf->nAllocLen);
+      return FALSE;
+    }
+
+    for (h = 0; h < dst_height[p]; h++) {
+      memcpy (dst, data, dst_width[p]);
+      dst += GST_VIDEO_FRAME_PLANE_STRIDE (frame, p);
+      data += src_stride[p];
+    }
+    src += src_size[p];
+  }
+
+  return TRUE;
+}
+
+/* Sets the timestamp and duration of @outbuf from @inbuf */
+void
+gst_omx_video_set_buffer_times (GstOMXBuffer * inbuf, GstBuffer * outbuf)
+{
+  GST_BUFFER_PTS (outbuf) =
+      gst_util_uint64_scale (GST_OMX_GET_TICKS (inbuf->omx_buf->nTimeStamp),
+      GST_SECOND, OMX_TICKS_PER_SECOND);
+  if (inbuf->omx_buf->nTickCount != 0)
+    GST_BUFFER_DURATION (outbuf) =
+        gst_util_uint64_scale (inbuf->omx_buf->nTickCount, GST_SECOND,
+        OMX_TICKS_PER_SECOND);
+}
+
+/* Number of output frames before the measured latency replaces
+ * a larger configured one */
+#define GST_OMX_VIDEO_LATENCY_WARMUP_FRAMES 30
+/* Number of output frames per window of the windowed maximum */
+#define GST_OMX_VIDEO_LATENCY_WINDOW_FRAMES 60
+
+void
+gst_omx_video_latency_reset (GstOMXVideoLatency * latency,
+    GstClockTime configured)
+{
+  latency->configured = configured;
+  latency->window_max = 0;
+  latency->prev_window_max = 0;
+  latency->window_frames = 0;
+  latency->n_frames = 0;
+  latency->latency = configured;
+}
+
+/* Remembers when @frame was passed to the component, in the frame's
+ * user data */
+void
+gst_omx_video_latency_mark_submitted (GstVideoCodecFrame * frame)
+{
+  gint64 *submitted;
+
+  submitted = gst_video_codec_frame_get_user_data (frame);
+  if (!submitted) {
+    submitted = g_new (gint64, 1);
+    gst_video_codec_frame_set_user_data (frame, submitted, g_free);
+  }
+  *submitted = g_get_monotonic_time ();
+}
+
+/* Returns the time since @frame was passed to the component, or
+ * GST_CLOCK_TIME_NONE if it wasn't marked */
+GstClockTime
+gst_omx_video_latency_get_measured (GstVideoCodecFrame * frame)
+{
+  gint64 *submitted;
+
+  submitted = gst_video_codec_frame_get_user_data (frame);
+  if (!submitted)
+    return GST_CLOCK_TIME_NONE;
+
+  return MAX (g_get_monotonic_time () - *submitted, 0) * GST_USECOND;
+}
+
+/* Called for every @frame the component outputs. Returns TRUE if the
+ * latency changed significantly and has to be reported again */
+gboolean
+gst_omx_video_latency_update (GstOMXVideoLatency * latency,
+    GstVideoCodecFrame * frame, GstVideoCodecState * state)
+{
+  GstClockTime measured, new_latency, diff, threshold;
+
+  measured = gst_omx_video_latency_get_measured (frame);
+  if (!GST_CLOCK_TIME_IS_VALID (measured))
+    return FALSE;
+
+  if (latency->window_frames == GST_OMX_VIDEO_LATENCY_WINDOW_FRAMES) {
+    latency->prev_window_max = latency->window_max;
+    latency->window_max = 0;
+    latency->window_frames = 0;
+  }
+  latency->window_frames++;
+  latency->window_max = MAX (latency->window_max, measured);
+  if (latency->n_frames < G_MAXUINT)
+    latency->n_frames++;
+
+  new_latency = MAX (latency->window_max, latency->prev_window_max);
+
+  /* Until the component is filled the measured value is too small */
+  if (latency->n_frames < GST_OMX_VIDEO_LATENCY_WARMUP_FRAMES
+      && GST_CLOCK_TIME_IS_VALID (latency->configured))
+    new_latency = MAX (new_latency, latency->configured);
+
+  /* Ignore changes of less than half a frame */
+  if (state && state->info.fps_n > 0 && state->info.fps_d > 0)
+    threshold = gst_util_uint64_scale_int (GST_SECOND / 2, state->info.fps_d,
+        state->info.fps_n);
+  else if (GST_CLOCK_TIME_IS_VALID (frame->duration))
+    threshold = frame->duration / 2;
+  else
+    threshold = GST_MSECOND;
+
+  if (GST_CLOCK_TIME_IS_VALID (latency->latency)) {
+    diff = new_latency > latency->latency ?
+        new_latency - latency->latency : latency->latency - new_latency;
+
+    if (diff < threshold)
+      return FALSE;
+  }
+
+  latency->latency = new_latency;
+
+  return TRUE;
+}
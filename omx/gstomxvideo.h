@@ -40,6 +40,25 @@ typedef struct
   OMX_COLOR_FORMATTYPE type;
 } GstOMXVideoNegotiationMap;
 
+/* Online measurement of the component's latency from the time between
+ * passing a frame to the component and getting it back. The maximum is
+ * taken over the last two windows of frames, so a single burst only
+ * raises the latency for a while */
+typedef struct
+{
+  /* Static latency from the configuration, or GST_CLOCK_TIME_NONE */
+  GstClockTime configured;
+  /* Largest latency measured in the current and the previous window */
+  GstClockTime window_max;
+  GstClockTime prev_window_max;
+  /* Number of output frames measured in the current window */
+  guint window_frames;
+  /* Number of output frames measured since the last reset */
+  guint n_frames;
+  /* Last reported latency */
+  GstClockTime latency;
+} GstOMXVideoLatency;
+
 GstVideoFormat
 gst_omx_video_get_format_from_omx (OMX_COLOR_FORMATTYPE omx_colorformat);
 
@@ -55,6 +74,33 @@ gst_omx_video_negotiation_map_free (GstOMXVideoNegotiationMap * m);
 GstVideoCodecFrame *
 gst_omx_video_find_nearest_frame (GstOMXBuffer * buf, GList * frames);
 
+gboolean
+gst_omx_video_add_ports (GstOMXComponent * comp,
+    const GstOMXClassData * cdata, GstOMXPort ** in_port,
+    GstOMXPort ** out_port);
+
+gboolean
+gst_omx_video_copy_frame (GstOMXBuffer * inbuf,
+    const OMX_PARAM_PORTDEFINITIONTYPE * port_def, guint x, guint y,
+    GstVideoFrame * frame);
+
+void
+gst_omx_video_set_buffer_times (GstOMXBuffer * inbuf, GstBuffer * outbuf);
+
+void
+gst_omx_video_latency_reset (GstOMXVideoLatency * latency,
+    GstClockTime configured);
+
+void
+gst_omx_video_latency_mark_submitted (GstVideoCodecFrame * frame);
+
+GstClockTime
+gst_omx_video_latency_get_measured (GstVideoCodecFrame * frame);
+
+gboolean
+gst_omx_video_latency_update (GstOMXVideoLatency * latency,
+    GstVideoCodecFrame * frame, GstVideoCodecState * state);
+
 G_END_DECLS
 
 #endif /* __GST_OMX_VIDEO_H__ */
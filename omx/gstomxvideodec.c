@@ -57,6 +57,10 @@ GST_DEBUG_CATEGORY_STATIC (gst_omx_video_dec_debug_category);
 
 /* prototypes */
 static void gst_omx_video_dec_finalize (GObject * object);
+static void gst_omx_video_dec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_omx_video_dec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
 
 static GstStateChangeReturn
 gst_omx_video_dec_change_state (GstElement * element,
@@ -69,6 +73,8 @@ static gboolean gst_omx_video_dec_stop (GstVideoDecoder * decoder);
 static gboolean gst_omx_video_dec_set_format (GstVideoDecoder * decoder,
     GstVideoCodecState * state);
 static gboolean gst_omx_video_dec_flush (GstVideoDecoder * decoder);
+static gboolean gst_omx_video_dec_sink_event (GstVideoDecoder * decoder,
+    GstEvent * event);
 static GstFlowReturn gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame);
 static GstFlowReturn gst_omx_video_dec_finish (GstVideoDecoder * decoder);
@@ -76,6 +82,7 @@ static gboolean gst_omx_video_dec_decide_allocation (GstVideoDecoder * bdec,
     GstQuery * query);
 
 static GstFlowReturn gst_omx_video_dec_drain (GstVideoDecoder * decoder);
+static GstFlowReturn gst_omx_video_dec_maybe_drain (GstVideoDecoder * decoder);
 
 static OMX_ERRORTYPE gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec *
     self);
@@ -84,9 +91,18 @@ static OMX_ERRORTYPE gst_omx_video_dec_deallocate_output_buffers (GstOMXVideoDec
 
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_MAX_WIDTH,
+  PROP_MAX_HEIGHT,
+  PROP_SINGLE_FRAME,
+  PROP_USE_DOWNSTREAM_BUFFERS
 };
 
+#define GST_OMX_VIDEO_DEC_MAX_WIDTH_DEFAULT (0)
+#define GST_OMX_VIDEO_DEC_MAX_HEIGHT_DEFAULT (0)
+#define GST_OMX_VIDEO_DEC_SINGLE_FRAME_DEFAULT (FALSE)
+#define GST_OMX_VIDEO_DEC_USE_DOWNSTREAM_BUFFERS_DEFAULT (FALSE)
+
 /* class initialization */
 
 #define DEBUG_INIT \
@@ -105,6 +121,44 @@ gst_omx_video_dec_class_init (GstOMXVideoDecClass * klass)
   GstVideoDecoderClass *video_decoder_class = GST_VIDEO_DECODER_CLASS (klass);
 
   gobject_class->finalize = gst_omx_video_dec_finalize;
+  gobject_class->set_property = gst_omx_video_dec_set_property;
+  gobject_class->get_property = gst_omx_video_dec_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_MAX_WIDTH,
+      g_param_spec_uint ("max-width", "Maximum Width",
+          "Largest expected output width. Output buffers are allocated for "
+          "this size so resolution changes that fit don't reallocate them "
+          "(0=disabled)",
+          0, G_MAXUINT, GST_OMX_VIDEO_DEC_MAX_WIDTH_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_HEIGHT,
+      g_param_spec_uint ("max-height", "Maximum Height",
+          "Largest expected output height. Output buffers are allocated for "
+          "this size so resolution changes that fit don't reallocate them "
+          "(0=disabled)",
+          0, G_MAXUINT, GST_OMX_VIDEO_DEC_MAX_HEIGHT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_SINGLE_FRAME,
+      g_param_spec_boolean ("single-frame", "Single Frame",
+          "Only decode the first keyframe, e.g. for thumbnails. Uses as few "
+          "buffers as possible and releases the component after the frame "
+          "was output",
+          GST_OMX_VIDEO_DEC_SINGLE_FRAME_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_USE_DOWNSTREAM_BUFFERS,
+      g_param_spec_boolean ("use-downstream-buffers", "Use Downstream Buffers",
+          "Let the component decode directly into the buffers of the pool "
+          "provided by downstream if they are suitable (needs OMX_UseBuffer "
+          "support)",
+          GST_OMX_VIDEO_DEC_USE_DOWNSTREAM_BUFFERS_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
 
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_omx_video_dec_change_state);
@@ -114,12 +168,15 @@ gst_omx_video_dec_class_init (GstOMXVideoDecClass * klass)
   video_decoder_class->start = GST_DEBUG_FUNCPTR (gst_omx_video_dec_start);
   video_decoder_class->stop = GST_DEBUG_FUNCPTR (gst_omx_video_dec_stop);
   video_decoder_class->flush = GST_DEBUG_FUNCPTR (gst_omx_video_dec_flush);
+  video_decoder_class->sink_event =
+      GST_DEBUG_FUNCPTR (gst_omx_video_dec_sink_event);
   video_decoder_class->set_format =
       GST_DEBUG_FUNCPTR (gst_omx_video_dec_set_format);
   video_decoder_class->handle_frame =
       GST_DEBUG_FUNCPTR (gst_omx_video_dec_handle_frame);
   video_decoder_class->finish = GST_DEBUG_FUNCPTR (gst_omx_video_dec_finish);
-  video_decoder_class->drain = GST_DEBUG_FUNCPTR (gst_omx_video_dec_drain);
+  video_decoder_class->drain =
+      GST_DEBUG_FUNCPTR (gst_omx_video_dec_maybe_drain);
   video_decoder_class->decide_allocation =
       GST_DEBUG_FUNCPTR (gst_omx_video_dec_decide_allocation);
 
@@ -142,6 +199,12 @@ gst_omx_video_dec_init (GstOMXVideoDec * self)
       (self), TRUE);
   GST_PAD_SET_ACCEPT_TEMPLATE (GST_VIDEO_DECODER_SINK_PAD (self));
 
+  self->max_width = GST_OMX_VIDEO_DEC_MAX_WIDTH_DEFAULT;
+  self->max_height = GST_OMX_VIDEO_DEC_MAX_HEIGHT_DEFAULT;
+  self->single_frame = GST_OMX_VIDEO_DEC_SINGLE_FRAME_DEFAULT;
+  self->use_downstream_buffers =
+      GST_OMX_VIDEO_DEC_USE_DOWNSTREAM_BUFFERS_DEFAULT;
+
   g_mutex_init (&self->drain_lock);
   g_cond_init (&self->drain_cond);
 }
@@ -151,7 +214,9 @@ gst_omx_video_dec_open (GstVideoDecoder * decoder)
 {
   GstOMXVideoDec *self = GST_OMX_VIDEO_DEC (decoder);
   GstOMXVideoDecClass *klass = GST_OMX_VIDEO_DEC_GET_CLASS (self);
+#if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
   gint in_port_index, out_port_index;
+#endif
 
   GST_DEBUG_OBJECT (self, "Opening decoder");
 
@@ -168,35 +233,8 @@ gst_omx_video_dec_open (GstVideoDecoder * decoder)
           GST_CLOCK_TIME_NONE) != OMX_StateLoaded)
     return FALSE;
 
-  in_port_index = klass->cdata.in_port_index;
-  out_port_index = klass->cdata.out_port_index;
-
-  if (in_port_index == -1 || out_port_index == -1) {
-    OMX_PORT_PARAM_TYPE param;
-    OMX_ERRORTYPE err;
-
-    GST_OMX_INIT_STRUCT (&param);
-
-    err =
-        gst_omx_component_get_parameter (self->dec, OMX_IndexParamVideoInit,
-        &param);
-    if (err != OMX_ErrorNone) {
-      GST_WARNING_OBJECT (self, "Couldn't get port information: %s (0x%08x)",
-          gst_omx_error_to_string (err), err);
-      /* Fallback */
-      in_port_index = 0;
-      out_port_index = 1;
-    } else {
-      GST_DEBUG_OBJECT (self, "Detected %u ports, starting at %u",
-          (guint) param.nPorts, (guint) param.nStartPortNumber);
-      in_port_index = param.nStartPortNumber + 0;
-      out_port_index = param.nStartPortNumber + 1;
-    }
-  }
-  self->dec_in_port = gst_omx_component_add_port (self->dec, in_port_index);
-  self->dec_out_port = gst_omx_component_add_port (self->dec, out_port_index);
-
-  if (!self->dec_in_port || !self->dec_out_port)
+  if (!gst_omx_video_add_ports (self->dec, &klass->cdata, &self->dec_in_port,
+          &self->dec_out_port))
     return FALSE;
 
   GST_DEBUG_OBJECT (self, "Opened decoder");
@@ -341,6 +379,56 @@ gst_omx_video_dec_finalize (GObject * object)
   G_OBJECT_CLASS (gst_omx_video_dec_parent_class)->finalize (object);
 }
 
+static void
+gst_omx_video_dec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXVideoDec *self = GST_OMX_VIDEO_DEC (object);
+
+  switch (prop_id) {
+    case PROP_MAX_WIDTH:
+      self->max_width = g_value_get_uint (value);
+      break;
+    case PROP_MAX_HEIGHT:
+      self->max_height = g_value_get_uint (value);
+      break;
+    case PROP_SINGLE_FRAME:
+      self->single_frame = g_value_get_boolean (value);
+      break;
+    case PROP_USE_DOWNSTREAM_BUFFERS:
+      self->use_downstream_buffers = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_video_dec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXVideoDec *self = GST_OMX_VIDEO_DEC (object);
+
+  switch (prop_id) {
+    case PROP_MAX_WIDTH:
+      g_value_set_uint (value, self->max_width);
+      break;
+    case PROP_MAX_HEIGHT:
+      g_value_set_uint (value, self->max_height);
+      break;
+    case PROP_SINGLE_FRAME:
+      g_value_set_boolean (value, self->single_frame);
+      break;
+    case PROP_USE_DOWNSTREAM_BUFFERS:
+      g_value_set_boolean (value, self->use_downstream_buffers);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static GstStateChangeReturn
 gst_omx_video_dec_change_state (GstElement * element, GstStateChange transition)
 {
@@ -375,6 +463,7 @@ gst_omx_video_dec_change_state (GstElement * element, GstStateChange transition)
 
       g_mutex_lock (&self->drain_lock);
       self->draining = FALSE;
+      self->flush_pending = FALSE;
       g_cond_broadcast (&self->drain_cond);
       g_mutex_unlock (&self->drain_lock);
       break;
@@ -418,18 +507,25 @@ gst_omx_video_dec_fill_buffer (GstOMXVideoDec * self,
   OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->dec_out_port->port_def;
   gboolean ret = FALSE;
   GstVideoFrame frame;
+  guint width, height;
+
+  if (self->has_crop) {
+    width = self->crop_width;
+    height = self->crop_height;
+  } else {
+    width = port_def->format.video.nFrameWidth;
+    height = port_def->format.video.nFrameHeight;
+  }
 
-  if (vinfo->width != port_def->format.video.nFrameWidth ||
-      vinfo->height != port_def->format.video.nFrameHeight) {
+  if (vinfo->width != width || vinfo->height != height) {
     GST_ERROR_OBJECT (self, "Resolution do not match: port=%ux%u vinfo=%dx%d",
-        (guint) port_def->format.video.nFrameWidth,
-        (guint) port_def->format.video.nFrameHeight,
-        vinfo->width, vinfo->height);
+        width, height, vinfo->width, vinfo->height);
     goto done;
   }
 
   /* Same strides and everything */
-  if (gst_buffer_get_size (outbuf) == inbuf->omx_buf->nFilledLen) {
+  if (!self->has_crop
+      && gst_buffer_get_size (outbuf) == inbuf->omx_buf->nFilledLen) {
     GstMapInfo map = GST_MAP_INFO_INIT;
 
     if (!gst_buffer_map (outbuf, &map, GST_MAP_WRITE)) {
@@ -447,100 +543,209 @@ gst_omx_video_dec_fill_buffer (GstOMXVideoDec * self,
 
   /* Different strides */
   if (gst_video_frame_map (&frame, vinfo, outbuf, GST_MAP_WRITE)) {
-    const guint nstride = port_def->format.video.nStride;
-    const guint nslice = port_def->format.video.nSliceHeight;
-    guint src_stride[GST_VIDEO_MAX_PLANES] = { nstride, 0, };
-    guint src_size[GST_VIDEO_MAX_PLANES] = { nstride * nslice, 0, };
-    gint dst_width[GST_VIDEO_MAX_PLANES] = { 0, };
-    gint dst_height[GST_VIDEO_MAX_PLANES] =
-        { GST_VIDEO_INFO_HEIGHT (vinfo), 0, };
-    const guint8 *src;
-    guint p;
-
-    switch (GST_VIDEO_INFO_FORMAT (vinfo)) {
-      case GST_VIDEO_FORMAT_ABGR:
-      case GST_VIDEO_FORMAT_ARGB:
-        dst_width[0] = GST_VIDEO_INFO_WIDTH (vinfo) * 4;
-        break;
-      case GST_VIDEO_FORMAT_RGB16:
-      case GST_VIDEO_FORMAT_BGR16:
-      case GST_VIDEO_FORMAT_YUY2:
-      case GST_VIDEO_FORMAT_UYVY:
-      case GST_VIDEO_FORMAT_YVYU:
-        dst_width[0] = GST_VIDEO_INFO_WIDTH (vinfo) * 2;
-        break;
-      case GST_VIDEO_FORMAT_GRAY8:
-        dst_width[0] = GST_VIDEO_INFO_WIDTH (vinfo);
-        break;
-      case GST_VIDEO_FORMAT_I420:
-        dst_width[0] = GST_VIDEO_INFO_WIDTH (vinfo);
-        src_stride[1] = nstride / 2;
-        src_size[1] = (src_stride[1] * nslice) / 2;
-        dst_width[1] = GST_VIDEO_INFO_WIDTH (vinfo) / 2;
-        dst_height[1] = GST_VIDEO_INFO_HEIGHT (vinfo) / 2;
-        src_stride[2] = nstride / 2;
-        src_size[2] = (src_stride[1] * nslice) / 2;
-        dst_width[2] = GST_VIDEO_INFO_WIDTH (vinfo) / 2;
-        dst_height[2] = GST_VIDEO_INFO_HEIGHT (vinfo) / 2;
-        break;
-      case GST_VIDEO_FORMAT_NV12:
-        dst_width[0] = GST_VIDEO_INFO_WIDTH (vinfo);
-        src_stride[1] = nstride;
-        src_size[1] = src_stride[1] * nslice / 2;
-        dst_width[1] = GST_VIDEO_INFO_WIDTH (vinfo);
-        dst_height[1] = GST_VIDEO_INFO_HEIGHT (vinfo) / 2;
-        break;
-      case GST_VIDEO_FORMAT_NV16:
-        dst_width[0] = GST_VIDEO_INFO_WIDTH (vinfo);
-        src_stride[1] = nstride;
-        src_size[1] = src_stride[1] * nslice;
-        dst_width[1] = GST_VIDEO_INFO_WIDTH (vinfo);
-        dst_height[1] = GST_VIDEO_INFO_HEIGHT (vinfo);
-        break;
-      default:
-        g_assert_not_reached ();
-        break;
-    }
-
-    src = inbuf->omx_buf->pBuffer + inbuf->omx_buf->nOffset;
-    for (p = 0; p < GST_VIDEO_INFO_N_PLANES (vinfo); p++) {
-      const guint8 *data;
-      guint8 *dst;
-      guint h;
-
-      dst = GST_VIDEO_FRAME_PLANE_DATA (&frame, p);
-      data = src;
-      for (h = 0; h < dst_height[p]; h++) {
-        memcpy (dst, data, dst_width[p]);
-        dst += GST_VIDEO_FRAME_PLANE_STRIDE (&frame, p);
-        data += src_stride[p];
-      }
-      src += src_size[p];
-    }
-
+    if (self->has_crop)
+      ret = gst_omx_video_copy_frame (inbuf, port_def, self->crop_x,
+          self->crop_y, &frame);
+    else
+      ret = gst_omx_video_copy_frame (inbuf, port_def, 0, 0, &frame);
     gst_video_frame_unmap (&frame);
-    ret = TRUE;
   } else {
     GST_ERROR_OBJECT (self, "Can't map output buffer to frame");
     goto done;
   }
 
 done:
-  if (ret) {
-    GST_BUFFER_PTS (outbuf) =
-        gst_util_uint64_scale (GST_OMX_GET_TICKS (inbuf->omx_buf->nTimeStamp),
-        GST_SECOND, OMX_TICKS_PER_SECOND);
-    if (inbuf->omx_buf->nTickCount != 0)
-      GST_BUFFER_DURATION (outbuf) =
-          gst_util_uint64_scale (inbuf->omx_buf->nTickCount, GST_SECOND,
-          OMX_TICKS_PER_SECOND);
-  }
+  if (ret)
+    gst_omx_video_set_buffer_times (inbuf, outbuf);
 
   gst_video_codec_state_unref (state);
 
   return ret;
 }
 
+/* Make the output buffers big enough for max-width x max-height so that
+ * later resolution changes can reuse them */
+static void
+gst_omx_video_dec_reserve_max_buffer_size (GstOMXVideoDec * self,
+    GstOMXPort * port)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+  guint64 width, height, size;
+  OMX_ERRORTYPE err;
+
+  if (self->max_width == 0 || self->max_height == 0)
+    return;
+
+  width = port->port_def.format.video.nFrameWidth;
+  height = port->port_def.format.video.nFrameHeight;
+  if (width == 0 || height == 0)
+    return;
+
+  /* Strides and slice heights scale with the frame size, so scaling the
+   * buffer size by the area is a good enough estimate */
+  size = gst_util_uint64_scale_ceil (port->port_def.nBufferSize,
+      MAX (width, self->max_width) * MAX (height, self->max_height),
+      width * height);
+  if (size <= port->port_def.nBufferSize)
+    return;
+
+  port_def = port->port_def;
+  port_def.nBufferSize = size;
+  err = gst_omx_port_update_port_definition (port, &port_def);
+  if (err != OMX_ErrorNone || port->port_def.nBufferSize < size) {
+    GST_WARNING_OBJECT (self, "Component refused output buffers of %u bytes "
+        "for %ux%u: %s (0x%08x)", (guint) size, self->max_width,
+        self->max_height, gst_omx_error_to_string (err), err);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (self, "Allocating output buffers of %u bytes for %ux%u",
+      (guint) port->port_def.nBufferSize, self->max_width, self->max_height);
+}
+
+/* Let the component decode into buffers acquired from the pool downstream
+ * proposed. This only works if the component supports OMX_UseBuffer and
+ * accepts the strides and slice heights of downstream's buffers, otherwise
+ * FALSE is returned with the port untouched and the caller should allocate
+ * the buffers itself. */
+static gboolean
+gst_omx_video_dec_use_downstream_buffers (GstOMXVideoDec * self,
+    GstOMXPort * port, GstBufferPool * pool, GstCaps * caps, guint min)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+  GstBufferPoolAcquireParams params = { 0, };
+  GstVideoInfo info;
+  GstVideoMeta *meta;
+  GList *buffers = NULL, *data = NULL, *l;
+  gboolean was_enabled = TRUE;
+  gint stride, slice_height;
+  OMX_ERRORTYPE err;
+  guint i;
+
+  if (self->has_crop || !gst_video_info_from_caps (&info, caps))
+    return FALSE;
+
+  if (!gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_INFO_OBJECT (self, "Failed to activate downstream pool");
+    return FALSE;
+  }
+
+  for (i = 0; i < min; i++) {
+    GstBuffer *buffer;
+
+    if (gst_buffer_pool_acquire_buffer (pool, &buffer,
+            &params) != GST_FLOW_OK) {
+      GST_INFO_OBJECT (self, "Failed to acquire %u-th downstream buffer", i);
+      goto fail;
+    }
+    buffers = g_list_append (buffers, buffer);
+
+    if (gst_buffer_n_memory (buffer) != 1) {
+      GST_INFO_OBJECT (self, "Downstream buffers have %u memories",
+          gst_buffer_n_memory (buffer));
+      goto fail;
+    }
+  }
+
+  /* All buffers of a pool have the same layout */
+  meta = gst_buffer_get_video_meta (buffers->data);
+  if (meta) {
+    stride = meta->stride[0];
+    slice_height = meta->n_planes > 1 ? meta->offset[1] / stride : meta->height;
+  } else {
+    stride = GST_VIDEO_INFO_PLANE_STRIDE (&info, 0);
+    slice_height = GST_VIDEO_INFO_N_PLANES (&info) > 1 ?
+        GST_VIDEO_INFO_PLANE_OFFSET (&info, 1) / stride :
+        GST_VIDEO_INFO_HEIGHT (&info);
+  }
+
+  err = gst_omx_port_update_port_definition (port, NULL);
+  if (err != OMX_ErrorNone)
+    goto fail;
+
+  port_def = port->port_def;
+  port_def.format.video.nStride = stride;
+  port_def.format.video.nSliceHeight = slice_height;
+  port_def.nBufferCountActual = min;
+  err = gst_omx_port_update_port_definition (port, &port_def);
+  if (err != OMX_ErrorNone
+      || port->port_def.format.video.nStride != stride
+      || port->port_def.format.video.nSliceHeight != slice_height
+      || port->port_def.nBufferCountActual != min) {
+    GST_INFO_OBJECT (self, "Component refused downstream layout, stride %d "
+        "slice height %d: %s (0x%08x)", stride, slice_height,
+        gst_omx_error_to_string (err), err);
+    goto fail;
+  }
+
+  for (l = buffers; l; l = l->next) {
+    GstMapInfo map;
+    guintptr align = MAX (port->port_def.nBufferAlignment, 1);
+
+    if (!gst_buffer_map (l->data, &map, GST_MAP_WRITE))
+      goto fail;
+    gst_buffer_unmap (l->data, &map);
+
+    if (map.size < port->port_def.nBufferSize
+        || ((guintptr) map.data) % align != 0) {
+      GST_INFO_OBJECT (self, "Downstream buffer %p of %" G_GSIZE_FORMAT
+          " bytes is too small or misaligned (%u bytes, %u alignment)",
+          map.data, map.size, (guint) port->port_def.nBufferSize,
+          (guint) port->port_def.nBufferAlignment);
+      goto fail;
+    }
+    data = g_list_append (data, map.data);
+  }
+
+  if (!gst_omx_port_is_enabled (port)) {
+    err = gst_omx_port_set_enabled (port, TRUE);
+    if (err != OMX_ErrorNone) {
+      GST_INFO_OBJECT (self, "Failed to enable port: %s (0x%08x)",
+          gst_omx_error_to_string (err), err);
+      goto fail;
+    }
+    was_enabled = FALSE;
+  }
+
+  err = gst_omx_port_use_buffers (port, data);
+  if (err != OMX_ErrorNone) {
+    GST_INFO_OBJECT (self, "Failed to pass downstream buffers to port: "
+        "%s (0x%08x)", gst_omx_error_to_string (err), err);
+    goto fail;
+  }
+
+  if (!was_enabled) {
+    err = gst_omx_port_wait_enabled (port, 2 * GST_SECOND);
+    if (err != OMX_ErrorNone) {
+      GST_INFO_OBJECT (self,
+          "Failed to wait until port is enabled: %s (0x%08x)",
+          gst_omx_error_to_string (err), err);
+      gst_omx_port_deallocate_buffers (port);
+      goto fail;
+    }
+  }
+
+  GST_DEBUG_OBJECT (self, "Decoding into %u downstream buffers", min);
+
+  GST_OMX_BUFFER_POOL (self->out_port_pool)->other_pool =
+      GST_BUFFER_POOL (gst_object_ref (pool));
+  for (l = buffers; l; l = l->next)
+    g_ptr_array_add (GST_OMX_BUFFER_POOL (self->out_port_pool)->buffers,
+        l->data);
+  g_list_free (buffers);
+  g_list_free (data);
+
+  return TRUE;
+
+fail:
+  if (!was_enabled)
+    gst_omx_port_set_enabled (port, FALSE);
+  g_list_free_full (buffers, (GDestroyNotify) gst_buffer_unref);
+  g_list_free (data);
+
+  return FALSE;
+}
+
 static OMX_ERRORTYPE
 gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec * self)
 {
@@ -548,7 +753,7 @@ gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec * self)
   GstOMXPort *port;
   GstBufferPool *pool;
   GstStructure *config;
-  gboolean eglimage = FALSE, add_videometa = FALSE;
+  gboolean eglimage = FALSE, add_videometa = FALSE, use_downstream = FALSE;
   GstCaps *caps = NULL;
   guint min = 0, max = 0;
   GstVideoCodecState *state =
@@ -593,6 +798,13 @@ gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec * self)
         GST_BUFFER_POOL_OPTION_VIDEO_META);
     gst_structure_free (config);
 
+    /* Cropped frames can only be passed downstream if it can handle
+     * both the strides and the crop rectangle */
+    if (self->has_crop && !(add_videometa && self->use_crop_meta)) {
+      GST_DEBUG_OBJECT (self, "Downstream doesn't support cropping, copying");
+      gst_caps_replace (&caps, NULL);
+    }
+
 #if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
     eglimage = self->eglimage
         && (allocator && GST_IS_GL_MEMORY_EGL_ALLOCATOR (allocator));
@@ -621,6 +833,13 @@ gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec * self)
   }
 #endif
 
+  /* Only one picture will be output, so use as few buffers as possible
+   * and copy it instead of sharing our buffers with downstream */
+  if (self->single_frame && !eglimage) {
+    gst_caps_replace (&caps, NULL);
+    min = max = port->port_def.nBufferCountMin;
+  }
+
   if (caps)
     self->out_port_pool =
         gst_omx_buffer_pool_new (GST_ELEMENT_CAST (self), self->dec, port);
@@ -754,10 +973,17 @@ gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec * self)
   }
 #endif
 
-  /* If not using EGLImage or trying to use EGLImage failed */
-  if (!eglimage) {
+  if (!eglimage && caps && self->use_downstream_buffers
+      && self->downstream_pool)
+    use_downstream =
+        gst_omx_video_dec_use_downstream_buffers (self, port, pool, caps, min);
+
+  /* If not using EGLImage or downstream buffers, or trying to failed */
+  if (!eglimage && !use_downstream) {
     gboolean was_enabled = TRUE;
 
+    gst_omx_video_dec_reserve_max_buffer_size (self, port);
+
     if (min != port->port_def.nBufferCountActual) {
       err = gst_omx_port_update_port_definition (port, NULL);
       if (err == OMX_ErrorNone) {
@@ -860,6 +1086,18 @@ gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec * self)
       goto done;
     }
 
+    /* The buffers contain the full frames, the caps only the visible part */
+    if (self->has_crop) {
+      GstVideoInfo info;
+
+      gst_video_info_set_format (&info,
+          GST_VIDEO_INFO_FORMAT (&GST_OMX_BUFFER_POOL (self->out_port_pool)->
+              video_info), port->port_def.format.video.nFrameWidth,
+          port->port_def.format.video.nFrameHeight);
+      gst_omx_buffer_pool_set_video_info (GST_OMX_BUFFER_POOL
+          (self->out_port_pool), &info);
+    }
+
     GST_OMX_BUFFER_POOL (self->out_port_pool)->allocating = TRUE;
     /* This now allocates all the buffers */
     if (!gst_buffer_pool_set_active (self->out_port_pool, TRUE)) {
@@ -914,6 +1152,137 @@ gst_omx_video_dec_deallocate_output_buffers (GstOMXVideoDec * self)
   return err;
 }
 
+/* Queries the visible rectangle of the output frames. Frames are either
+ * copied without the padding or, if downstream supports it, passed with
+ * a GstVideoCropMeta */
+static void
+gst_omx_video_dec_update_crop (GstOMXVideoDec * self, GstOMXPort * port)
+{
+  OMX_CONFIG_RECTTYPE crop;
+  guint width, height;
+  OMX_ERRORTYPE err;
+
+  self->has_crop = FALSE;
+
+  width = port->port_def.format.video.nFrameWidth;
+  height = port->port_def.format.video.nFrameHeight;
+
+  GST_OMX_INIT_STRUCT (&crop);
+  crop.nPortIndex = port->index;
+  err = gst_omx_component_get_config (self->dec,
+      OMX_IndexConfigCommonOutputCrop, &crop);
+  if (err != OMX_ErrorNone) {
+    GST_DEBUG_OBJECT (self, "Can't get output crop: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    return;
+  }
+
+  if (crop.nLeft < 0 || crop.nTop < 0 || crop.nWidth == 0
+      || crop.nHeight == 0 || crop.nLeft + crop.nWidth > width
+      || crop.nTop + crop.nHeight > height) {
+    GST_WARNING_OBJECT (self, "Ignoring invalid output crop %dx%d+%d+%d "
+        "for %ux%u frames", (gint) crop.nWidth, (gint) crop.nHeight,
+        (gint) crop.nLeft, (gint) crop.nTop, width, height);
+    return;
+  }
+
+  if (crop.nLeft == 0 && crop.nTop == 0 && crop.nWidth == width
+      && crop.nHeight == height)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Output crop %ux%u+%d+%d in %ux%u frames",
+      (guint) crop.nWidth, (guint) crop.nHeight, (gint) crop.nLeft,
+      (gint) crop.nTop, width, height);
+
+  self->has_crop = TRUE;
+  self->crop_x = crop.nLeft;
+  self->crop_y = crop.nTop;
+  self->crop_width = crop.nWidth;
+  self->crop_height = crop.nHeight;
+}
+
+static void
+gst_omx_video_dec_add_crop_meta (GstOMXVideoDec * self, GstBuffer * buffer)
+{
+  GstVideoCropMeta *meta;
+
+  meta = gst_buffer_get_video_crop_meta (buffer);
+  if (!meta)
+    meta = gst_buffer_add_video_crop_meta (buffer);
+
+  meta->x = self->crop_x;
+  meta->y = self->crop_y;
+  meta->width = self->crop_width;
+  meta->height = self->crop_height;
+}
+
+/* If downstream only accepts a smaller resolution than the coded one, ask
+ * the component to downscale the output. Components that can't scale
+ * keep outputting the full resolution and downstream has to cope. */
+static void
+gst_omx_video_dec_configure_scaling (GstOMXVideoDec * self, GstOMXPort * port)
+{
+  OMX_CONFIG_SCALEFACTORTYPE scale;
+  GstCaps *peercaps;
+  GstStructure *s;
+  gint width, height;
+  guint native_width, native_height;
+  OMX_S32 x_width = 1 << 16, x_height = 1 << 16;
+  OMX_ERRORTYPE err;
+
+  native_width = self->dec_in_port->port_def.format.video.nFrameWidth;
+  native_height = self->dec_in_port->port_def.format.video.nFrameHeight;
+  if (native_width == 0 || native_height == 0)
+    return;
+
+  peercaps = gst_pad_peer_query_caps (GST_VIDEO_DECODER_SRC_PAD (self), NULL);
+  if (peercaps && !gst_caps_is_empty (peercaps) && !gst_caps_is_any (peercaps)) {
+    s = gst_caps_get_structure (peercaps, 0);
+
+    if (gst_structure_get_int (s, "width", &width)
+        && gst_structure_get_int (s, "height", &height)
+        && width > 0 && height > 0
+        && width <= native_width && height <= native_height
+        && (width < native_width || height < native_height)) {
+      x_width = gst_util_uint64_scale_int (width, 1 << 16, native_width);
+      x_height = gst_util_uint64_scale_int (height, 1 << 16, native_height);
+      GST_DEBUG_OBJECT (self, "Downstream wants %dx%d, trying to downscale "
+          "from %ux%u", width, height, native_width, native_height);
+    }
+  }
+  if (peercaps)
+    gst_caps_unref (peercaps);
+
+  GST_OMX_INIT_STRUCT (&scale);
+  scale.nPortIndex = port->index;
+  err = gst_omx_component_get_config (self->dec, OMX_IndexConfigCommonScale,
+      &scale);
+  if (err != OMX_ErrorNone) {
+    if (x_width != 1 << 16 || x_height != 1 << 16)
+      GST_DEBUG_OBJECT (self, "Component does not support scaling: %s "
+          "(0x%08x)", gst_omx_error_to_string (err), err);
+    return;
+  }
+
+  if (scale.xWidth == x_width && scale.xHeight == x_height)
+    return;
+
+  scale.xWidth = x_width;
+  scale.xHeight = x_height;
+  err = gst_omx_component_set_config (self->dec, OMX_IndexConfigCommonScale,
+      &scale);
+  if (err != OMX_ErrorNone) {
+    GST_DEBUG_OBJECT (self, "Failed to set scale factor: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    return;
+  }
+
+  gst_omx_port_update_port_definition (port, NULL);
+  GST_DEBUG_OBJECT (self, "Output port now has %ux%u",
+      (guint) port->port_def.format.video.nFrameWidth,
+      (guint) port->port_def.format.video.nFrameHeight);
+}
+
 static OMX_ERRORTYPE
 gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
 {
@@ -925,6 +1294,8 @@ gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
 
   /* At this point the decoder output port is disabled */
 
+  self->has_crop = FALSE;
+
 #if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
   {
     OMX_STATETYPE egl_state;
@@ -1105,12 +1476,20 @@ gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
 #endif
   port = self->dec_out_port;
 
+  gst_omx_video_dec_configure_scaling (self, port);
+  gst_omx_video_dec_update_crop (self, port);
+
   /* Update caps */
   GST_VIDEO_DECODER_STREAM_LOCK (self);
 
   gst_omx_port_get_port_definition (port, &port_def);
   g_assert (port_def.format.video.eCompressionFormat == OMX_VIDEO_CodingUnused);
 
+  if (self->has_crop) {
+    port_def.format.video.nFrameWidth = self->crop_width;
+    port_def.format.video.nFrameHeight = self->crop_height;
+  }
+
   format =
       gst_omx_video_get_format_from_omx (port_def.format.video.eColorFormat);
 
@@ -1165,6 +1544,92 @@ done:
   return err;
 }
 
+/* Handles output port settings changes without disabling the port and
+ * reallocating the buffers if the currently allocated buffers are big
+ * enough for the new settings. Only done if max-width/max-height are set,
+ * as the component has to support changing resolution on enabled ports.
+ * Returns FALSE if the port has to be reconfigured the normal way. */
+static gboolean
+gst_omx_video_dec_reconfigure_output_in_place (GstOMXVideoDec * self,
+    GstOMXPort * port)
+{
+  GstVideoCodecState *state;
+  GstVideoFormat format;
+  GstVideoInfo info;
+  guint i;
+
+  if (self->max_width == 0 || self->max_height == 0)
+    return FALSE;
+
+#if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
+  if (self->eglimage)
+    return FALSE;
+#endif
+
+  if (!gst_omx_port_is_enabled (port) || !port->buffers)
+    return FALSE;
+
+  /* Downstream must be able to follow the new strides without copying */
+  if (self->out_port_pool
+      && !GST_OMX_BUFFER_POOL (self->out_port_pool)->add_videometa)
+    return FALSE;
+
+  /* Downstream's buffers have a fixed layout */
+  if (self->out_port_pool
+      && GST_OMX_BUFFER_POOL (self->out_port_pool)->other_pool)
+    return FALSE;
+
+  if (gst_omx_port_update_port_definition (port, NULL) != OMX_ErrorNone)
+    return FALSE;
+
+  if (port->port_def.format.video.nFrameWidth > self->max_width
+      || port->port_def.format.video.nFrameHeight > self->max_height
+      || port->port_def.nBufferCountMin > port->buffers->len)
+    return FALSE;
+
+  /* Cropped output might need a different buffer setup */
+  gst_omx_video_dec_update_crop (self, port);
+  if (self->has_crop)
+    return FALSE;
+
+  for (i = 0; i < port->buffers->len; i++) {
+    GstOMXBuffer *buf = g_ptr_array_index (port->buffers, i);
+
+    if (buf->omx_buf->nAllocLen < port->port_def.nBufferSize)
+      return FALSE;
+  }
+
+  format =
+      gst_omx_video_get_format_from_omx (port->port_def.format.video.
+      eColorFormat);
+  if (format == GST_VIDEO_FORMAT_UNKNOWN)
+    return FALSE;
+
+  GST_DEBUG_OBJECT (self, "Reconfiguring output port in place to %ux%u",
+      (guint) port->port_def.format.video.nFrameWidth,
+      (guint) port->port_def.format.video.nFrameHeight);
+
+  GST_VIDEO_DECODER_STREAM_LOCK (self);
+  state = gst_video_decoder_set_output_state (GST_VIDEO_DECODER (self),
+      format, port->port_def.format.video.nFrameWidth,
+      port->port_def.format.video.nFrameHeight, self->input_state);
+  info = state->info;
+  gst_video_codec_state_unref (state);
+
+  if (!gst_video_decoder_negotiate (GST_VIDEO_DECODER (self))) {
+    GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+    GST_DEBUG_OBJECT (self, "Failed to negotiate, reallocating buffers");
+    return FALSE;
+  }
+
+  if (self->out_port_pool)
+    gst_omx_buffer_pool_set_video_info (GST_OMX_BUFFER_POOL
+        (self->out_port_pool), &info);
+  GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+
+  return gst_omx_port_mark_reconfigured (port) == OMX_ErrorNone;
+}
+
 static void
 gst_omx_video_dec_clean_older_frames (GstOMXVideoDec * self,
     GstOMXBuffer * buf, GList * frames)
@@ -1236,6 +1701,90 @@ copy_frame (const GstVideoInfo * info, GstBuffer * outbuf)
   return tmpbuf;
 }
 
+static gboolean
+gst_omx_video_dec_is_key_units_trickmode (GstOMXVideoDec * self)
+{
+  GstSegment *segment = &GST_VIDEO_DECODER (self)->input_segment;
+
+  return (segment->flags & GST_SEGMENT_FLAG_TRICKMODE_KEY_UNITS) != 0;
+}
+
+/* Reports the latency to the base class, which also posts
+ * a latency message to let the pipeline reconfigure */
+static void
+gst_omx_video_dec_report_latency (GstOMXVideoDec * self)
+{
+  GstClockTime latency = self->latency.latency;
+
+  if (!GST_CLOCK_TIME_IS_VALID (latency))
+    return;
+
+  GST_INFO_OBJECT (self, "Reporting latency %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (latency));
+  gst_video_decoder_set_latency (GST_VIDEO_DECODER (self), latency, latency);
+}
+
+static void
+gst_omx_video_dec_update_trickmode_stats (GstOMXVideoDec * self)
+{
+  gint64 now, elapsed;
+
+  if (!gst_omx_video_dec_is_key_units_trickmode (self))
+    return;
+
+  now = g_get_monotonic_time ();
+  if (self->trickmode_frames == 0)
+    self->trickmode_start = now;
+  self->trickmode_frames++;
+
+  elapsed = now - self->trickmode_start;
+  if (elapsed >= G_TIME_SPAN_SECOND) {
+    GST_INFO_OBJECT (self, "Key unit trick mode: %" G_GUINT64_FORMAT
+        " frames in %.3f s (%.2f fps)", self->trickmode_frames,
+        (gdouble) elapsed / G_TIME_SPAN_SECOND,
+        (gdouble) self->trickmode_frames * G_TIME_SPAN_SECOND / elapsed);
+    self->trickmode_frames = 0;
+  }
+}
+
+/* Single frame mode: the frame was output, wakes up
+ * gst_omx_video_dec_finish_single_frame() */
+static void
+gst_omx_video_dec_set_single_frame_done (GstOMXVideoDec * self)
+{
+  g_mutex_lock (&self->drain_lock);
+  self->single_frame_done = TRUE;
+  g_cond_broadcast (&self->drain_cond);
+  g_mutex_unlock (&self->drain_lock);
+}
+
+/* Called by the srcpad loop when it notices flushing. If a flush is in
+ * progress, wait until it is finished and return TRUE to let the task
+ * continue. Otherwise return FALSE and the task is paused as usual. */
+static gboolean
+gst_omx_video_dec_park_loop (GstOMXVideoDec * self)
+{
+  g_mutex_lock (&self->drain_lock);
+  if (!self->flush_pending) {
+    g_mutex_unlock (&self->drain_lock);
+    return FALSE;
+  }
+
+  GST_DEBUG_OBJECT (self, "Flushing -- parking task");
+  if (self->draining)
+    self->draining = FALSE;
+  self->loop_parked = TRUE;
+  g_cond_broadcast (&self->drain_cond);
+  while (self->flush_pending)
+    g_cond_wait (&self->drain_cond, &self->drain_lock);
+  self->loop_parked = FALSE;
+  g_mutex_unlock (&self->drain_lock);
+
+  GST_DEBUG_OBJECT (self, "Flush finished -- resuming task");
+
+  return TRUE;
+}
+
 static void
 gst_omx_video_dec_loop (GstOMXVideoDec * self)
 {
@@ -1270,6 +1819,10 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
 
     GST_DEBUG_OBJECT (self, "Port settings have changed, updating caps");
 
+    if (acq_return == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE
+        && gst_omx_video_dec_reconfigure_output_in_place (self, port))
+      return;
+
     /* Reallocate all buffers */
     if (acq_return == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE
         && gst_omx_port_is_enabled (port)) {
@@ -1303,6 +1856,12 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
       g_assert (port_def.format.video.eCompressionFormat ==
           OMX_VIDEO_CodingUnused);
 
+      gst_omx_video_dec_update_crop (self, port);
+      if (self->has_crop) {
+        port_def.format.video.nFrameWidth = self->crop_width;
+        port_def.format.video.nFrameHeight = self->crop_height;
+      }
+
       format =
           gst_omx_video_get_format_from_omx (port_def.format.video.
           eColorFormat);
@@ -1363,6 +1922,12 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
       (guint) buf->omx_buf->nFlags,
       (guint64) GST_OMX_GET_TICKS (buf->omx_buf->nTimeStamp));
 
+  if (self->flush_start_time != 0 && buf->omx_buf->nFilledLen > 0) {
+    GST_INFO_OBJECT (self, "First output buffer %" G_GINT64_FORMAT
+        " us after flush", g_get_monotonic_time () - self->flush_start_time);
+    self->flush_start_time = 0;
+  }
+
   GST_VIDEO_DECODER_STREAM_LOCK (self);
   frame = gst_omx_video_find_nearest_frame (buf,
       gst_video_decoder_get_frames (GST_VIDEO_DECODER (self)));
@@ -1376,7 +1941,19 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
   gst_omx_video_dec_clean_older_frames (self, buf,
       gst_video_decoder_get_frames (GST_VIDEO_DECODER (self)));
 
-  if (frame
+  if (frame && gst_omx_video_latency_update (&self->latency, frame,
+          self->input_state))
+    gst_omx_video_dec_report_latency (self);
+
+  if (frame && (GST_VIDEO_CODEC_FRAME_IS_DECODE_ONLY (frame)
+          || (buf->omx_buf->nFlags & OMX_BUFFERFLAG_DECODEONLY))) {
+    /* Decoded for reference only, don't bother copying it out. This is
+     * not a QoS drop, so don't report it as one */
+    GST_LOG_OBJECT (self, "Releasing decode-only frame");
+    gst_video_decoder_release_frame (GST_VIDEO_DECODER (self), frame);
+    flow_ret = GST_FLOW_OK;
+    frame = NULL;
+  } else if (frame
       && (deadline = gst_video_decoder_get_max_decode_time
           (GST_VIDEO_DECODER (self), frame)) < 0) {
     GST_WARNING_OBJECT (self,
@@ -1420,6 +1997,8 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
         outbuf =
             copy_frame (&GST_OMX_BUFFER_POOL (self->out_port_pool)->video_info,
             outbuf);
+      else if (self->has_crop)
+        gst_omx_video_dec_add_crop_meta (self, outbuf);
 
       buf = NULL;
     } else {
@@ -1433,6 +2012,8 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
     }
 
     flow_ret = gst_pad_push (GST_VIDEO_DECODER_SRC_PAD (self), outbuf);
+    if (self->single_frame)
+      gst_omx_video_dec_set_single_frame_done (self);
   } else if (buf->omx_buf->nFilledLen > 0 || buf->eglimage) {
     if (self->out_port_pool) {
       gint i, n;
@@ -1464,6 +2045,8 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
         outbuf =
             copy_frame (&GST_OMX_BUFFER_POOL (self->out_port_pool)->video_info,
             outbuf);
+      else if (self->has_crop)
+        gst_omx_video_dec_add_crop_meta (self, outbuf);
 
       frame->output_buffer = outbuf;
 
@@ -1471,6 +2054,9 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
           gst_video_decoder_finish_frame (GST_VIDEO_DECODER (self), frame);
       frame = NULL;
       buf = NULL;
+      gst_omx_video_dec_update_trickmode_stats (self);
+      if (self->single_frame)
+        gst_omx_video_dec_set_single_frame_done (self);
     } else {
       if ((flow_ret =
               gst_video_decoder_allocate_output_frame (GST_VIDEO_DECODER
@@ -1490,6 +2076,9 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
         flow_ret =
             gst_video_decoder_finish_frame (GST_VIDEO_DECODER (self), frame);
         frame = NULL;
+        gst_omx_video_dec_update_trickmode_stats (self);
+        if (self->single_frame)
+          gst_omx_video_dec_set_single_frame_done (self);
       }
     }
   } else if (frame != NULL) {
@@ -1512,6 +2101,18 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
   if (flow_ret != GST_FLOW_OK)
     goto flow_error;
 
+  if (self->single_frame_done) {
+    /* Nothing else is going to be output, make upstream stop sending
+     * data and let drain() release the component */
+    GST_DEBUG_OBJECT (self, "Single frame output -- stopping task");
+    self->downstream_flow_ret = GST_FLOW_EOS;
+    g_mutex_lock (&self->drain_lock);
+    gst_pad_pause_task (GST_VIDEO_DECODER_SRC_PAD (self));
+    self->started = FALSE;
+    g_cond_broadcast (&self->drain_cond);
+    g_mutex_unlock (&self->drain_lock);
+  }
+
   GST_VIDEO_DECODER_STREAM_UNLOCK (self);
 
   return;
@@ -1531,15 +2132,16 @@ component_error:
 
 flushing:
   {
+    if (gst_omx_video_dec_park_loop (self))
+      return;
+
     GST_DEBUG_OBJECT (self, "Flushing -- stopping task");
     g_mutex_lock (&self->drain_lock);
-    if (self->draining) {
-      self->draining = FALSE;
-      g_cond_broadcast (&self->drain_cond);
-    }
+    self->draining = FALSE;
     gst_pad_pause_task (GST_VIDEO_DECODER_SRC_PAD (self));
     self->downstream_flow_ret = GST_FLOW_FLUSHING;
     self->started = FALSE;
+    g_cond_broadcast (&self->drain_cond);
     g_mutex_unlock (&self->drain_lock);
     return;
   }
@@ -1597,14 +2199,17 @@ flow_error:
       gst_pad_pause_task (GST_VIDEO_DECODER_SRC_PAD (self));
       self->started = FALSE;
     } else if (flow_ret == GST_FLOW_FLUSHING) {
+      GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+      if (gst_omx_video_dec_park_loop (self))
+        return;
+      GST_VIDEO_DECODER_STREAM_LOCK (self);
+
       GST_DEBUG_OBJECT (self, "Flushing -- stopping task");
       g_mutex_lock (&self->drain_lock);
-      if (self->draining) {
-        self->draining = FALSE;
-        g_cond_broadcast (&self->drain_cond);
-      }
+      self->draining = FALSE;
       gst_pad_pause_task (GST_VIDEO_DECODER_SRC_PAD (self));
       self->started = FALSE;
+      g_cond_broadcast (&self->drain_cond);
       g_mutex_unlock (&self->drain_lock);
     }
     GST_VIDEO_DECODER_STREAM_UNLOCK (self);
@@ -1667,6 +2272,14 @@ gst_omx_video_dec_start (GstVideoDecoder * decoder)
 
   self->last_upstream_ts = 0;
   self->downstream_flow_ret = GST_FLOW_OK;
+  self->trickmode_frames = 0;
+  self->skip_keyframe_drain = FALSE;
+  self->single_frame_submitted = FALSE;
+  self->single_frame_done = FALSE;
+
+  gst_omx_video_latency_reset (&self->latency,
+      GST_OMX_VIDEO_DEC_GET_CLASS (self)->cdata.latency);
+  gst_omx_video_dec_report_latency (self);
 
   return TRUE;
 }
@@ -1721,6 +2334,98 @@ gst_omx_video_dec_stop (GstVideoDecoder * decoder)
   return TRUE;
 }
 
+/* Position of @format in the preference order of @caps, or -1 if @caps
+ * don't accept @format at all */
+static gint
+gst_omx_video_dec_get_downstream_rank (GstCaps * caps, GstVideoFormat format)
+{
+  const gchar *format_str = gst_video_format_to_string (format);
+  gint rank = 0;
+  guint i, j, n;
+
+  n = gst_caps_get_size (caps);
+  for (i = 0; i < n; i++) {
+    GstStructure *s = gst_caps_get_structure (caps, i);
+    const GValue *v = gst_structure_get_value (s, "format");
+
+    if (!v)
+      return rank;
+
+    if (GST_VALUE_HOLDS_LIST (v)) {
+      for (j = 0; j < gst_value_list_get_size (v); j++) {
+        const GValue *f = gst_value_list_get_value (v, j);
+
+        if (G_VALUE_HOLDS_STRING (f)
+            && g_strcmp0 (g_value_get_string (f), format_str) == 0)
+          return rank;
+        rank++;
+      }
+    } else if (G_VALUE_HOLDS_STRING (v)) {
+      if (g_strcmp0 (g_value_get_string (v), format_str) == 0)
+        return rank;
+      rank++;
+    }
+  }
+
+  return -1;
+}
+
+/* Estimates how expensive it is to output @m, lower is better. Takes into
+ * account downstream's preference, the memory bandwidth of the format and
+ * if the component's buffer layout for it needs to be fixed up by copying */
+static guint
+gst_omx_video_dec_get_format_cost (GstOMXVideoDec * self,
+    GstOMXVideoNegotiationMap * m, gint rank)
+{
+  OMX_VIDEO_PARAM_PORTFORMATTYPE param;
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+  const GstVideoFormatInfo *finfo;
+  GstVideoInfo info;
+  guint bits = 0, cost, c;
+  gboolean layout_matches = TRUE;
+
+  finfo = gst_video_format_get_info (m->format);
+  for (c = 0; c < GST_VIDEO_FORMAT_INFO_N_COMPONENTS (finfo); c++)
+    bits += GST_VIDEO_FORMAT_INFO_DEPTH (finfo, c) >>
+        (GST_VIDEO_FORMAT_INFO_W_SUB (finfo, c) +
+        GST_VIDEO_FORMAT_INFO_H_SUB (finfo, c));
+
+  /* Ask the component which layout it would use for this format */
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = self->dec_out_port->index;
+  param.eColorFormat = m->type;
+  if (gst_omx_component_set_parameter (self->dec,
+          OMX_IndexParamVideoPortFormat, &param) == OMX_ErrorNone
+      && gst_omx_port_get_port_definition (self->dec_out_port,
+          &port_def) == OMX_ErrorNone
+      && port_def.format.video.nFrameWidth > 0
+      && port_def.format.video.nFrameHeight > 0) {
+    gst_video_info_set_format (&info, m->format,
+        port_def.format.video.nFrameWidth,
+        port_def.format.video.nFrameHeight);
+
+    if (port_def.format.video.nStride != 0
+        && port_def.format.video.nStride != GST_VIDEO_INFO_PLANE_STRIDE (&info,
+            0))
+      layout_matches = FALSE;
+    if (GST_VIDEO_INFO_N_PLANES (&info) > 1
+        && port_def.format.video.nSliceHeight != 0
+        && port_def.format.video.nSliceHeight !=
+        port_def.format.video.nFrameHeight)
+      layout_matches = FALSE;
+  }
+
+  cost = rank * 20 + bits / 2;
+  if (!layout_matches)
+    cost += self->downstream_video_meta ? 5 : 40;
+
+  GST_DEBUG_OBJECT (self, "Format %s (%d): downstream rank %d, %u bits per "
+      "pixel, layout %s: cost %u", gst_video_format_to_string (m->format),
+      m->type, rank, bits, layout_matches ? "matches" : "differs", cost);
+
+  return cost;
+}
+
 static gboolean
 gst_omx_video_dec_negotiate (GstOMXVideoDec * self)
 {
@@ -1728,10 +2433,9 @@ gst_omx_video_dec_negotiate (GstOMXVideoDec * self)
   OMX_ERRORTYPE err;
   GstCaps *comp_supported_caps;
   GList *negotiation_map = NULL, *l;
-  GstCaps *templ_caps, *intersection;
-  GstVideoFormat format;
-  GstStructure *s;
-  const gchar *format_str;
+  GstCaps *templ_caps, *intersection, *peercaps;
+  GstOMXVideoNegotiationMap *best = NULL;
+  guint best_cost = G_MAXUINT;
 
   GST_DEBUG_OBJECT (self, "Trying to negotiate a video format with downstream");
 
@@ -1742,6 +2446,7 @@ gst_omx_video_dec_negotiate (GstOMXVideoDec * self)
 
   GST_DEBUG_OBJECT (self, "Allowed downstream caps: %" GST_PTR_FORMAT,
       intersection);
+  peercaps = gst_caps_ref (intersection);
 
   negotiation_map =
       gst_omx_video_get_supported_colorformats (self->dec_out_port,
@@ -1760,21 +2465,41 @@ gst_omx_video_dec_negotiate (GstOMXVideoDec * self)
 
   if (gst_caps_is_empty (intersection)) {
     gst_caps_unref (intersection);
+    gst_caps_unref (peercaps);
     GST_ERROR_OBJECT (self, "Empty caps");
     g_list_free_full (negotiation_map,
         (GDestroyNotify) gst_omx_video_negotiation_map_free);
     return FALSE;
   }
 
-  intersection = gst_caps_truncate (intersection);
-  intersection = gst_caps_fixate (intersection);
+  /* Pick the cheapest of the formats both sides support */
+  for (l = negotiation_map; l; l = l->next) {
+    GstOMXVideoNegotiationMap *m = l->data;
+    GstCaps *fcaps;
+    gboolean supported;
+    guint cost;
+    gint rank;
+
+    fcaps = gst_caps_new_simple ("video/x-raw", "format", G_TYPE_STRING,
+        gst_video_format_to_string (m->format), NULL);
+    supported = gst_caps_can_intersect (intersection, fcaps);
+    gst_caps_unref (fcaps);
+    if (!supported)
+      continue;
 
-  s = gst_caps_get_structure (intersection, 0);
-  format_str = gst_structure_get_string (s, "format");
-  if (!format_str ||
-      (format =
-          gst_video_format_from_string (format_str)) ==
-      GST_VIDEO_FORMAT_UNKNOWN) {
+    rank = gst_omx_video_dec_get_downstream_rank (peercaps, m->format);
+    if (rank < 0)
+      continue;
+
+    cost = gst_omx_video_dec_get_format_cost (self, m, rank);
+    if (cost < best_cost) {
+      best = m;
+      best_cost = cost;
+    }
+  }
+  gst_caps_unref (peercaps);
+
+  if (!best) {
     GST_ERROR_OBJECT (self, "Invalid caps: %" GST_PTR_FORMAT, intersection);
     gst_caps_unref (intersection);
     g_list_free_full (negotiation_map,
@@ -1784,21 +2509,12 @@ gst_omx_video_dec_negotiate (GstOMXVideoDec * self)
 
   GST_OMX_INIT_STRUCT (&param);
   param.nPortIndex = self->dec_out_port->index;
+  param.eColorFormat = best->type;
 
-  for (l = negotiation_map; l; l = l->next) {
-    GstOMXVideoNegotiationMap *m = l->data;
-
-    if (m->format == format) {
-      param.eColorFormat = m->type;
-      break;
-    }
-  }
+  GST_INFO_OBJECT (self, "Negotiating color format %s (%d) with cost %u",
+      gst_video_format_to_string (best->format), param.eColorFormat,
+      best_cost);
 
-  GST_DEBUG_OBJECT (self, "Negotiating color format %s (%d)", format_str,
-      param.eColorFormat);
-
-  /* We must find something here */
-  g_assert (l != NULL);
   g_list_free_full (negotiation_map,
       (GDestroyNotify) gst_omx_video_negotiation_map_free);
 
@@ -1862,6 +2578,9 @@ gst_omx_video_dec_set_format (GstVideoDecoder * decoder,
     return TRUE;
   }
 
+  /* The latency of the old format doesn't apply anymore */
+  gst_omx_video_latency_reset (&self->latency, klass->cdata.latency);
+
   if (needs_disable && is_format_change) {
 #if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
     GstOMXPort *out_port =
@@ -1956,6 +2675,8 @@ gst_omx_video_dec_set_format (GstVideoDecoder * decoder,
 
   port_def.format.video.nFrameWidth = info->width;
   port_def.format.video.nFrameHeight = info->height;
+  if (self->single_frame)
+    port_def.nBufferCountActual = port_def.nBufferCountMin;
   if (info->fps_n == 0)
     port_def.format.video.xFramerate = 0;
   else
@@ -2066,6 +2787,93 @@ gst_omx_video_dec_set_format (GstVideoDecoder * decoder,
   return TRUE;
 }
 
+/* TRUE if the component can be flushed while it stays in Executing state */
+static gboolean
+gst_omx_video_dec_can_fast_flush (GstOMXVideoDec * self)
+{
+  if (!self->dec)
+    return FALSE;
+
+#if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
+  if (self->eglimage)
+    return FALSE;
+#endif
+
+  return gst_omx_component_get_state (self->dec, 0) == OMX_StateExecuting;
+}
+
+/* Flushes the component while it stays in Executing state. Both ports are
+ * flushed at once and the srcpad task is kept alive, it only waits until
+ * the output port is populated again.
+ *
+ * flush_pending is usually set already on flush-start, see
+ * gst_omx_video_dec_sink_event() */
+static void
+gst_omx_video_dec_fast_flush (GstOMXVideoDec * self)
+{
+  GstOMXPort *ports[2];
+  OMX_ERRORTYPE err;
+  gint64 deadline;
+
+  ports[0] = self->dec_in_port;
+  ports[1] = self->dec_out_port;
+
+  g_mutex_lock (&self->drain_lock);
+  self->flush_pending = TRUE;
+  g_mutex_unlock (&self->drain_lock);
+
+  /* 1) Flush the ports */
+  err = gst_omx_component_flush_ports (self->dec, ports, G_N_ELEMENTS (ports),
+      5 * GST_SECOND);
+  if (err != OMX_ErrorNone)
+    GST_WARNING_OBJECT (self, "Failed to flush ports: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+
+  /* 2) Wait until the srcpad loop is parked or paused itself,
+   * unlock GST_VIDEO_DECODER_STREAM_LOCK to prevent deadlocks
+   * caused by using this lock from inside the loop function */
+  GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+  deadline = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+  g_mutex_lock (&self->drain_lock);
+  while (!self->loop_parked
+      && gst_pad_get_task_state (GST_VIDEO_DECODER_SRC_PAD (self)) ==
+      GST_TASK_STARTED) {
+    if (!g_cond_wait_until (&self->drain_cond, &self->drain_lock, deadline)) {
+      GST_WARNING_OBJECT (self, "Timeout waiting for the srcpad loop");
+      break;
+    }
+  }
+  g_mutex_unlock (&self->drain_lock);
+  GST_VIDEO_DECODER_STREAM_LOCK (self);
+
+  /* 3) Unset flushing and give all output buffers back in one go */
+  gst_omx_port_set_flushing (self->dec_in_port, 5 * GST_SECOND, FALSE);
+  gst_omx_port_set_flushing (self->dec_out_port, 5 * GST_SECOND, FALSE);
+
+  err = gst_omx_port_populate (self->dec_out_port);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (self, "Failed to populate output port: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+  }
+
+  /* Reset our state */
+  self->last_upstream_ts = 0;
+  self->downstream_flow_ret = GST_FLOW_OK;
+  self->started = FALSE;
+  self->trickmode_frames = 0;
+  self->skip_keyframe_drain = FALSE;
+  gst_omx_video_latency_reset (&self->latency,
+      GST_OMX_VIDEO_DEC_GET_CLASS (self)->cdata.latency);
+
+  /* 4) Let the srcpad loop continue */
+  g_mutex_lock (&self->drain_lock);
+  self->flush_pending = FALSE;
+  g_cond_broadcast (&self->drain_cond);
+  g_mutex_unlock (&self->drain_lock);
+
+  GST_DEBUG_OBJECT (self, "Flush finished");
+}
+
 static gboolean
 gst_omx_video_dec_flush (GstVideoDecoder * decoder)
 {
@@ -2074,9 +2882,24 @@ gst_omx_video_dec_flush (GstVideoDecoder * decoder)
 
   GST_DEBUG_OBJECT (self, "Flushing decoder");
 
+  if (gst_omx_video_dec_can_fast_flush (self)) {
+    self->flush_start_time = g_get_monotonic_time ();
+    gst_omx_video_dec_fast_flush (self);
+    return TRUE;
+  }
+
+  /* A flush-start may have prepared for a fast flush, let the srcpad loop
+   * stop instead */
+  g_mutex_lock (&self->drain_lock);
+  self->flush_pending = FALSE;
+  g_cond_broadcast (&self->drain_cond);
+  g_mutex_unlock (&self->drain_lock);
+
   if (gst_omx_component_get_state (self->dec, 0) == OMX_StateLoaded)
     return TRUE;
 
+  self->flush_start_time = g_get_monotonic_time ();
+
   /* 0) Pause the components */
   if (gst_omx_component_get_state (self->dec, 0) == OMX_StateExecuting) {
     gst_omx_component_set_state (self->dec, OMX_StatePause);
@@ -2147,11 +2970,35 @@ gst_omx_video_dec_flush (GstVideoDecoder * decoder)
   self->last_upstream_ts = 0;
   self->downstream_flow_ret = GST_FLOW_OK;
   self->started = FALSE;
+  self->trickmode_frames = 0;
+  self->skip_keyframe_drain = FALSE;
+  gst_omx_video_latency_reset (&self->latency,
+      GST_OMX_VIDEO_DEC_GET_CLASS (self)->cdata.latency);
   GST_DEBUG_OBJECT (self, "Flush finished");
 
   return TRUE;
 }
 
+static gboolean
+gst_omx_video_dec_sink_event (GstVideoDecoder * decoder, GstEvent * event)
+{
+  GstOMXVideoDec *self = GST_OMX_VIDEO_DEC (decoder);
+
+  /* Once flush-start is forwarded, downstream returns FLUSHING and the
+   * srcpad loop would pause the task. Tell it to park instead before
+   * that, the ports are flushed later in flush() */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_START
+      && gst_omx_video_dec_can_fast_flush (self)) {
+    g_mutex_lock (&self->drain_lock);
+    self->flush_pending = TRUE;
+    g_mutex_unlock (&self->drain_lock);
+  }
+
+  return
+      GST_VIDEO_DECODER_CLASS (gst_omx_video_dec_parent_class)->sink_event
+      (decoder, event);
+}
+
 static GstFlowReturn
 gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame)
@@ -2171,6 +3018,13 @@ gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
 
   GST_DEBUG_OBJECT (self, "Handling frame");
 
+  self->skip_keyframe_drain = FALSE;
+
+  if (self->single_frame && self->single_frame_submitted) {
+    gst_video_decoder_drop_frame (decoder, frame);
+    return GST_FLOW_EOS;
+  }
+
   if (!self->started) {
     if (!GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)) {
       gst_video_decoder_drop_frame (GST_VIDEO_DECODER (self), frame);
@@ -2189,6 +3043,44 @@ gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
     return self->downstream_flow_ret;
   }
 
+  /* In key unit trick mode only sync points are decoded */
+  if (gst_omx_video_dec_is_key_units_trickmode (self)
+      && !GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)) {
+    GST_LOG_OBJECT (self, "Key unit trick mode, dropping delta frame");
+    return gst_video_decoder_drop_frame (decoder, frame);
+  }
+
+  /* Frames that are already too late and that nothing else references can
+   * be dropped before they are decoded at all, saving the component time
+   * and the copy on the output side */
+  if (!GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)
+      && GST_BUFFER_FLAG_IS_SET (frame->input_buffer,
+          GST_BUFFER_FLAG_DROPPABLE)) {
+    GstClockTimeDiff deadline;
+
+    deadline = gst_video_decoder_get_max_decode_time (decoder, frame);
+    if (deadline < 0) {
+      GST_DEBUG_OBJECT (self,
+          "Dropping late non-reference frame before decoding (deadline %"
+          GST_TIME_FORMAT ")", GST_TIME_ARGS (-deadline));
+      return gst_video_decoder_drop_frame (decoder, frame);
+    }
+  }
+
+  /* Frames ending before the segment start (e.g. after an accurate seek)
+   * are only needed as references, they will never be displayed.
+   * A thumbnail is always taken from the first keyframe though */
+  if (!self->single_frame
+      && decoder->input_segment.format == GST_FORMAT_TIME
+      && GST_CLOCK_TIME_IS_VALID (timestamp)
+      && GST_CLOCK_TIME_IS_VALID (decoder->input_segment.start)
+      && timestamp + (GST_CLOCK_TIME_IS_VALID (duration) ? duration : 0) <
+      decoder->input_segment.start) {
+    GST_LOG_OBJECT (self, "Frame %" GST_TIME_FORMAT " is before the segment "
+        "start, decoding only", GST_TIME_ARGS (timestamp));
+    GST_VIDEO_CODEC_FRAME_SET_DECODE_ONLY (frame);
+  }
+
   if (klass->prepare_frame) {
     GstFlowReturn ret;
 
@@ -2347,19 +3239,27 @@ gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
       buf->omx_buf->nTickCount = 0;
     }
 
-    if (offset == 0 && GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame))
-      buf->omx_buf->nFlags |= OMX_BUFFERFLAG_SYNCFRAME;
+    if (offset == 0) {
+      if (GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame))
+        buf->omx_buf->nFlags |= OMX_BUFFERFLAG_SYNCFRAME;
+      gst_omx_video_latency_mark_submitted (frame);
+    }
 
-    /* TODO: Set flags
-     *   - OMX_BUFFERFLAG_DECODEONLY for buffers that are outside
-     *     the segment
-     */
+    if (GST_VIDEO_CODEC_FRAME_IS_DECODE_ONLY (frame))
+      buf->omx_buf->nFlags |= OMX_BUFFERFLAG_DECODEONLY;
 
     offset += buf->omx_buf->nFilledLen;
 
-    if (offset == size)
+    if (offset == size) {
       buf->omx_buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
 
+      /* Nothing will follow, no need to drain later */
+      if (self->single_frame) {
+        buf->omx_buf->nFlags |= OMX_BUFFERFLAG_EOS;
+        self->single_frame_submitted = TRUE;
+      }
+    }
+
     self->started = TRUE;
     err = gst_omx_port_release_buffer (port, buf);
     if (err != OMX_ErrorNone)
@@ -2370,6 +3270,15 @@ gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
 
   GST_DEBUG_OBJECT (self, "Passed frame to component");
 
+  if (self->single_frame_submitted)
+    return GST_FLOW_EOS;
+
+  /* The base class drains next, see gst_omx_video_dec_maybe_drain() */
+  if (decoder->input_segment.rate > 0.0
+      && gst_omx_video_dec_is_key_units_trickmode (self)
+      && self->downstream_flow_ret == GST_FLOW_OK)
+    self->skip_keyframe_drain = TRUE;
+
   return self->downstream_flow_ret;
 
 full_buffer:
@@ -2437,6 +3346,61 @@ gst_omx_video_dec_finish (GstVideoDecoder * decoder)
   return gst_omx_video_dec_drain (decoder);
 }
 
+/* In single frame mode, waits until the frame was output and then puts the
+ * component back to Loaded state right away */
+static void
+gst_omx_video_dec_finish_single_frame (GstOMXVideoDec * self)
+{
+  gint64 wait_until;
+
+  GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+
+  /* Not all error paths of the loop wake us up when pausing the task */
+  wait_until = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&self->drain_lock);
+  while (!self->single_frame_done
+      && gst_pad_get_task_state (GST_VIDEO_DECODER_SRC_PAD (self)) ==
+      GST_TASK_STARTED) {
+    if (!g_cond_wait_until (&self->drain_cond, &self->drain_lock,
+            wait_until)) {
+      GST_WARNING_OBJECT (self, "Timeout waiting for the single frame");
+      break;
+    }
+  }
+  g_mutex_unlock (&self->drain_lock);
+
+  GST_DEBUG_OBJECT (self, "Single frame finished, releasing component");
+
+  gst_omx_port_set_flushing (self->dec_in_port, 5 * GST_SECOND, TRUE);
+  gst_omx_port_set_flushing (self->dec_out_port, 5 * GST_SECOND, TRUE);
+  gst_pad_stop_task (GST_VIDEO_DECODER_SRC_PAD (self));
+
+  GST_VIDEO_DECODER_STREAM_LOCK (self);
+
+  self->started = FALSE;
+  gst_omx_video_dec_shutdown (self);
+}
+
+static GstFlowReturn
+gst_omx_video_dec_maybe_drain (GstVideoDecoder * decoder)
+{
+  GstOMXVideoDec *self = GST_OMX_VIDEO_DEC (decoder);
+
+  /* In forward key unit trick mode the base class drains right after
+   * every keyframe to reduce latency. Draining means a full EOS round-trip
+   * and a restart of the component for every frame, so only this drain is
+   * skipped. A component that holds back its output until more input
+   * arrives outputs the keyframe once the next one is passed. */
+  if (self->skip_keyframe_drain) {
+    self->skip_keyframe_drain = FALSE;
+    GST_LOG_OBJECT (self, "Key unit trick mode, not draining component");
+    return GST_FLOW_OK;
+  }
+
+  return gst_omx_video_dec_drain (decoder);
+}
+
 static GstFlowReturn
 gst_omx_video_dec_drain (GstVideoDecoder * decoder)
 {
@@ -2452,6 +3416,11 @@ gst_omx_video_dec_drain (GstVideoDecoder * decoder)
 
   klass = GST_OMX_VIDEO_DEC_GET_CLASS (self);
 
+  if (self->single_frame_submitted) {
+    gst_omx_video_dec_finish_single_frame (self);
+    return GST_FLOW_OK;
+  }
+
   if (!self->started) {
     GST_DEBUG_OBJECT (self, "Component not started yet");
     return GST_FLOW_OK;
@@ -2522,6 +3491,7 @@ gst_omx_video_dec_drain (GstVideoDecoder * decoder)
 static gboolean
 gst_omx_video_dec_decide_allocation (GstVideoDecoder * bdec, GstQuery * query)
 {
+  GstOMXVideoDec *self = GST_OMX_VIDEO_DEC (bdec);
   GstBufferPool *pool;
   GstStructure *config;
 
@@ -2569,6 +3539,47 @@ gst_omx_video_dec_decide_allocation (GstVideoDecoder * bdec, GstQuery * query)
   }
 #endif
 
+  /* Only decode into downstream's buffers if it offered its own pool */
+  self->downstream_pool = FALSE;
+  if (gst_query_get_n_allocation_pools (query) > 0) {
+    guint size, min, max;
+
+    gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+    if (pool) {
+      self->downstream_pool = TRUE;
+
+      /* The component needs at least this many buffers to decode into */
+      if (self->use_downstream_buffers) {
+        min = MAX (min, self->dec_out_port->port_def.nBufferCountMin);
+        if (max != 0)
+          max = MAX (max, min);
+        gst_query_set_nth_allocation_pool (query, 0, pool, size, min, max);
+      }
+      gst_object_unref (pool);
+    }
+  }
+
+  /* Ask for the alignment the component needs for its buffers */
+  if (self->use_downstream_buffers
+      && self->dec_out_port->port_def.nBufferAlignment > 1) {
+    GstAllocator *allocator = NULL;
+    GstAllocationParams params;
+
+    if (gst_query_get_n_allocation_params (query) > 0) {
+      gst_query_parse_nth_allocation_param (query, 0, &allocator, &params);
+    } else {
+      gst_allocation_params_init (&params);
+    }
+    params.align =
+        MAX (params.align, self->dec_out_port->port_def.nBufferAlignment - 1);
+    if (gst_query_get_n_allocation_params (query) > 0)
+      gst_query_set_nth_allocation_param (query, 0, allocator, &params);
+    else
+      gst_query_add_allocation_param (query, allocator, &params);
+    if (allocator)
+      gst_object_unref (allocator);
+  }
+
   if (!GST_VIDEO_DECODER_CLASS
       (gst_omx_video_dec_parent_class)->decide_allocation (bdec, query))
     return FALSE;
@@ -2582,6 +3593,11 @@ gst_omx_video_dec_decide_allocation (GstVideoDecoder * bdec, GstQuery * query)
     gst_buffer_pool_config_add_option (config,
         GST_BUFFER_POOL_OPTION_VIDEO_META);
   }
+  GST_OMX_VIDEO_DEC (bdec)->downstream_video_meta =
+      gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
+  GST_OMX_VIDEO_DEC (bdec)->use_crop_meta =
+      gst_query_find_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE,
+      NULL);
   gst_buffer_pool_set_config (pool, config);
   gst_object_unref (pool);
 
@@ -30,6 +30,7 @@
 #include <gst/video/gstvideodecoder.h>
 
 #include "gstomx.h"
+#include "gstomxvideo.h"
 
 G_BEGIN_DECLS
 
@@ -75,6 +76,45 @@ struct _GstOMXVideoDec
   gboolean draining;
 
   GstFlowReturn downstream_flow_ret;
+
+  /* Output crop rectangle reported by the component */
+  gboolean has_crop;
+  gint crop_x, crop_y, crop_width, crop_height;
+  /* TRUE if downstream supports GstVideoCropMeta */
+  gboolean use_crop_meta;
+  /* TRUE if downstream supported GstVideoMeta in the last allocation query */
+  gboolean downstream_video_meta;
+  /* TRUE if the pool of the last allocation query came from downstream */
+  gboolean downstream_pool;
+
+  /* Single frame mode state */
+  gboolean single_frame_submitted;
+  /* TRUE once the frame was output, drain_lock */
+  gboolean single_frame_done;
+
+  /* properties */
+  guint32 max_width;
+  guint32 max_height;
+  gboolean single_frame;
+  gboolean use_downstream_buffers;
+
+  /* TRUE while a flush is in progress and the srcpad loop
+   * should wait for it to finish instead of pausing */
+  gboolean flush_pending;
+  /* TRUE if the srcpad loop is waiting for the flush to finish */
+  gboolean loop_parked;
+  /* Start of the last flush, for measuring seek latency */
+  gint64 flush_start_time;
+
+  /* Measured latency of the component */
+  GstOMXVideoLatency latency;
+
+  /* Key unit trick mode statistics */
+  guint64 trickmode_frames;
+  gint64 trickmode_start;
+  /* TRUE if the drain following a keyframe in forward key unit trick
+   * mode should be skipped */
+  gboolean skip_keyframe_drain;
 #ifdef USE_OMX_TARGET_RPI
   GstOMXComponent *egl_render;
   GstOMXPort *egl_in_port, *egl_out_port;
@@ -26,6 +26,12 @@
 #include <gst/video/gstvideometa.h>
 #include <string.h>
 
+#if defined (__ARM_NEON__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "gstomxvideo.h"
 #include "gstomxvideoenc.h"
 
@@ -61,6 +67,49 @@ gst_omx_video_enc_control_rate_get_type (void)
   return qtype;
 }
 
+#define GST_TYPE_OMX_VIDEO_ENC_INTRA_REFRESH_MODE (gst_omx_video_enc_intra_refresh_mode_get_type ())
+static GType
+gst_omx_video_enc_intra_refresh_mode_get_type (void)
+{
+  static GType qtype = 0;
+
+  if (qtype == 0) {
+    static const GEnumValue values[] = {
+      {OMX_VIDEO_IntraRefreshCyclic, "Cyclic", "cyclic"},
+      {OMX_VIDEO_IntraRefreshAdaptive, "Adaptive", "adaptive"},
+      {OMX_VIDEO_IntraRefreshBoth, "Cyclic and Adaptive", "both"},
+      {0xffffffff, "Component Default", "default"},
+      {0, NULL, NULL}
+    };
+
+    qtype =
+        g_enum_register_static ("GstOMXVideoEncIntraRefreshMode", values);
+  }
+  return qtype;
+}
+
+#define GST_TYPE_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY (gst_omx_video_enc_input_queue_policy_get_type ())
+static GType
+gst_omx_video_enc_input_queue_policy_get_type (void)
+{
+  static GType qtype = 0;
+
+  if (qtype == 0) {
+    static const GEnumValue values[] = {
+      {GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_BLOCK, "Block", "block"},
+      {GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DROP_OLDEST, "Drop Oldest",
+          "drop-oldest"},
+      {GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DROP_NEWEST, "Drop Newest",
+          "drop-newest"},
+      {0, NULL, NULL}
+    };
+
+    qtype =
+        g_enum_register_static ("GstOMXVideoEncInputQueuePolicy", values);
+  }
+  return qtype;
+}
+
 /* prototypes */
 static void gst_omx_video_enc_finalize (GObject * object);
 static void gst_omx_video_enc_set_property (GObject * object, guint prop_id,
@@ -87,8 +136,12 @@ static gboolean gst_omx_video_enc_propose_allocation (GstVideoEncoder * encoder,
     GstQuery * query);
 static GstCaps *gst_omx_video_enc_getcaps (GstVideoEncoder * encoder,
     GstCaps * filter);
+static gboolean gst_omx_video_enc_src_event (GstVideoEncoder * encoder,
+    GstEvent * event);
 
 static GstFlowReturn gst_omx_video_enc_drain (GstOMXVideoEnc * self);
+static GstFlowReturn gst_omx_video_enc_submit_frame (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame);
 
 static GstFlowReturn gst_omx_video_enc_handle_output_frame (GstOMXVideoEnc *
     self, GstOMXPort * port, GstOMXBuffer * buf, GstVideoCodecFrame * frame);
@@ -100,7 +153,25 @@ enum
   PROP_TARGET_BITRATE,
   PROP_QUANT_I_FRAMES,
   PROP_QUANT_P_FRAMES,
-  PROP_QUANT_B_FRAMES
+  PROP_QUANT_B_FRAMES,
+  PROP_ZERO_COPY_OUTPUT,
+  PROP_SLICE_OUTPUT,
+  PROP_INTRA_REFRESH_MODE,
+  PROP_INTRA_REFRESH_MBS,
+  PROP_ADAPTIVE_BITRATE,
+  PROP_MIN_BITRATE,
+  PROP_MAX_BITRATE,
+  PROP_INPUT_QUEUE_SIZE,
+  PROP_INPUT_QUEUE_POLICY,
+  PROP_INPUT_QUEUE_DROPPED,
+  PROP_KEYFRAME_SCHEDULE,
+  PROP_KEYFRAMES_ON_TARGET,
+  PROP_KEYFRAMES_MISSED,
+  PROP_KEYFRAMES_UNSCHEDULED,
+  PROP_ROI_QP_DELTA,
+  PROP_ROI_BITRATE_BOOST,
+  PROP_STATS_META,
+  PROP_STATS_INTERVAL
 };
 
 /* FIXME: Better defaults */
@@ -109,6 +180,58 @@ enum
 #define GST_OMX_VIDEO_ENC_QUANT_I_FRAMES_DEFAULT (0xffffffff)
 #define GST_OMX_VIDEO_ENC_QUANT_P_FRAMES_DEFAULT (0xffffffff)
 #define GST_OMX_VIDEO_ENC_QUANT_B_FRAMES_DEFAULT (0xffffffff)
+#define GST_OMX_VIDEO_ENC_ZERO_COPY_OUTPUT_DEFAULT (FALSE)
+#define GST_OMX_VIDEO_ENC_SLICE_OUTPUT_DEFAULT (FALSE)
+#define GST_OMX_VIDEO_ENC_INTRA_REFRESH_MODE_DEFAULT (0xffffffff)
+#define GST_OMX_VIDEO_ENC_INTRA_REFRESH_MBS_DEFAULT (0xffffffff)
+#define GST_OMX_VIDEO_ENC_ADAPTIVE_BITRATE_DEFAULT (FALSE)
+#define GST_OMX_VIDEO_ENC_MIN_BITRATE_DEFAULT (0)
+#define GST_OMX_VIDEO_ENC_MAX_BITRATE_DEFAULT (0)
+#define GST_OMX_VIDEO_ENC_INPUT_QUEUE_SIZE_DEFAULT (0)
+#define GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DEFAULT \
+    (GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_BLOCK)
+#define GST_OMX_VIDEO_ENC_KEYFRAME_SCHEDULE_DEFAULT (0)
+#define GST_OMX_VIDEO_ENC_ROI_QP_DELTA_DEFAULT (-5)
+#define GST_OMX_VIDEO_ENC_ROI_BITRATE_BOOST_DEFAULT (0)
+#define GST_OMX_VIDEO_ENC_STATS_META_DEFAULT (FALSE)
+#define GST_OMX_VIDEO_ENC_STATS_INTERVAL_DEFAULT (0)
+
+/* Extension for per-frame regions of interest. Every region set
+ * before an input buffer only applies to that buffer */
+#define GST_OMX_VIDEO_ENC_ROI_EXTENSION \
+    "OMX.index.config.video.regionofinterest"
+
+typedef struct
+{
+  OMX_U32 nSize;
+  OMX_VERSIONTYPE nVersion;
+  OMX_U32 nPortIndex;
+  OMX_U32 nLeft;
+  OMX_U32 nTop;
+  OMX_U32 nWidth;
+  OMX_U32 nHeight;
+  OMX_S32 nQpDelta;
+} GstOMXVideoEncRegionOfInterest;
+
+/* Extension reporting the average quantizer of the last frame
+ * that came out of the output port */
+#define GST_OMX_VIDEO_ENC_AVERAGE_QP_EXTENSION \
+    "OMX.index.config.video.averageqp"
+
+typedef struct
+{
+  OMX_U32 nSize;
+  OMX_VERSIONTYPE nVersion;
+  OMX_U32 nPortIndex;
+  OMX_U32 nQp;
+} GstOMXVideoEncAverageQp;
+
+/* Adaptive bitrate tuning: share of the estimate used for the video,
+ * fraction of the distance to the target covered per estimate when
+ * increasing and the smallest change the component is reconfigured for */
+#define GST_OMX_VIDEO_ENC_ABR_HEADROOM_PERCENT 90
+#define GST_OMX_VIDEO_ENC_ABR_RAMP_UP_DIVISOR 4
+#define GST_OMX_VIDEO_ENC_ABR_MIN_CHANGE_PERCENT 5
 
 /* class initialization */
 #define do_init \
@@ -169,6 +292,148 @@ gst_omx_video_enc_class_init (GstOMXVideoEncClass * klass)
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
           GST_PARAM_MUTABLE_READY));
 
+  g_object_class_install_property (gobject_class, PROP_ZERO_COPY_OUTPUT,
+      g_param_spec_boolean ("zero-copy-output", "Zero-copy Output",
+          "Push the encoded data in the component's output buffers instead "
+          "of copying it, falls back to copying if downstream holds on to "
+          "too many buffers",
+          GST_OMX_VIDEO_ENC_ZERO_COPY_OUTPUT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_SLICE_OUTPUT,
+      g_param_spec_boolean ("slice-output", "Slice Output",
+          "Push output buffers without OMX_BUFFERFLAG_ENDOFFRAME downstream "
+          "as soon as they are produced and finish the frame with the last "
+          "one",
+          GST_OMX_VIDEO_ENC_SLICE_OUTPUT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_INTRA_REFRESH_MODE,
+      g_param_spec_enum ("intra-refresh-mode", "Intra Refresh Mode",
+          "Refresh the picture with intra macroblocks spread over several "
+          "frames instead of periodic keyframes",
+          GST_TYPE_OMX_VIDEO_ENC_INTRA_REFRESH_MODE,
+          GST_OMX_VIDEO_ENC_INTRA_REFRESH_MODE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_INTRA_REFRESH_MBS,
+      g_param_spec_uint ("intra-refresh-mbs", "Intra Refresh Macroblocks",
+          "Number of intra macroblocks per frame for intra refresh "
+          "(0xffffffff=component default)",
+          0, G_MAXUINT, GST_OMX_VIDEO_ENC_INTRA_REFRESH_MBS_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_BITRATE,
+      g_param_spec_boolean ("adaptive-bitrate", "Adaptive Bitrate",
+          "Follow the \"bandwidth-estimate\" custom upstream events "
+          "(with a \"bitrate\" field in bits per second) by changing the "
+          "bitrate at runtime",
+          GST_OMX_VIDEO_ENC_ADAPTIVE_BITRATE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_BITRATE,
+      g_param_spec_uint ("min-bitrate", "Minimum Bitrate",
+          "Lowest bitrate set by adaptive-bitrate, frames are skipped for "
+          "lower bandwidth estimates (0=no limit)",
+          0, G_MAXUINT, GST_OMX_VIDEO_ENC_MIN_BITRATE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_BITRATE,
+      g_param_spec_uint ("max-bitrate", "Maximum Bitrate",
+          "Highest bitrate set by adaptive-bitrate (0=no limit)",
+          0, G_MAXUINT, GST_OMX_VIDEO_ENC_MAX_BITRATE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_INPUT_QUEUE_SIZE,
+      g_param_spec_uint ("input-queue-size", "Input Queue Size",
+          "Number of frames queued for a separate thread passing them to "
+          "the component, so that upstream does not wait for input buffers "
+          "(0=pass frames from the upstream thread)",
+          0, G_MAXUINT, GST_OMX_VIDEO_ENC_INPUT_QUEUE_SIZE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_INPUT_QUEUE_POLICY,
+      g_param_spec_enum ("input-queue-policy", "Input Queue Policy",
+          "What to do with new frames while the input queue is full",
+          GST_TYPE_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY,
+          GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_INPUT_QUEUE_DROPPED,
+      g_param_spec_uint ("input-queue-dropped", "Input Queue Dropped",
+          "Number of frames dropped because the input queue was full",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEYFRAME_SCHEDULE,
+      g_param_spec_uint64 ("keyframe-schedule", "Keyframe Schedule",
+          "Force a keyframe on the first frame at or after every multiple of "
+          "this running time interval in nanoseconds, replacing the periodic "
+          "keyframes of the component (0=disabled)",
+          0, G_MAXUINT64, GST_OMX_VIDEO_ENC_KEYFRAME_SCHEDULE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_KEYFRAMES_ON_TARGET,
+      g_param_spec_uint ("keyframes-on-target", "Keyframes On Target",
+          "Number of keyframes scheduled by keyframe-schedule that were "
+          "encoded on their target frame",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEYFRAMES_MISSED,
+      g_param_spec_uint ("keyframes-missed", "Keyframes Missed",
+          "Number of target frames of keyframe-schedule that were not "
+          "encoded as keyframe",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEYFRAMES_UNSCHEDULED,
+      g_param_spec_uint ("keyframes-unscheduled", "Keyframes Unscheduled",
+          "Number of keyframes not requested by keyframe-schedule, e.g. "
+          "by force-key-unit events or the component itself",
+          0, G_MAXUINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_QP_DELTA,
+      g_param_spec_int ("roi-qp-delta", "ROI QP Delta",
+          "Quantizer offset for the regions of interest of a frame if the "
+          "component supports them, unless the region has a 'roi/omx' "
+          "parameter with a 'delta-qp' field",
+          -51, 51, GST_OMX_VIDEO_ENC_ROI_QP_DELTA_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_ROI_BITRATE_BOOST,
+      g_param_spec_uint ("roi-bitrate-boost", "ROI Bitrate Boost",
+          "Percentage the bitrate is raised by for frames with regions of "
+          "interest if the component doesn't support them (0=disabled)",
+          0, 1000, GST_OMX_VIDEO_ENC_ROI_BITRATE_BOOST_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_META,
+      g_param_spec_boolean ("stats-meta", "Statistics Meta",
+          "Attach a GstOMXVideoEncStatsMeta with the size, type, encoding "
+          "latency and quantizer of the frame to every output buffer",
+          GST_OMX_VIDEO_ENC_STATS_META_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_STATS_INTERVAL,
+      g_param_spec_uint64 ("stats-interval", "Statistics Interval",
+          "Post an omx-encoder-stats element message with the statistics of "
+          "the frames of every interval of this many nanoseconds of stream "
+          "time (0=disabled)",
+          0, G_MAXUINT64, GST_OMX_VIDEO_ENC_STATS_INTERVAL_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_omx_video_enc_change_state);
 
@@ -185,6 +450,8 @@ gst_omx_video_enc_class_init (GstOMXVideoEncClass * klass)
   video_encoder_class->propose_allocation =
       GST_DEBUG_FUNCPTR (gst_omx_video_enc_propose_allocation);
   video_encoder_class->getcaps = GST_DEBUG_FUNCPTR (gst_omx_video_enc_getcaps);
+  video_encoder_class->src_event =
+      GST_DEBUG_FUNCPTR (gst_omx_video_enc_src_event);
 
   klass->cdata.type = GST_OMX_COMPONENT_TYPE_FILTER;
   klass->cdata.default_sink_template_caps = "video/x-raw, "
@@ -203,9 +470,28 @@ gst_omx_video_enc_init (GstOMXVideoEnc * self)
   self->quant_i_frames = GST_OMX_VIDEO_ENC_QUANT_I_FRAMES_DEFAULT;
   self->quant_p_frames = GST_OMX_VIDEO_ENC_QUANT_P_FRAMES_DEFAULT;
   self->quant_b_frames = GST_OMX_VIDEO_ENC_QUANT_B_FRAMES_DEFAULT;
+  self->zero_copy_output = GST_OMX_VIDEO_ENC_ZERO_COPY_OUTPUT_DEFAULT;
+  self->slice_output = GST_OMX_VIDEO_ENC_SLICE_OUTPUT_DEFAULT;
+  self->intra_refresh_mode = GST_OMX_VIDEO_ENC_INTRA_REFRESH_MODE_DEFAULT;
+  self->intra_refresh_mbs = GST_OMX_VIDEO_ENC_INTRA_REFRESH_MBS_DEFAULT;
+  self->adaptive_bitrate = GST_OMX_VIDEO_ENC_ADAPTIVE_BITRATE_DEFAULT;
+  self->min_bitrate = GST_OMX_VIDEO_ENC_MIN_BITRATE_DEFAULT;
+  self->max_bitrate = GST_OMX_VIDEO_ENC_MAX_BITRATE_DEFAULT;
+  self->input_queue_size = GST_OMX_VIDEO_ENC_INPUT_QUEUE_SIZE_DEFAULT;
+  self->input_queue_policy = GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DEFAULT;
+  self->keyframe_schedule = GST_OMX_VIDEO_ENC_KEYFRAME_SCHEDULE_DEFAULT;
+  self->roi_qp_delta = GST_OMX_VIDEO_ENC_ROI_QP_DELTA_DEFAULT;
+  self->roi_bitrate_boost = GST_OMX_VIDEO_ENC_ROI_BITRATE_BOOST_DEFAULT;
+  self->stats_meta = GST_OMX_VIDEO_ENC_STATS_META_DEFAULT;
+  self->stats_interval = GST_OMX_VIDEO_ENC_STATS_INTERVAL_DEFAULT;
 
   g_mutex_init (&self->drain_lock);
   g_cond_init (&self->drain_cond);
+
+  g_mutex_init (&self->input_lock);
+  g_cond_init (&self->input_cond);
+  g_queue_init (&self->input_queue);
+  g_queue_init (&self->keyframe_targets);
 }
 
 static gboolean
@@ -260,6 +546,17 @@ gst_omx_video_enc_open (GstVideoEncoder * encoder)
   if (!self->enc_in_port || !self->enc_out_port)
     return FALSE;
 
+  self->roi_supported =
+      gst_omx_component_get_extension_index (self->enc,
+      GST_OMX_VIDEO_ENC_ROI_EXTENSION, &self->roi_index) == OMX_ErrorNone;
+  GST_DEBUG_OBJECT (self, "Regions of interest %ssupported",
+      self->roi_supported ? "" : "not ");
+
+  self->average_qp_supported =
+      gst_omx_component_get_extension_index (self->enc,
+      GST_OMX_VIDEO_ENC_AVERAGE_QP_EXTENSION,
+      &self->average_qp_index) == OMX_ErrorNone;
+
   /* Set properties */
   {
     OMX_ERRORTYPE err;
@@ -406,9 +703,39 @@ gst_omx_video_enc_finalize (GObject * object)
   g_mutex_clear (&self->drain_lock);
   g_cond_clear (&self->drain_cond);
 
+  g_mutex_clear (&self->input_lock);
+  g_cond_clear (&self->input_cond);
+
   G_OBJECT_CLASS (gst_omx_video_enc_parent_class)->finalize (object);
 }
 
+/* Applies @bitrate to the running component */
+static void
+gst_omx_video_enc_set_bitrate (GstOMXVideoEnc * self, guint32 bitrate)
+{
+  OMX_VIDEO_CONFIG_BITRATETYPE config;
+  OMX_ERRORTYPE err;
+
+  /* Keep raising the bitrate while frames have regions of interest */
+  GST_OBJECT_LOCK (self);
+  self->roi_base_bitrate = bitrate;
+  if (self->roi_boosted)
+    bitrate = MIN (((guint64) bitrate) * (100 + self->roi_bitrate_boost) / 100,
+        G_MAXUINT32);
+  GST_OBJECT_UNLOCK (self);
+
+  GST_OMX_INIT_STRUCT (&config);
+  config.nPortIndex = self->enc_out_port->index;
+  config.nEncodeBitrate = bitrate;
+  err =
+      gst_omx_component_set_config (self->enc,
+      OMX_IndexConfigVideoBitrate, &config);
+  if (err != OMX_ErrorNone)
+    GST_ERROR_OBJECT (self,
+        "Failed to set bitrate parameter: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+}
+
 static void
 gst_omx_video_enc_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
@@ -421,21 +748,8 @@ gst_omx_video_enc_set_property (GObject * object, guint prop_id,
       break;
     case PROP_TARGET_BITRATE:
       self->target_bitrate = g_value_get_uint (value);
-      if (self->enc) {
-        OMX_VIDEO_CONFIG_BITRATETYPE config;
-        OMX_ERRORTYPE err;
-
-        GST_OMX_INIT_STRUCT (&config);
-        config.nPortIndex = self->enc_out_port->index;
-        config.nEncodeBitrate = self->target_bitrate;
-        err =
-            gst_omx_component_set_config (self->enc,
-            OMX_IndexConfigVideoBitrate, &config);
-        if (err != OMX_ErrorNone)
-          GST_ERROR_OBJECT (self,
-              "Failed to set bitrate parameter: %s (0x%08x)",
-              gst_omx_error_to_string (err), err);
-      }
+      if (self->enc)
+        gst_omx_video_enc_set_bitrate (self, self->target_bitrate);
       break;
     case PROP_QUANT_I_FRAMES:
       self->quant_i_frames = g_value_get_uint (value);
@@ -446,6 +760,52 @@ gst_omx_video_enc_set_property (GObject * object, guint prop_id,
     case PROP_QUANT_B_FRAMES:
       self->quant_b_frames = g_value_get_uint (value);
       break;
+    case PROP_ZERO_COPY_OUTPUT:
+      self->zero_copy_output = g_value_get_boolean (value);
+      break;
+    case PROP_SLICE_OUTPUT:
+      self->slice_output = g_value_get_boolean (value);
+      break;
+    case PROP_INTRA_REFRESH_MODE:
+      self->intra_refresh_mode = g_value_get_enum (value);
+      break;
+    case PROP_INTRA_REFRESH_MBS:
+      self->intra_refresh_mbs = g_value_get_uint (value);
+      break;
+    case PROP_ADAPTIVE_BITRATE:
+      self->adaptive_bitrate = g_value_get_boolean (value);
+      break;
+    case PROP_MIN_BITRATE:
+      GST_OBJECT_LOCK (self);
+      self->min_bitrate = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_MAX_BITRATE:
+      GST_OBJECT_LOCK (self);
+      self->max_bitrate = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_INPUT_QUEUE_SIZE:
+      self->input_queue_size = g_value_get_uint (value);
+      break;
+    case PROP_INPUT_QUEUE_POLICY:
+      self->input_queue_policy = g_value_get_enum (value);
+      break;
+    case PROP_KEYFRAME_SCHEDULE:
+      self->keyframe_schedule = g_value_get_uint64 (value);
+      break;
+    case PROP_ROI_QP_DELTA:
+      self->roi_qp_delta = g_value_get_int (value);
+      break;
+    case PROP_ROI_BITRATE_BOOST:
+      self->roi_bitrate_boost = g_value_get_uint (value);
+      break;
+    case PROP_STATS_META:
+      self->stats_meta = g_value_get_boolean (value);
+      break;
+    case PROP_STATS_INTERVAL:
+      self->stats_interval = g_value_get_uint64 (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -474,6 +834,68 @@ gst_omx_video_enc_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_QUANT_B_FRAMES:
       g_value_set_uint (value, self->quant_b_frames);
       break;
+    case PROP_ZERO_COPY_OUTPUT:
+      g_value_set_boolean (value, self->zero_copy_output);
+      break;
+    case PROP_SLICE_OUTPUT:
+      g_value_set_boolean (value, self->slice_output);
+      break;
+    case PROP_INTRA_REFRESH_MODE:
+      g_value_set_enum (value, self->intra_refresh_mode);
+      break;
+    case PROP_INTRA_REFRESH_MBS:
+      g_value_set_uint (value, self->intra_refresh_mbs);
+      break;
+    case PROP_ADAPTIVE_BITRATE:
+      g_value_set_boolean (value, self->adaptive_bitrate);
+      break;
+    case PROP_MIN_BITRATE:
+      g_value_set_uint (value, self->min_bitrate);
+      break;
+    case PROP_MAX_BITRATE:
+      g_value_set_uint (value, self->max_bitrate);
+      break;
+    case PROP_INPUT_QUEUE_SIZE:
+      g_value_set_uint (value, self->input_queue_size);
+      break;
+    case PROP_INPUT_QUEUE_POLICY:
+      g_value_set_enum (value, self->input_queue_policy);
+      break;
+    case PROP_INPUT_QUEUE_DROPPED:
+      g_mutex_lock (&self->input_lock);
+      g_value_set_uint (value, self->input_dropped);
+      g_mutex_unlock (&self->input_lock);
+      break;
+    case PROP_KEYFRAME_SCHEDULE:
+      g_value_set_uint64 (value, self->keyframe_schedule);
+      break;
+    case PROP_ROI_QP_DELTA:
+      g_value_set_int (value, self->roi_qp_delta);
+      break;
+    case PROP_ROI_BITRATE_BOOST:
+      g_value_set_uint (value, self->roi_bitrate_boost);
+      break;
+    case PROP_STATS_META:
+      g_value_set_boolean (value, self->stats_meta);
+      break;
+    case PROP_STATS_INTERVAL:
+      g_value_set_uint64 (value, self->stats_interval);
+      break;
+    case PROP_KEYFRAMES_ON_TARGET:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->keyframes_on_target);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_KEYFRAMES_MISSED:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->keyframes_missed);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_KEYFRAMES_UNSCHEDULED:
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->keyframes_unscheduled);
+      GST_OBJECT_UNLOCK (self);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -511,6 +933,12 @@ gst_omx_video_enc_change_state (GstElement * element, GstStateChange transition)
       self->draining = FALSE;
       g_cond_broadcast (&self->drain_cond);
       g_mutex_unlock (&self->drain_lock);
+
+      /* Unblock handle_frame() waiting for space in the input queue */
+      g_mutex_lock (&self->input_lock);
+      self->input_stop = TRUE;
+      g_cond_broadcast (&self->input_cond);
+      g_mutex_unlock (&self->input_lock);
       break;
     default:
       break;
@@ -545,6 +973,252 @@ gst_omx_video_enc_change_state (GstElement * element, GstStateChange transition)
   return ret;
 }
 
+/* Reports the latency to the base class, which also posts
+ * a latency message to let the pipeline reconfigure */
+static void
+gst_omx_video_enc_report_latency (GstOMXVideoEnc * self)
+{
+  GstClockTime latency = self->latency.latency;
+
+  if (!GST_CLOCK_TIME_IS_VALID (latency))
+    return;
+
+  GST_INFO_OBJECT (self, "Reporting latency %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (latency));
+  gst_video_encoder_set_latency (GST_VIDEO_ENCODER (self), latency, latency);
+}
+
+/* Slices can only be pushed before their frame is finished if the base
+ * class already sent all events that have to precede them */
+static gboolean
+gst_omx_video_enc_can_push_slice (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame)
+{
+  GstEvent *segment;
+  GList *frames, *l;
+  gboolean ret = TRUE;
+
+  segment = gst_pad_get_sticky_event (GST_VIDEO_ENCODER_SRC_PAD (self),
+      GST_EVENT_SEGMENT, 0);
+  if (!segment)
+    return FALSE;
+  gst_event_unref (segment);
+
+  frames = gst_video_encoder_get_frames (GST_VIDEO_ENCODER (self));
+  for (l = frames; l; l = l->next) {
+    GstVideoCodecFrame *tmp = l->data;
+
+    if (tmp->events) {
+      ret = FALSE;
+      break;
+    }
+    if (tmp == frame)
+      break;
+  }
+  g_list_free_full (frames, (GDestroyNotify) gst_video_codec_frame_unref);
+
+  return ret;
+}
+
+/* Handles an output buffer that doesn't complete @frame. It's pushed
+ * downstream right away if possible, otherwise it's kept in the frame until
+ * the last slice arrives. Slices of keyframes are always kept, the base
+ * class might have to send stream headers before them. Takes ownership of
+ * @frame and @slice. */
+static GstFlowReturn
+gst_omx_video_enc_handle_slice (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame, GstBuffer * slice)
+{
+  GstFlowReturn flow_ret = GST_FLOW_OK;
+
+  /* Keep the order if previous slices of the frame were kept */
+  if (!frame->output_buffer && !GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame)
+      && gst_omx_video_enc_can_push_slice (self, frame)) {
+    GST_BUFFER_PTS (slice) = frame->pts;
+    GST_BUFFER_DTS (slice) =
+        GST_CLOCK_TIME_IS_VALID (frame->dts) ? frame->dts : frame->pts;
+    GST_BUFFER_DURATION (slice) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_FLAG_SET (slice, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    GST_LOG_OBJECT (self, "Pushing slice of %" G_GSIZE_FORMAT " bytes of "
+        "frame %u", gst_buffer_get_size (slice), frame->system_frame_number);
+    flow_ret = gst_pad_push (GST_VIDEO_ENCODER_SRC_PAD (self), slice);
+  } else if (frame->output_buffer) {
+    frame->output_buffer = gst_buffer_append (frame->output_buffer, slice);
+  } else {
+    frame->output_buffer = slice;
+  }
+
+  gst_video_codec_frame_unref (frame);
+
+  return flow_ret;
+}
+
+/* Updates the keyframe-schedule statistics with the complete
+ * output @frame. Called with the stream lock */
+static void
+gst_omx_video_enc_check_keyframe (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame)
+{
+  gboolean sync = GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame);
+  gboolean target = FALSE;
+  guint missed = 0;
+
+  if (self->keyframe_schedule == 0)
+    return;
+
+  /* Keyframes are never reordered after later frames, so targets
+   * before @frame didn't come out as separate keyframe anymore */
+  while (!g_queue_is_empty (&self->keyframe_targets)) {
+    guint number =
+        GPOINTER_TO_UINT (g_queue_peek_head (&self->keyframe_targets));
+
+    if (number > frame->system_frame_number)
+      break;
+
+    g_queue_pop_head (&self->keyframe_targets);
+    if (number == frame->system_frame_number)
+      target = TRUE;
+    else
+      missed++;
+  }
+  if (target && !sync)
+    missed++;
+
+  if (missed > 0)
+    GST_WARNING_OBJECT (self, "%u scheduled keyframes missed their target "
+        "frame", missed);
+  else if (target)
+    GST_DEBUG_OBJECT (self, "Scheduled keyframe %u on target",
+        frame->system_frame_number);
+  else if (sync)
+    GST_DEBUG_OBJECT (self, "Unscheduled keyframe %u",
+        frame->system_frame_number);
+
+  GST_OBJECT_LOCK (self);
+  self->keyframes_missed += missed;
+  if (target && sync)
+    self->keyframes_on_target++;
+  else if (sync)
+    self->keyframes_unscheduled++;
+  GST_OBJECT_UNLOCK (self);
+}
+
+/* Posts the omx-encoder-stats message for the frames since the last
+ * one and starts a new interval */
+static void
+gst_omx_video_enc_post_stats (GstOMXVideoEnc * self, GstClockTime duration)
+{
+  GstOMXVideoEncStats *stats = &self->stats;
+  GstStructure *s;
+
+  s = gst_structure_new ("omx-encoder-stats",
+      "duration", G_TYPE_UINT64, duration,
+      "frames", G_TYPE_UINT, stats->frames,
+      "i-frames", G_TYPE_UINT, stats->i_frames,
+      "p-frames", G_TYPE_UINT, stats->p_frames,
+      "b-frames", G_TYPE_UINT, stats->b_frames,
+      "keyframes", G_TYPE_UINT, stats->keyframes,
+      "bytes", G_TYPE_UINT64, stats->bytes,
+      "bitrate", G_TYPE_UINT64,
+      gst_util_uint64_scale (stats->bytes * 8, GST_SECOND, duration),
+      "average-latency", G_TYPE_UINT64, stats->latency_frames > 0 ?
+      stats->latency_sum / stats->latency_frames : GST_CLOCK_TIME_NONE,
+      "max-latency", G_TYPE_UINT64, stats->latency_frames > 0 ?
+      stats->latency_max : GST_CLOCK_TIME_NONE,
+      "average-qp", G_TYPE_DOUBLE, stats->qp_frames > 0 ?
+      ((gdouble) stats->qp_sum) / stats->qp_frames : -1.0, NULL);
+
+  GST_DEBUG_OBJECT (self, "Posting %" GST_PTR_FORMAT, s);
+  gst_element_post_message (GST_ELEMENT_CAST (self),
+      gst_message_new_element (GST_OBJECT_CAST (self), s));
+
+  memset (stats, 0, sizeof (GstOMXVideoEncStats));
+  stats->start = GST_CLOCK_TIME_NONE;
+}
+
+/* Collects the statistics of @frame, which is completed by @buf and
+ * its output buffer. Called with the stream lock */
+static void
+gst_omx_video_enc_update_stats (GstOMXVideoEnc * self, GstOMXBuffer * buf,
+    GstVideoCodecFrame * frame)
+{
+  GstOMXVideoEncClass *klass = GST_OMX_VIDEO_ENC_GET_CLASS (self);
+  GstOMXVideoEncStats *stats = &self->stats;
+  GstOMXVideoEncFrameType frame_type = GST_OMX_VIDEO_ENC_FRAME_TYPE_UNKNOWN;
+  GstClockTime latency;
+  gboolean keyframe = GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame);
+  gint qp = -1;
+  gsize size;
+
+  size = self->stats_frame_bytes;
+  self->stats_frame_bytes = 0;
+
+  if (klass->get_frame_type)
+    frame_type = klass->get_frame_type (self, buf);
+  if (frame_type == GST_OMX_VIDEO_ENC_FRAME_TYPE_UNKNOWN && keyframe)
+    frame_type = GST_OMX_VIDEO_ENC_FRAME_TYPE_I;
+
+  latency = gst_omx_video_latency_get_measured (frame);
+
+  if (self->average_qp_supported) {
+    GstOMXVideoEncAverageQp config;
+
+    GST_OMX_INIT_STRUCT (&config);
+    config.nPortIndex = self->enc_out_port->index;
+    if (gst_omx_component_get_config (self->enc, self->average_qp_index,
+            &config) == OMX_ErrorNone)
+      qp = config.nQp;
+  }
+
+  if (self->stats_meta) {
+    GstOMXVideoEncStatsMeta *meta;
+
+    meta = gst_buffer_add_omx_video_enc_stats_meta (frame->output_buffer);
+    meta->size = size;
+    meta->frame_type = frame_type;
+    meta->keyframe = keyframe;
+    meta->latency = latency;
+    meta->average_qp = qp;
+  }
+
+  GST_LOG_OBJECT (self, "Frame %u: %" G_GSIZE_FORMAT " bytes, type %s, "
+      "latency %" GST_TIME_FORMAT ", QP %d", frame->system_frame_number, size,
+      gst_omx_video_enc_frame_type_to_string (frame_type),
+      GST_TIME_ARGS (latency), qp);
+
+  if (self->stats_interval == 0 || !GST_CLOCK_TIME_IS_VALID (frame->pts))
+    return;
+
+  if (!GST_CLOCK_TIME_IS_VALID (stats->start))
+    stats->start = frame->pts;
+
+  stats->frames++;
+  if (frame_type == GST_OMX_VIDEO_ENC_FRAME_TYPE_I)
+    stats->i_frames++;
+  else if (frame_type == GST_OMX_VIDEO_ENC_FRAME_TYPE_P)
+    stats->p_frames++;
+  else if (frame_type == GST_OMX_VIDEO_ENC_FRAME_TYPE_B)
+    stats->b_frames++;
+  if (keyframe)
+    stats->keyframes++;
+  stats->bytes += size;
+  if (GST_CLOCK_TIME_IS_VALID (latency)) {
+    stats->latency_sum += latency;
+    stats->latency_max = MAX (stats->latency_max, latency);
+    stats->latency_frames++;
+  }
+  if (qp >= 0) {
+    stats->qp_sum += qp;
+    stats->qp_frames++;
+  }
+
+  /* B-frames come out after later frames, only count forward */
+  if (frame->pts > stats->start
+      && frame->pts - stats->start >= self->stats_interval)
+    gst_omx_video_enc_post_stats (self, frame->pts - stats->start);
+}
+
 static GstFlowReturn
 gst_omx_video_enc_handle_output_frame (GstOMXVideoEnc * self, GstOMXPort * port,
     GstOMXBuffer * buf, GstVideoCodecFrame * frame)
@@ -581,21 +1255,12 @@ gst_omx_video_enc_handle_output_frame (GstOMXVideoEnc * self, GstOMXPort * port,
     flow_ret = GST_FLOW_OK;
   } else if (buf->omx_buf->nFilledLen > 0) {
     GstBuffer *outbuf;
-    GstMapInfo map = GST_MAP_INFO_INIT;
 
     GST_DEBUG_OBJECT (self, "Handling output data");
 
-    if (buf->omx_buf->nFilledLen > 0) {
-      outbuf = gst_buffer_new_and_alloc (buf->omx_buf->nFilledLen);
-
-      gst_buffer_map (outbuf, &map, GST_MAP_WRITE);
-      memcpy (map.data,
-          buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
-          buf->omx_buf->nFilledLen);
-      gst_buffer_unmap (outbuf, &map);
-    } else {
-      outbuf = gst_buffer_new ();
-    }
+    /* If the data is wrapped, buf belongs to outbuf now */
+    outbuf = gst_omx_port_wrap_or_copy_buffer (port, buf,
+        &self->out_buf_wrapped);
 
     GST_BUFFER_TIMESTAMP (outbuf) =
         gst_util_uint64_scale (GST_OMX_GET_TICKS (buf->omx_buf->nTimeStamp),
@@ -618,8 +1283,23 @@ gst_omx_video_enc_handle_output_frame (GstOMXVideoEnc * self, GstOMXPort * port,
         GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DELTA_UNIT);
     }
 
+    self->stats_frame_bytes += buf->omx_buf->nFilledLen;
+
+    if (frame && self->slice_output
+        && !(buf->omx_buf->nFlags & OMX_BUFFERFLAG_ENDOFFRAME))
+      return gst_omx_video_enc_handle_slice (self, frame, outbuf);
+
     if (frame) {
+      if (!(klass->cdata.hacks & GST_OMX_HACK_SYNCFRAME_FLAG_NOT_USED))
+        gst_omx_video_enc_check_keyframe (self, frame);
+
+      /* Slices that couldn't be pushed on their own */
+      if (frame->output_buffer)
+        outbuf = gst_buffer_append (frame->output_buffer, outbuf);
       frame->output_buffer = outbuf;
+
+      if (self->stats_meta || self->stats_interval > 0)
+        gst_omx_video_enc_update_stats (self, buf, frame);
       flow_ret =
           gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (self), frame);
     } else {
@@ -709,6 +1389,9 @@ gst_omx_video_enc_loop (GstOMXVideoEnc * self)
     GST_VIDEO_ENCODER_STREAM_UNLOCK (self);
 
     if (acq_return == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
+      gst_omx_port_set_wrap_buffers (self->enc_out_port,
+          self->zero_copy_output);
+
       err = gst_omx_port_set_enabled (port, TRUE);
       if (err != OMX_ErrorNone)
         goto reconfigure_error;
@@ -756,14 +1439,22 @@ gst_omx_video_enc_loop (GstOMXVideoEnc * self)
   frame = gst_omx_video_find_nearest_frame (buf,
       gst_video_encoder_get_frames (GST_VIDEO_ENCODER (self)));
 
+  if (frame && gst_omx_video_latency_update (&self->latency, frame,
+          self->input_state))
+    gst_omx_video_enc_report_latency (self);
+
   g_assert (klass->handle_output_frame);
+  self->out_buf_wrapped = FALSE;
   flow_ret = klass->handle_output_frame (self, self->enc_out_port, buf, frame);
 
   GST_DEBUG_OBJECT (self, "Finished frame: %s", gst_flow_get_name (flow_ret));
 
-  err = gst_omx_port_release_buffer (port, buf);
-  if (err != OMX_ErrorNone)
-    goto release_error;
+  /* Otherwise it's released once downstream doesn't need it anymore */
+  if (!self->out_buf_wrapped) {
+    err = gst_omx_port_release_buffer (port, buf);
+    if (err != OMX_ErrorNone)
+      goto release_error;
+  }
 
   self->downstream_flow_ret = flow_ret;
 
@@ -893,42 +1584,185 @@ release_error:
   }
 }
 
-static gboolean
-gst_omx_video_enc_start (GstVideoEncoder * encoder)
+static gpointer
+gst_omx_video_enc_input_thread (GstOMXVideoEnc * self)
 {
-  GstOMXVideoEnc *self;
-
-  self = GST_OMX_VIDEO_ENC (encoder);
+  GST_DEBUG_OBJECT (self, "Starting input thread");
 
-  self->last_upstream_ts = 0;
-  self->downstream_flow_ret = GST_FLOW_OK;
+  g_mutex_lock (&self->input_lock);
+  while (!self->input_stop) {
+    GstVideoCodecFrame *frame;
+    GstFlowReturn ret = GST_FLOW_OK;
+    gboolean failed;
 
-  return TRUE;
-}
+    if (g_queue_is_empty (&self->input_queue)) {
+      g_cond_wait (&self->input_cond, &self->input_lock);
+      continue;
+    }
+    g_mutex_unlock (&self->input_lock);
 
-static gboolean
-gst_omx_video_enc_stop (GstVideoEncoder * encoder)
-{
-  GstOMXVideoEnc *self;
+    /* Dequeue with the stream lock so that flush() can't discard
+     * the queue while we're about to pass one of its frames */
+    GST_VIDEO_ENCODER_STREAM_LOCK (self);
+    g_mutex_lock (&self->input_lock);
+    if (self->input_stop || g_queue_is_empty (&self->input_queue)) {
+      g_mutex_unlock (&self->input_lock);
+      GST_VIDEO_ENCODER_STREAM_UNLOCK (self);
+      g_mutex_lock (&self->input_lock);
+      continue;
+    }
+    frame = g_queue_pop_head (&self->input_queue);
+    failed = self->input_flow_ret != GST_FLOW_OK;
+    self->input_busy = TRUE;
+    g_cond_broadcast (&self->input_cond);
+    g_mutex_unlock (&self->input_lock);
 
-  self = GST_OMX_VIDEO_ENC (encoder);
+    if (failed)
+      gst_video_codec_frame_unref (frame);
+    else
+      ret = gst_omx_video_enc_submit_frame (self, frame);
 
-  GST_DEBUG_OBJECT (self, "Stopping encoder");
+    g_mutex_lock (&self->input_lock);
+    if (ret != GST_FLOW_OK && ret != GST_FLOW_FLUSHING) {
+      GST_DEBUG_OBJECT (self, "Failed to pass frame to the component: %s",
+          gst_flow_get_name (ret));
+      self->input_flow_ret = ret;
+    }
+    self->input_busy = FALSE;
+    g_cond_broadcast (&self->input_cond);
+    g_mutex_unlock (&self->input_lock);
+    GST_VIDEO_ENCODER_STREAM_UNLOCK (self);
 
-  gst_omx_port_set_flushing (self->enc_in_port, 5 * GST_SECOND, TRUE);
-  gst_omx_port_set_flushing (self->enc_out_port, 5 * GST_SECOND, TRUE);
+    g_mutex_lock (&self->input_lock);
+  }
+  g_mutex_unlock (&self->input_lock);
 
-  gst_pad_stop_task (GST_VIDEO_ENCODER_SRC_PAD (encoder));
+  GST_DEBUG_OBJECT (self, "Stopped input thread");
 
-  if (gst_omx_component_get_state (self->enc, 0) > OMX_StateIdle)
-    gst_omx_component_set_state (self->enc, OMX_StateIdle);
+  return NULL;
+}
 
-  self->downstream_flow_ret = GST_FLOW_FLUSHING;
-  self->started = FALSE;
+/* Discards all frames that were not passed to the component yet */
+static void
+gst_omx_video_enc_clear_input_queue (GstOMXVideoEnc * self)
+{
+  GstVideoCodecFrame *frame;
 
-  if (self->input_state)
-    gst_video_codec_state_unref (self->input_state);
-  self->input_state = NULL;
+  g_mutex_lock (&self->input_lock);
+  while ((frame = g_queue_pop_head (&self->input_queue)))
+    gst_video_codec_frame_unref (frame);
+  g_cond_broadcast (&self->input_cond);
+  g_mutex_unlock (&self->input_lock);
+}
+
+/* Waits until the input thread has passed all queued frames to the
+ * component. Must be called without the stream lock */
+static void
+gst_omx_video_enc_wait_input_queue (GstOMXVideoEnc * self)
+{
+  if (!self->input_thread)
+    return;
+
+  g_mutex_lock (&self->input_lock);
+  while (!self->input_stop && (self->input_busy
+          || !g_queue_is_empty (&self->input_queue)))
+    g_cond_wait (&self->input_cond, &self->input_lock);
+  g_mutex_unlock (&self->input_lock);
+}
+
+static void
+gst_omx_video_enc_stop_input_thread (GstOMXVideoEnc * self)
+{
+  if (!self->input_thread)
+    return;
+
+  g_mutex_lock (&self->input_lock);
+  self->input_stop = TRUE;
+  g_cond_broadcast (&self->input_cond);
+  g_mutex_unlock (&self->input_lock);
+
+  g_thread_join (self->input_thread);
+  self->input_thread = NULL;
+
+  gst_omx_video_enc_clear_input_queue (self);
+}
+
+static gboolean
+gst_omx_video_enc_start (GstVideoEncoder * encoder)
+{
+  GstOMXVideoEnc *self;
+
+  self = GST_OMX_VIDEO_ENC (encoder);
+
+  self->last_upstream_ts = 0;
+  self->downstream_flow_ret = GST_FLOW_OK;
+  self->keyframe_next = GST_CLOCK_TIME_NONE;
+  g_queue_clear (&self->keyframe_targets);
+  memset (&self->stats, 0, sizeof (GstOMXVideoEncStats));
+  self->stats.start = GST_CLOCK_TIME_NONE;
+  self->stats_frame_bytes = 0;
+
+  GST_OBJECT_LOCK (self);
+  self->roi_boosted = FALSE;
+  self->roi_base_bitrate = 0;
+  self->keyframes_on_target = 0;
+  self->keyframes_missed = 0;
+  self->keyframes_unscheduled = 0;
+  self->abr_bitrate = 0;
+  self->abr_applied_bitrate = 0;
+  self->abr_bitrate_pending = FALSE;
+  self->abr_skip_ratio = 0.0;
+  self->abr_skip_credit = 0.0;
+  GST_OBJECT_UNLOCK (self);
+
+  self->input_stop = FALSE;
+  self->input_busy = FALSE;
+  self->input_flow_ret = GST_FLOW_OK;
+  self->input_dropped = 0;
+  if (self->input_queue_size > 0) {
+    gchar *name;
+
+    name = g_strdup_printf ("%s:input", GST_OBJECT_NAME (self));
+    self->input_thread =
+        g_thread_new (name, (GThreadFunc) gst_omx_video_enc_input_thread,
+        self);
+    g_free (name);
+  }
+
+  gst_omx_video_latency_reset (&self->latency,
+      GST_OMX_VIDEO_ENC_GET_CLASS (self)->cdata.latency);
+  gst_omx_video_enc_report_latency (self);
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_video_enc_stop (GstVideoEncoder * encoder)
+{
+  GstOMXVideoEnc *self;
+
+  self = GST_OMX_VIDEO_ENC (encoder);
+
+  GST_DEBUG_OBJECT (self, "Stopping encoder");
+
+  gst_omx_port_set_flushing (self->enc_in_port, 5 * GST_SECOND, TRUE);
+  gst_omx_port_set_flushing (self->enc_out_port, 5 * GST_SECOND, TRUE);
+
+  gst_pad_stop_task (GST_VIDEO_ENCODER_SRC_PAD (encoder));
+
+  gst_omx_video_enc_stop_input_thread (self);
+
+  if (gst_omx_component_get_state (self->enc, 0) > OMX_StateIdle)
+    gst_omx_component_set_state (self->enc, OMX_StateIdle);
+
+  self->downstream_flow_ret = GST_FLOW_FLUSHING;
+  self->started = FALSE;
+
+  if (self->input_state)
+    gst_video_codec_state_unref (self->input_state);
+  self->input_state = NULL;
+
+  g_queue_clear (&self->keyframe_targets);
 
   g_mutex_lock (&self->drain_lock);
   self->draining = FALSE;
@@ -940,6 +1774,480 @@ gst_omx_video_enc_stop (GstVideoEncoder * encoder)
   return TRUE;
 }
 
+/* Packed formats the component can't take as input, they are converted
+ * into its planar 4:2:0 layout while filling the input buffers so that no
+ * separate conversion upstream is needed */
+static gboolean
+gst_omx_video_enc_is_converted_format (GstVideoFormat format)
+{
+  return format == GST_VIDEO_FORMAT_YUY2 || format == GST_VIDEO_FORMAT_UYVY
+      || format == GST_VIDEO_FORMAT_BGRx;
+}
+
+/* Add the converted formats to @negotiation_map, mapped to the component's
+ * NV12 or I420 color format */
+static GList *
+gst_omx_video_enc_add_converted_formats (GList * negotiation_map)
+{
+  static const GstVideoFormat formats[] = {
+    GST_VIDEO_FORMAT_YUY2, GST_VIDEO_FORMAT_UYVY, GST_VIDEO_FORMAT_BGRx
+  };
+  GstOMXVideoNegotiationMap *target = NULL, *m;
+  GList *l;
+  guint i;
+
+  for (l = negotiation_map; l; l = l->next) {
+    m = l->data;
+
+    /* Interleaved chroma is a bit cheaper to write */
+    if (m->format == GST_VIDEO_FORMAT_NV12) {
+      target = m;
+      break;
+    } else if (m->format == GST_VIDEO_FORMAT_I420 && !target) {
+      target = m;
+    }
+  }
+
+  if (!target)
+    return negotiation_map;
+
+  for (i = 0; i < G_N_ELEMENTS (formats); i++) {
+    m = g_slice_new (GstOMXVideoNegotiationMap);
+    m->format = formats[i];
+    m->type = target->type;
+    negotiation_map = g_list_append (negotiation_map, m);
+  }
+
+  return negotiation_map;
+}
+
+/* BT.601 limited range */
+#define RGB_TO_Y(r,g,b) ((( 66 * (r) + 129 * (g) +  25 * (b) + 128) >> 8) + 16)
+#define RGB_TO_U(r,g,b) (((-38 * (r) -  74 * (g) + 112 * (b) + 128) >> 8) + 128)
+#define RGB_TO_V(r,g,b) (((112 * (r) -  94 * (g) -  18 * (b) + 128) >> 8) + 128)
+
+/* Vectorized row converters. They convert as many pixels as fit into full
+ * vectors, compute the same values as the macros above and return the
+ * number of converted pixels. The rest of the row is converted by the
+ * scalar code. */
+#if defined (__ARM_NEON__) || defined (__ARM_NEON)
+#define USE_NEON_CONVERT 1
+#elif defined (__SSE2__)
+#define USE_SSE2_CONVERT 1
+#endif
+
+#ifdef USE_NEON_CONVERT
+static inline gint
+convert_packed_422_neon (const guint8 * s0, const guint8 * s1, guint8 * y0,
+    guint8 * y1, guint8 * u, guint8 * v, gint uv_step, gint width,
+    gint y_off)
+{
+  gint i;
+
+  for (i = 0; i + 32 <= width; i += 32) {
+    uint8x16x4_t p0 = vld4q_u8 (s0 + 2 * i);
+    uint8x16x4_t p1 = vld4q_u8 (s1 + 2 * i);
+    uint8x16x2_t l0, l1, uv;
+
+    l0.val[0] = p0.val[y_off];
+    l0.val[1] = p0.val[y_off + 2];
+    l1.val[0] = p1.val[y_off];
+    l1.val[1] = p1.val[y_off + 2];
+    vst2q_u8 (y0 + i, l0);
+    vst2q_u8 (y1 + i, l1);
+
+    uv.val[0] = vrhaddq_u8 (p0.val[1 - y_off], p1.val[1 - y_off]);
+    uv.val[1] = vrhaddq_u8 (p0.val[3 - y_off], p1.val[3 - y_off]);
+    if (uv_step == 2) {
+      vst2q_u8 (u + i, uv);
+    } else {
+      vst1q_u8 (u + i / 2, uv.val[0]);
+      vst1q_u8 (v + i / 2, uv.val[1]);
+    }
+  }
+
+  return i;
+}
+
+static inline uint8x16_t
+bgrx_to_y_neon (const uint8x16x4_t * p)
+{
+  uint16x8_t lo, hi;
+
+  lo = vmull_u8 (vget_low_u8 (p->val[2]), vdup_n_u8 (66));
+  lo = vmlal_u8 (lo, vget_low_u8 (p->val[1]), vdup_n_u8 (129));
+  lo = vmlal_u8 (lo, vget_low_u8 (p->val[0]), vdup_n_u8 (25));
+  hi = vmull_u8 (vget_high_u8 (p->val[2]), vdup_n_u8 (66));
+  hi = vmlal_u8 (hi, vget_high_u8 (p->val[1]), vdup_n_u8 (129));
+  hi = vmlal_u8 (hi, vget_high_u8 (p->val[0]), vdup_n_u8 (25));
+
+  return vaddq_u8 (vcombine_u8 (vrshrn_n_u16 (lo, 8), vrshrn_n_u16 (hi, 8)),
+      vdupq_n_u8 (16));
+}
+
+/* Average of the 2x2 blocks of one component */
+static inline int16x8_t
+average_2x2_neon (uint8x16_t a, uint8x16_t b)
+{
+  return vreinterpretq_s16_u16 (vrshrq_n_u16 (vaddq_u16 (vpaddlq_u8 (a),
+              vpaddlq_u8 (b)), 2));
+}
+
+static inline uint8x8_t
+rgb_to_chroma_neon (int16x8_t r, int16x8_t g, int16x8_t b, gint16 cr,
+    gint16 cg, gint16 cb)
+{
+  int16x8_t c = vdupq_n_s16 (128);
+
+  c = vmlaq_n_s16 (c, r, cr);
+  c = vmlaq_n_s16 (c, g, cg);
+  c = vmlaq_n_s16 (c, b, cb);
+
+  return vmovn_u16 (vreinterpretq_u16_s16 (vaddq_s16 (vshrq_n_s16 (c, 8),
+              vdupq_n_s16 (128))));
+}
+
+static inline gint
+convert_bgrx_neon (const guint8 * s0, const guint8 * s1, guint8 * y0,
+    guint8 * y1, guint8 * u, guint8 * v, gint uv_step, gint width)
+{
+  gint i;
+
+  for (i = 0; i + 16 <= width; i += 16) {
+    uint8x16x4_t p0 = vld4q_u8 (s0 + 4 * i);
+    uint8x16x4_t p1 = vld4q_u8 (s1 + 4 * i);
+    int16x8_t r, g, b;
+    uint8x8x2_t uv;
+
+    vst1q_u8 (y0 + i, bgrx_to_y_neon (&p0));
+    vst1q_u8 (y1 + i, bgrx_to_y_neon (&p1));
+
+    r = average_2x2_neon (p0.val[2], p1.val[2]);
+    g = average_2x2_neon (p0.val[1], p1.val[1]);
+    b = average_2x2_neon (p0.val[0], p1.val[0]);
+    uv.val[0] = rgb_to_chroma_neon (r, g, b, -38, -74, 112);
+    uv.val[1] = rgb_to_chroma_neon (r, g, b, 112, -94, -18);
+    if (uv_step == 2) {
+      vst2_u8 (u + i, uv);
+    } else {
+      vst1_u8 (u + i / 2, uv.val[0]);
+      vst1_u8 (v + i / 2, uv.val[1]);
+    }
+  }
+
+  return i;
+}
+#define convert_packed_422_simd convert_packed_422_neon
+#define convert_bgrx_simd convert_bgrx_neon
+#elif defined (USE_SSE2_CONVERT)
+static inline gint
+convert_packed_422_sse2 (const guint8 * s0, const guint8 * s1, guint8 * y0,
+    guint8 * y1, guint8 * u, guint8 * v, gint uv_step, gint width,
+    gint y_off)
+{
+  const __m128i mask = _mm_set1_epi16 (0xff);
+  const __m128i zero = _mm_setzero_si128 ();
+  gint i;
+
+  for (i = 0; i + 16 <= width; i += 16) {
+    __m128i a0 = _mm_loadu_si128 ((const __m128i *) (s0 + 2 * i));
+    __m128i a1 = _mm_loadu_si128 ((const __m128i *) (s0 + 2 * i + 16));
+    __m128i b0 = _mm_loadu_si128 ((const __m128i *) (s1 + 2 * i));
+    __m128i b1 = _mm_loadu_si128 ((const __m128i *) (s1 + 2 * i + 16));
+    __m128i ya0, ya1, yb0, yb1, ca, cb, c;
+
+    /* Luma and chroma are the even or the odd bytes */
+    if (y_off == 0) {
+      ya0 = _mm_and_si128 (a0, mask);
+      ya1 = _mm_and_si128 (a1, mask);
+      yb0 = _mm_and_si128 (b0, mask);
+      yb1 = _mm_and_si128 (b1, mask);
+      ca = _mm_packus_epi16 (_mm_srli_epi16 (a0, 8), _mm_srli_epi16 (a1, 8));
+      cb = _mm_packus_epi16 (_mm_srli_epi16 (b0, 8), _mm_srli_epi16 (b1, 8));
+    } else {
+      ya0 = _mm_srli_epi16 (a0, 8);
+      ya1 = _mm_srli_epi16 (a1, 8);
+      yb0 = _mm_srli_epi16 (b0, 8);
+      yb1 = _mm_srli_epi16 (b1, 8);
+      ca = _mm_packus_epi16 (_mm_and_si128 (a0, mask),
+          _mm_and_si128 (a1, mask));
+      cb = _mm_packus_epi16 (_mm_and_si128 (b0, mask),
+          _mm_and_si128 (b1, mask));
+    }
+    _mm_storeu_si128 ((__m128i *) (y0 + i), _mm_packus_epi16 (ya0, ya1));
+    _mm_storeu_si128 ((__m128i *) (y1 + i), _mm_packus_epi16 (yb0, yb1));
+
+    /* Interleaved UV of both rows, rounded up like the scalar code */
+    c = _mm_avg_epu8 (ca, cb);
+    if (uv_step == 2) {
+      _mm_storeu_si128 ((__m128i *) (u + i), c);
+    } else {
+      _mm_storel_epi64 ((__m128i *) (u + i / 2),
+          _mm_packus_epi16 (_mm_and_si128 (c, mask), zero));
+      _mm_storel_epi64 ((__m128i *) (v + i / 2),
+          _mm_packus_epi16 (_mm_srli_epi16 (c, 8), zero));
+    }
+  }
+
+  return i;
+}
+
+/* Splits 8 BGRx pixels into 16 bit components */
+static inline void
+bgrx_unpack_sse2 (const guint8 * s, __m128i * r, __m128i * g, __m128i * b)
+{
+  const __m128i mask = _mm_set1_epi32 (0xff);
+  __m128i p0 = _mm_loadu_si128 ((const __m128i *) s);
+  __m128i p1 = _mm_loadu_si128 ((const __m128i *) (s + 16));
+
+  *b = _mm_packs_epi32 (_mm_and_si128 (p0, mask), _mm_and_si128 (p1, mask));
+  *g = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (p0, 8), mask),
+      _mm_and_si128 (_mm_srli_epi32 (p1, 8), mask));
+  *r = _mm_packs_epi32 (_mm_and_si128 (_mm_srli_epi32 (p0, 16), mask),
+      _mm_and_si128 (_mm_srli_epi32 (p1, 16), mask));
+}
+
+/* The sum fits into 16 bits unsigned, the additions wrap around */
+static inline __m128i
+rgb_to_y_sse2 (__m128i r, __m128i g, __m128i b)
+{
+  __m128i y;
+
+  y = _mm_add_epi16 (_mm_mullo_epi16 (r, _mm_set1_epi16 (66)),
+      _mm_mullo_epi16 (g, _mm_set1_epi16 (129)));
+  y = _mm_add_epi16 (y, _mm_mullo_epi16 (b, _mm_set1_epi16 (25)));
+  y = _mm_srli_epi16 (_mm_add_epi16 (y, _mm_set1_epi16 (128)), 8);
+
+  return _mm_add_epi16 (y, _mm_set1_epi16 (16));
+}
+
+/* Sums of horizontally neighbouring pixels of @a and @b, in the 16 low
+ * bits of every 32 bit lane */
+static inline __m128i
+sum_2x2_sse2 (__m128i a, __m128i b)
+{
+  __m128i s = _mm_add_epi16 (a, b);
+
+  return _mm_and_si128 (_mm_add_epi16 (s, _mm_srli_epi32 (s, 16)),
+      _mm_set1_epi32 (0xffff));
+}
+
+static inline __m128i
+rgb_to_chroma_sse2 (__m128i r, __m128i g, __m128i b, gint16 cr, gint16 cg,
+    gint16 cb)
+{
+  __m128i c;
+
+  c = _mm_add_epi16 (_mm_mullo_epi16 (r, _mm_set1_epi16 (cr)),
+      _mm_mullo_epi16 (g, _mm_set1_epi16 (cg)));
+  c = _mm_add_epi16 (c, _mm_mullo_epi16 (b, _mm_set1_epi16 (cb)));
+  c = _mm_srai_epi16 (_mm_add_epi16 (c, _mm_set1_epi16 (128)), 8);
+
+  return _mm_add_epi16 (c, _mm_set1_epi16 (128));
+}
+
+static inline gint
+convert_bgrx_sse2 (const guint8 * s0, const guint8 * s1, guint8 * y0,
+    guint8 * y1, guint8 * u, guint8 * v, gint uv_step, gint width)
+{
+  const __m128i two = _mm_set1_epi16 (2);
+  gint i;
+
+  for (i = 0; i + 16 <= width; i += 16) {
+    __m128i r[4], g[4], b[4], ya, yb, cr, cg, cb, cu, cv;
+
+    /* Pixels 0-7 and 8-15 of both rows */
+    bgrx_unpack_sse2 (s0 + 4 * i, &r[0], &g[0], &b[0]);
+    bgrx_unpack_sse2 (s0 + 4 * i + 32, &r[1], &g[1], &b[1]);
+    bgrx_unpack_sse2 (s1 + 4 * i, &r[2], &g[2], &b[2]);
+    bgrx_unpack_sse2 (s1 + 4 * i + 32, &r[3], &g[3], &b[3]);
+
+    ya = _mm_packus_epi16 (rgb_to_y_sse2 (r[0], g[0], b[0]),
+        rgb_to_y_sse2 (r[1], g[1], b[1]));
+    yb = _mm_packus_epi16 (rgb_to_y_sse2 (r[2], g[2], b[2]),
+        rgb_to_y_sse2 (r[3], g[3], b[3]));
+    _mm_storeu_si128 ((__m128i *) (y0 + i), ya);
+    _mm_storeu_si128 ((__m128i *) (y1 + i), yb);
+
+    cr = _mm_packs_epi32 (sum_2x2_sse2 (r[0], r[2]), sum_2x2_sse2 (r[1], r[3]));
+    cg = _mm_packs_epi32 (sum_2x2_sse2 (g[0], g[2]), sum_2x2_sse2 (g[1], g[3]));
+    cb = _mm_packs_epi32 (sum_2x2_sse2 (b[0], b[2]), sum_2x2_sse2 (b[1], b[3]));
+    cr = _mm_srli_epi16 (_mm_add_epi16 (cr, two), 2);
+    cg = _mm_srli_epi16 (_mm_add_epi16 (cg, two), 2);
+    cb = _mm_srli_epi16 (_mm_add_epi16 (cb, two), 2);
+
+    cu = rgb_to_chroma_sse2 (cr, cg, cb, -38, -74, 112);
+    cv = rgb_to_chroma_sse2 (cr, cg, cb, 112, -94, -18);
+    if (uv_step == 2) {
+      _mm_storeu_si128 ((__m128i *) (u + i),
+          _mm_or_si128 (cu, _mm_slli_epi16 (cv, 8)));
+    } else {
+      _mm_storel_epi64 ((__m128i *) (u + i / 2),
+          _mm_packus_epi16 (cu, cu));
+      _mm_storel_epi64 ((__m128i *) (v + i / 2),
+          _mm_packus_epi16 (cv, cv));
+    }
+  }
+
+  return i;
+}
+#define convert_packed_422_simd convert_packed_422_sse2
+#define convert_bgrx_simd convert_bgrx_sse2
+#else
+#define convert_packed_422_simd(s0, s1, y0, y1, u, v, uv_step, width, y_off) 0
+#define convert_bgrx_simd(s0, s1, y0, y1, u, v, uv_step, width) 0
+#endif
+
+/* Converts two rows of YUY2 (y_off 0) or UYVY (y_off 1) to two luma rows
+ * and one chroma row */
+static void
+gst_omx_video_enc_convert_packed_422 (const guint8 * s0, const guint8 * s1,
+    guint8 * y0, guint8 * y1, guint8 * u, guint8 * v, gint uv_step,
+    gint width, gint y_off)
+{
+  gint u_off = 1 - y_off;
+  gint i, n = width / 2;
+
+  i = convert_packed_422_simd (s0, s1, y0, y1, u, v, uv_step, width,
+      y_off) / 2;
+  for (; i < n; i++) {
+    y0[2 * i] = s0[4 * i + y_off];
+    y0[2 * i + 1] = s0[4 * i + y_off + 2];
+    y1[2 * i] = s1[4 * i + y_off];
+    y1[2 * i + 1] = s1[4 * i + y_off + 2];
+    u[i * uv_step] = (s0[4 * i + u_off] + s1[4 * i + u_off] + 1) >> 1;
+    v[i * uv_step] = (s0[4 * i + u_off + 2] + s1[4 * i + u_off + 2] + 1) >> 1;
+  }
+
+  if (width & 1) {
+    y0[2 * n] = s0[4 * n + y_off];
+    y1[2 * n] = s1[4 * n + y_off];
+    u[n * uv_step] = (s0[4 * n + u_off] + s1[4 * n + u_off] + 1) >> 1;
+    v[n * uv_step] = (s0[4 * n + u_off + 2] + s1[4 * n + u_off + 2] + 1) >> 1;
+  }
+}
+
+/* Same for BGRx, chroma is computed from the average of each 2x2 block */
+static void
+gst_omx_video_enc_convert_bgrx (const guint8 * s0, const guint8 * s1,
+    guint8 * y0, guint8 * y1, guint8 * u, guint8 * v, gint uv_step,
+    gint width)
+{
+  gint i, done, n = width / 2;
+
+  done = convert_bgrx_simd (s0, s1, y0, y1, u, v, uv_step, width);
+
+  for (i = done; i < width; i++) {
+    y0[i] = RGB_TO_Y (s0[4 * i + 2], s0[4 * i + 1], s0[4 * i]);
+    y1[i] = RGB_TO_Y (s1[4 * i + 2], s1[4 * i + 1], s1[4 * i]);
+  }
+
+  for (i = done / 2; i < n; i++) {
+    gint r, g, b;
+
+    r = (s0[8 * i + 2] + s0[8 * i + 6] + s1[8 * i + 2] + s1[8 * i + 6] + 2)
+        >> 2;
+    g = (s0[8 * i + 1] + s0[8 * i + 5] + s1[8 * i + 1] + s1[8 * i + 5] + 2)
+        >> 2;
+    b = (s0[8 * i] + s0[8 * i + 4] + s1[8 * i] + s1[8 * i + 4] + 2) >> 2;
+    u[i * uv_step] = RGB_TO_U (r, g, b);
+    v[i * uv_step] = RGB_TO_V (r, g, b);
+  }
+
+  if (width & 1) {
+    gint r, g, b;
+
+    r = (s0[8 * n + 2] + s1[8 * n + 2] + 1) >> 1;
+    g = (s0[8 * n + 1] + s1[8 * n + 1] + 1) >> 1;
+    b = (s0[8 * n] + s1[8 * n] + 1) >> 1;
+    u[n * uv_step] = RGB_TO_U (r, g, b);
+    v[n * uv_step] = RGB_TO_V (r, g, b);
+  }
+}
+
+#undef RGB_TO_Y
+#undef RGB_TO_U
+#undef RGB_TO_V
+
+/* Converts @frame into the I420 or NV12 layout of the input port, writing
+ * every destination byte once */
+static gboolean
+gst_omx_video_enc_convert_frame (GstObject * parent,
+    OMX_PARAM_PORTDEFINITIONTYPE * port_def, GstVideoFrame * frame,
+    GstOMXBuffer * outbuf)
+{
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT (frame);
+  gint width = GST_VIDEO_FRAME_WIDTH (frame);
+  gint height = GST_VIDEO_FRAME_HEIGHT (frame);
+  gint src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0);
+  const guint8 *src = GST_VIDEO_FRAME_PLANE_DATA (frame, 0);
+  gint stride, slice_height, uv_stride, uv_step;
+  guint8 *y, *u, *v;
+  gsize size;
+  gint j;
+
+  stride = port_def->format.video.nStride;
+  if (stride == 0)
+    stride = GST_ROUND_UP_4 (width);
+  slice_height = MAX (port_def->format.video.nSliceHeight, height);
+
+  y = outbuf->omx_buf->pBuffer + outbuf->omx_buf->nOffset;
+  switch (port_def->format.video.eColorFormat) {
+    case OMX_COLOR_FormatYUV420SemiPlanar:
+    case OMX_COLOR_FormatYUV420PackedSemiPlanar:
+      uv_stride = stride;
+      uv_step = 2;
+      u = y + stride * slice_height;
+      v = u + 1;
+      size = stride * slice_height + uv_stride * ((slice_height + 1) / 2);
+      break;
+    case OMX_COLOR_FormatYUV420Planar:
+    case OMX_COLOR_FormatYUV420PackedPlanar:
+      uv_stride = stride / 2;
+      uv_step = 1;
+      u = y + stride * slice_height;
+      v = u + uv_stride * ((slice_height + 1) / 2);
+      size = stride * slice_height + 2 * uv_stride * ((slice_height + 1) / 2);
+      break;
+    default:
+      GST_ERROR_OBJECT (parent, "Can't convert %s to port format %x",
+          gst_video_format_to_string (format),
+          port_def->format.video.eColorFormat);
+      return FALSE;
+  }
+
+  if (stride < width || uv_stride < ((width + 1) / 2) * uv_step
+      || size > outbuf->omx_buf->nAllocLen - outbuf->omx_buf->nOffset) {
+    GST_ERROR_OBJECT (parent, "Invalid output buffer size");
+    return FALSE;
+  }
+
+  GST_LOG_OBJECT (parent, "Converting %s to port format %x",
+      gst_video_format_to_string (format),
+      port_def->format.video.eColorFormat);
+
+  for (j = 0; j < height; j += 2) {
+    /* The last row of odd heights is paired with itself */
+    gint next = j + 1 < height ? 1 : 0;
+    const guint8 *s0 = src + j * src_stride;
+    guint8 *y0 = y + j * stride;
+    guint8 *cu = u + (j / 2) * uv_stride;
+    guint8 *cv = v + (j / 2) * uv_stride;
+
+    if (format == GST_VIDEO_FORMAT_BGRx)
+      gst_omx_video_enc_convert_bgrx (s0, s0 + next * src_stride, y0,
+          y0 + next * stride, cu, cv, uv_step, width);
+    else
+      gst_omx_video_enc_convert_packed_422 (s0, s0 + next * src_stride, y0,
+          y0 + next * stride, cu, cv, uv_step, width,
+          format == GST_VIDEO_FORMAT_UYVY ? 1 : 0);
+  }
+
+  outbuf->omx_buf->nFilledLen = size;
+
+  return TRUE;
+}
+
 static gboolean
 gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
     GstVideoCodecState * state)
@@ -950,6 +2258,7 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
   OMX_PARAM_PORTDEFINITIONTYPE port_def;
   GstVideoInfo *info = &state->info;
   GList *negotiation_map = NULL, *l;
+  guint32 abr_bitrate;
 
   self = GST_OMX_VIDEO_ENC (encoder);
   klass = GST_OMX_VIDEO_ENC_GET_CLASS (encoder);
@@ -1013,6 +2322,9 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
     GST_DEBUG_OBJECT (self, "Encoder drained and disabled");
   }
 
+  /* The latency of the old format doesn't apply anymore */
+  gst_omx_video_latency_reset (&self->latency, klass->cdata.latency);
+
   negotiation_map =
       gst_omx_video_get_supported_colorformats (self->enc_in_port,
       self->input_state);
@@ -1020,6 +2332,9 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
     /* Fallback */
     switch (info->finfo->format) {
       case GST_VIDEO_FORMAT_I420:
+      case GST_VIDEO_FORMAT_YUY2:
+      case GST_VIDEO_FORMAT_UYVY:
+      case GST_VIDEO_FORMAT_BGRx:
         port_def.format.video.eColorFormat = OMX_COLOR_FormatYUV420Planar;
         break;
       case GST_VIDEO_FORMAT_NV12:
@@ -1038,9 +2353,19 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
         break;
     }
   } else {
+    if (gst_omx_video_enc_is_converted_format (info->finfo->format))
+      negotiation_map =
+          gst_omx_video_enc_add_converted_formats (negotiation_map);
+
     for (l = negotiation_map; l; l = l->next) {
       GstOMXVideoNegotiationMap *m = l->data;
 
+      /* Natively supported packed formats are converted anyway, the input
+       * buffers are only filled with planar 4:2:0 data */
+      if (gst_omx_video_enc_is_converted_format (m->format)
+          && gst_omx_video_get_format_from_omx (m->type) == m->format)
+        continue;
+
       if (m->format == info->finfo->format) {
         port_def.format.video.eColorFormat = m->type;
         break;
@@ -1151,13 +2476,20 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
           NULL) != OMX_ErrorNone)
     return FALSE;
 
-  if (self->target_bitrate != 0xffffffff) {
+  /* Keep following the bandwidth estimate after reconfiguration */
+  GST_OBJECT_LOCK (self);
+  abr_bitrate = self->abr_applied_bitrate;
+  self->abr_bitrate_pending = FALSE;
+  GST_OBJECT_UNLOCK (self);
+
+  if (self->target_bitrate != 0xffffffff || abr_bitrate != 0) {
     OMX_VIDEO_PARAM_BITRATETYPE config;
     OMX_ERRORTYPE err;
 
     GST_OMX_INIT_STRUCT (&config);
     config.nPortIndex = self->enc_out_port->index;
-    config.nTargetBitrate = self->target_bitrate;
+    config.nTargetBitrate = abr_bitrate != 0 ?
+        abr_bitrate : self->target_bitrate;
     config.eControlRate = self->control_rate;
     err = gst_omx_component_set_parameter (self->enc,
         OMX_IndexParamVideoBitrate, &config);
@@ -1166,6 +2498,44 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
           gst_omx_error_to_string (err), err);
   }
 
+  if (self->intra_refresh_mode != 0xffffffff) {
+    OMX_VIDEO_PARAM_INTRAREFRESHTYPE param;
+    OMX_ERRORTYPE err;
+
+    GST_OMX_INIT_STRUCT (&param);
+    param.nPortIndex = self->enc_out_port->index;
+    err = gst_omx_component_get_parameter (self->enc,
+        OMX_IndexParamVideoIntraRefresh, &param);
+    if (err == OMX_ErrorNone) {
+      param.eRefreshMode = self->intra_refresh_mode;
+      if (self->intra_refresh_mbs != 0xffffffff) {
+        if (self->intra_refresh_mode != OMX_VIDEO_IntraRefreshAdaptive)
+          param.nCirMBs = self->intra_refresh_mbs;
+        if (self->intra_refresh_mode != OMX_VIDEO_IntraRefreshCyclic)
+          param.nAirMBs = self->intra_refresh_mbs;
+      }
+
+      err = gst_omx_component_set_parameter (self->enc,
+          OMX_IndexParamVideoIntraRefresh, &param);
+    }
+
+    if (err == OMX_ErrorUnsupportedIndex) {
+      GST_WARNING_OBJECT (self,
+          "Setting intra refresh parameters not supported by the component");
+    } else if (err != OMX_ErrorNone) {
+      GST_ERROR_OBJECT (self,
+          "Failed to set intra refresh parameters: %s (0x%08x)",
+          gst_omx_error_to_string (err), err);
+    } else {
+      GST_DEBUG_OBJECT (self, "Intra refresh mode %u with %u cyclic and %u "
+          "adaptive macroblocks", self->intra_refresh_mode,
+          (guint) param.nCirMBs, (guint) param.nAirMBs);
+    }
+  }
+
+  gst_omx_port_set_wrap_buffers (self->enc_out_port,
+      self->zero_copy_output);
+
   GST_DEBUG_OBJECT (self, "Enabling component");
   if (needs_disable) {
     if (gst_omx_port_set_enabled (self->enc_in_port, TRUE) != OMX_ErrorNone)
@@ -1270,18 +2640,34 @@ gst_omx_video_enc_flush (GstVideoEncoder * encoder)
   gst_omx_port_set_flushing (self->enc_in_port, 5 * GST_SECOND, TRUE);
   gst_omx_port_set_flushing (self->enc_out_port, 5 * GST_SECOND, TRUE);
 
-  /* Wait until the srcpad loop is finished,
+  gst_omx_video_enc_clear_input_queue (self);
+
+  /* Wait until the srcpad loop and the input thread are finished,
    * unlock GST_VIDEO_ENCODER_STREAM_LOCK to prevent deadlocks
    * caused by using this lock from inside the loop function */
   GST_VIDEO_ENCODER_STREAM_UNLOCK (self);
   GST_PAD_STREAM_LOCK (GST_VIDEO_ENCODER_SRC_PAD (self));
   GST_PAD_STREAM_UNLOCK (GST_VIDEO_ENCODER_SRC_PAD (self));
+  gst_omx_video_enc_wait_input_queue (self);
   GST_VIDEO_ENCODER_STREAM_LOCK (self);
 
+  g_mutex_lock (&self->input_lock);
+  self->input_flow_ret = GST_FLOW_OK;
+  g_mutex_unlock (&self->input_lock);
+
   gst_omx_port_set_flushing (self->enc_in_port, 5 * GST_SECOND, FALSE);
   gst_omx_port_set_flushing (self->enc_out_port, 5 * GST_SECOND, FALSE);
   gst_omx_port_populate (self->enc_out_port);
 
+  /* The running time may start over after a flush */
+  self->keyframe_next = GST_CLOCK_TIME_NONE;
+  g_queue_clear (&self->keyframe_targets);
+  memset (&self->stats, 0, sizeof (GstOMXVideoEncStats));
+  self->stats.start = GST_CLOCK_TIME_NONE;
+  self->stats_frame_bytes = 0;
+  gst_omx_video_latency_reset (&self->latency,
+      GST_OMX_VIDEO_ENC_GET_CLASS (self)->cdata.latency);
+
   /* Start the srcpad loop again */
   self->last_upstream_ts = 0;
   self->downstream_flow_ret = GST_FLOW_OK;
@@ -1291,19 +2677,30 @@ gst_omx_video_enc_flush (GstVideoEncoder * encoder)
   return TRUE;
 }
 
-static gboolean
-gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
-    GstOMXBuffer * outbuf)
+/* Copies @inbuf in the format @info into @outbuf with the strides and
+ * slice height of the input port described by @port_def, converting it
+ * if the port does not support the format. Also used by omxsimulcastenc */
+gboolean
+gst_omx_video_enc_fill_omx_buffer (GstObject * parent,
+    OMX_PARAM_PORTDEFINITIONTYPE * port_def, GstVideoInfo * info,
+    GstBuffer * inbuf, GstOMXBuffer * outbuf)
 {
-  GstVideoCodecState *state = gst_video_codec_state_ref (self->input_state);
-  GstVideoInfo *info = &state->info;
-  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->enc_in_port->port_def;
   gboolean ret = FALSE;
   GstVideoFrame frame;
 
   if (info->width != port_def->format.video.nFrameWidth ||
       info->height != port_def->format.video.nFrameHeight) {
-    GST_ERROR_OBJECT (self, "Width or height do not match");
+    GST_ERROR_OBJECT (parent, "Width or height do not match");
+    goto done;
+  }
+
+  if (gst_omx_video_enc_is_converted_format (info->finfo->format)) {
+    if (!gst_video_frame_map (&frame, info, inbuf, GST_MAP_READ)) {
+      GST_ERROR_OBJECT (parent, "Invalid input buffer size");
+      goto done;
+    }
+    ret = gst_omx_video_enc_convert_frame (parent, port_def, &frame, outbuf);
+    gst_video_frame_unmap (&frame);
     goto done;
   }
 
@@ -1312,7 +2709,7 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
       outbuf->omx_buf->nAllocLen - outbuf->omx_buf->nOffset) {
     outbuf->omx_buf->nFilledLen = gst_buffer_get_size (inbuf);
 
-    GST_LOG_OBJECT (self, "Matched strides - direct copy %u bytes",
+    GST_LOG_OBJECT (parent, "Matched strides - direct copy %u bytes",
         (guint) outbuf->omx_buf->nFilledLen);
 
     gst_buffer_extract (inbuf, 0,
@@ -1323,7 +2720,7 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
   }
 
   /* Different strides */
-  GST_LOG_OBJECT (self, "Mismatched strides - copying line-by-line");
+  GST_LOG_OBJECT (parent, "Mismatched strides - copying line-by-line");
 
   switch (info->finfo->format) {
     case GST_VIDEO_FORMAT_I420:{
@@ -1334,7 +2731,7 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
       outbuf->omx_buf->nFilledLen = 0;
 
       if (!gst_video_frame_map (&frame, info, inbuf, GST_MAP_READ)) {
-        GST_ERROR_OBJECT (self, "Invalid input buffer size");
+        GST_ERROR_OBJECT (parent, "Invalid input buffer size");
         ret = FALSE;
         break;
       }
@@ -1370,7 +2767,7 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
         if (dest + dest_stride * height >
             outbuf->omx_buf->pBuffer + outbuf->omx_buf->nAllocLen) {
           gst_video_frame_unmap (&frame);
-          GST_ERROR_OBJECT (self, "Invalid output buffer size");
+          GST_ERROR_OBJECT (parent, "Invalid output buffer size");
           ret = FALSE;
           break;
         }
@@ -1400,7 +2797,7 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
       outbuf->omx_buf->nFilledLen = 0;
 
       if (!gst_video_frame_map (&frame, info, inbuf, GST_MAP_READ)) {
-        GST_ERROR_OBJECT (self, "Invalid input buffer size");
+        GST_ERROR_OBJECT (parent, "Invalid input buffer size");
         ret = FALSE;
         break;
       }
@@ -1429,7 +2826,7 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
         if (dest + dest_stride * height >
             outbuf->omx_buf->pBuffer + outbuf->omx_buf->nAllocLen) {
           gst_video_frame_unmap (&frame);
-          GST_ERROR_OBJECT (self, "Invalid output buffer size");
+          GST_ERROR_OBJECT (parent, "Invalid output buffer size");
           ret = FALSE;
           break;
         }
@@ -1452,27 +2849,373 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
       break;
     }
     default:
-      GST_ERROR_OBJECT (self, "Unsupported format");
+      GST_ERROR_OBJECT (parent, "Unsupported format");
       goto done;
       break;
   }
 
 done:
 
+  return ret;
+}
+
+static gboolean
+gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
+    GstOMXBuffer * outbuf)
+{
+  GstVideoCodecState *state = gst_video_codec_state_ref (self->input_state);
+  gboolean ret;
+
+  ret =
+      gst_omx_video_enc_fill_omx_buffer (GST_OBJECT (self),
+      &self->enc_in_port->port_def, &state->info, inbuf, outbuf);
+
   gst_video_codec_state_unref (state);
 
   return ret;
 }
 
+/* Drives the bitrate from bandwidth estimates sent upstream by downstream
+ * elements, e.g. from RTCP feedback. Decreases are applied with the next
+ * frame to keep the send queues short, increases are smoothed. Below
+ * min-bitrate more and more frames are skipped the lower the estimate
+ * gets. Called from the upstream event thread, so the component is only
+ * reconfigured later by gst_omx_video_enc_apply_abr_bitrate(). */
+static void
+gst_omx_video_enc_update_bandwidth_estimate (GstOMXVideoEnc * self,
+    guint estimate)
+{
+  guint32 old_bitrate, bitrate, target, applied;
+  gdouble skip_ratio = 0.0;
+  gboolean apply;
+
+  /* Leave some headroom for the transport overhead */
+  target = estimate / 100 * GST_OMX_VIDEO_ENC_ABR_HEADROOM_PERCENT;
+
+  GST_OBJECT_LOCK (self);
+  old_bitrate = self->abr_bitrate;
+  if (old_bitrate == 0)
+    old_bitrate = self->target_bitrate != 0xffffffff ?
+        self->target_bitrate : target;
+
+  if (target < old_bitrate)
+    bitrate = target;
+  else
+    bitrate = old_bitrate + (target - old_bitrate) /
+        GST_OMX_VIDEO_ENC_ABR_RAMP_UP_DIVISOR;
+
+  if (self->min_bitrate > 0 && bitrate < self->min_bitrate) {
+    skip_ratio = 1.0 - ((gdouble) bitrate) / self->min_bitrate;
+    bitrate = self->min_bitrate;
+  }
+  if (self->max_bitrate > 0 && bitrate > self->max_bitrate)
+    bitrate = self->max_bitrate;
+
+  self->abr_bitrate = bitrate;
+  self->abr_skip_ratio = skip_ratio;
+
+  /* Don't reconfigure the component for small changes */
+  applied = self->abr_applied_bitrate;
+  apply = applied == 0
+      || ((guint64) bitrate) * 100 <
+      ((guint64) applied) * (100 - GST_OMX_VIDEO_ENC_ABR_MIN_CHANGE_PERCENT)
+      || ((guint64) bitrate) * 100 >
+      ((guint64) applied) * (100 + GST_OMX_VIDEO_ENC_ABR_MIN_CHANGE_PERCENT);
+  if (apply && self->enc) {
+    self->abr_applied_bitrate = bitrate;
+    self->abr_bitrate_pending = TRUE;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  GST_LOG_OBJECT (self, "Bandwidth estimate %u, bitrate %u -> %u, skipping "
+      "%.0f%% of the frames", estimate, old_bitrate, bitrate,
+      skip_ratio * 100);
+
+  if (apply && self->enc)
+    GST_DEBUG_OBJECT (self, "Changing bitrate from %u to %u", applied,
+        bitrate);
+}
+
+/* Sets the bitrate chosen by the last bandwidth estimate on the component.
+ * Called with the stream lock so that it can't race with set_format() */
+static void
+gst_omx_video_enc_apply_abr_bitrate (GstOMXVideoEnc * self)
+{
+  guint32 bitrate;
+  gboolean pending;
+
+  GST_OBJECT_LOCK (self);
+  pending = self->abr_bitrate_pending;
+  bitrate = self->abr_applied_bitrate;
+  self->abr_bitrate_pending = FALSE;
+  GST_OBJECT_UNLOCK (self);
+
+  if (pending && self->enc)
+    gst_omx_video_enc_set_bitrate (self, bitrate);
+}
+
+/* Returns TRUE if the current frame should be skipped because the
+ * bandwidth estimate is below min-bitrate */
+static gboolean
+gst_omx_video_enc_abr_skip_frame (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame)
+{
+  gboolean skip = FALSE;
+
+  if (!self->adaptive_bitrate
+      || GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME (frame))
+    return FALSE;
+
+  GST_OBJECT_LOCK (self);
+  if (self->abr_skip_ratio > 0.0) {
+    self->abr_skip_credit += self->abr_skip_ratio;
+    if (self->abr_skip_credit >= 1.0) {
+      self->abr_skip_credit -= 1.0;
+      skip = TRUE;
+    }
+  } else {
+    self->abr_skip_credit = 0.0;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  return skip;
+}
+
+/* Passes a region of interest of the next input buffer to the component */
+static gboolean
+gst_omx_video_enc_set_roi (GstOMXVideoEnc * self,
+    GstVideoRegionOfInterestMeta * meta)
+{
+  GstOMXVideoEncRegionOfInterest config;
+  GstVideoInfo *info = &self->input_state->info;
+  GstStructure *s;
+  gint delta_qp = self->roi_qp_delta;
+  OMX_ERRORTYPE err;
+
+  if (meta->x >= GST_VIDEO_INFO_WIDTH (info)
+      || meta->y >= GST_VIDEO_INFO_HEIGHT (info))
+    return TRUE;
+
+  s = gst_video_region_of_interest_meta_get_param (meta, "roi/omx");
+  if (s)
+    gst_structure_get_int (s, "delta-qp", &delta_qp);
+
+  GST_OMX_INIT_STRUCT (&config);
+  config.nPortIndex = self->enc_in_port->index;
+  config.nLeft = meta->x;
+  config.nTop = meta->y;
+  config.nWidth = MIN (meta->w, GST_VIDEO_INFO_WIDTH (info) - meta->x);
+  config.nHeight = MIN (meta->h, GST_VIDEO_INFO_HEIGHT (info) - meta->y);
+  config.nQpDelta = CLAMP (delta_qp, -51, 51);
+
+  GST_LOG_OBJECT (self, "Region of interest %s at %u,%u %ux%u, QP delta %d",
+      g_quark_to_string (meta->roi_type), (guint) config.nLeft,
+      (guint) config.nTop, (guint) config.nWidth, (guint) config.nHeight,
+      (gint) config.nQpDelta);
+
+  err = gst_omx_component_set_config (self->enc, self->roi_index, &config);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (self, "Failed to set region of interest: %s "
+        "(0x%08x)", gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Raises the bitrate by roi-bitrate-boost or restores it */
+static void
+gst_omx_video_enc_set_roi_boost (GstOMXVideoEnc * self, gboolean boost)
+{
+  guint32 bitrate;
+
+  GST_OBJECT_LOCK (self);
+  self->roi_boosted = boost;
+  bitrate = self->roi_base_bitrate;
+  GST_OBJECT_UNLOCK (self);
+
+  /* Nobody changed the bitrate yet, start from the configured one */
+  if (bitrate == 0) {
+    OMX_VIDEO_CONFIG_BITRATETYPE config;
+
+    GST_OMX_INIT_STRUCT (&config);
+    config.nPortIndex = self->enc_out_port->index;
+    if (gst_omx_component_get_config (self->enc, OMX_IndexConfigVideoBitrate,
+            &config) == OMX_ErrorNone)
+      bitrate = config.nEncodeBitrate;
+    else
+      bitrate = self->enc_out_port->port_def.format.video.nBitrate;
+  }
+
+  if (bitrate == 0) {
+    GST_DEBUG_OBJECT (self, "Unknown bitrate, can't raise it");
+    return;
+  }
+
+  GST_DEBUG_OBJECT (self, "%s bitrate for regions of interest",
+      boost ? "Raising" : "Restoring");
+  gst_omx_video_enc_set_bitrate (self, bitrate);
+}
+
+/* Configures the regions of interest of @frame, or raises the bitrate
+ * for it if the component doesn't support them */
+static void
+gst_omx_video_enc_apply_roi (GstOMXVideoEnc * self, GstVideoCodecFrame * frame)
+{
+  GstVideoRegionOfInterestMeta *meta;
+  gpointer state = NULL;
+  gboolean has_roi = FALSE;
+
+  while ((meta = (GstVideoRegionOfInterestMeta *)
+          gst_buffer_iterate_meta_filtered (frame->input_buffer, &state,
+              GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE))) {
+    has_roi = TRUE;
+    if (!self->roi_supported)
+      break;
+
+    if (!gst_omx_video_enc_set_roi (self, meta)) {
+      GST_WARNING_OBJECT (self, "Not using regions of interest anymore");
+      self->roi_supported = FALSE;
+      break;
+    }
+  }
+
+  if (self->roi_supported || self->roi_bitrate_boost == 0)
+    return;
+
+  if (has_roi != self->roi_boosted)
+    gst_omx_video_enc_set_roi_boost (self, has_roi);
+}
+
+/* Forces a keyframe on @frame if it is the first frame at or after
+ * the next multiple of keyframe-schedule in running time */
+static void
+gst_omx_video_enc_schedule_keyframe (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame)
+{
+  GstClockTime running_time;
+
+  if (self->keyframe_schedule == 0 || !GST_CLOCK_TIME_IS_VALID (frame->pts))
+    return;
+
+  running_time =
+      gst_segment_to_running_time (&GST_VIDEO_ENCODER_INPUT_SEGMENT (self),
+      GST_FORMAT_TIME, frame->pts);
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return;
+
+  if (GST_CLOCK_TIME_IS_VALID (self->keyframe_next)
+      && running_time < self->keyframe_next)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Scheduling keyframe on frame %u at running time %"
+      GST_TIME_FORMAT ", %" GST_TIME_FORMAT " after its target",
+      frame->system_frame_number, GST_TIME_ARGS (running_time),
+      GST_TIME_ARGS (GST_CLOCK_TIME_IS_VALID (self->keyframe_next) ?
+          running_time - self->keyframe_next : 0));
+
+  GST_VIDEO_CODEC_FRAME_SET_FORCE_KEYFRAME (frame);
+  g_queue_push_tail (&self->keyframe_targets,
+      GUINT_TO_POINTER (frame->system_frame_number));
+  self->keyframe_next =
+      (running_time / self->keyframe_schedule + 1) * self->keyframe_schedule;
+}
+
+static gboolean
+gst_omx_video_enc_src_event (GstVideoEncoder * encoder, GstEvent * event)
+{
+  GstOMXVideoEnc *self = GST_OMX_VIDEO_ENC (encoder);
+
+  /* Only consume the estimates if we follow them, otherwise another
+   * element upstream might */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_UPSTREAM
+      && gst_event_has_name (event, "bandwidth-estimate")
+      && self->adaptive_bitrate) {
+    const GstStructure *s = gst_event_get_structure (event);
+    guint estimate;
+
+    if (gst_structure_get_uint (s, "bitrate", &estimate) && estimate > 0)
+      gst_omx_video_enc_update_bandwidth_estimate (self, estimate);
+    gst_event_unref (event);
+
+    return TRUE;
+  }
+
+  return
+      GST_VIDEO_ENCODER_CLASS (gst_omx_video_enc_parent_class)->src_event
+      (encoder, event);
+}
+
+/* Queues @frame for the input thread, applying the input-queue-policy
+ * if the queue is full. Called with the stream lock */
+static GstFlowReturn
+gst_omx_video_enc_queue_frame (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame)
+{
+  GstVideoCodecFrame *dropped = NULL;
+  GstFlowReturn ret;
+
+  g_mutex_lock (&self->input_lock);
+  while (!self->input_stop && self->input_flow_ret == GST_FLOW_OK
+      && g_queue_get_length (&self->input_queue) >= self->input_queue_size) {
+    if (self->input_queue_policy ==
+        GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DROP_OLDEST) {
+      dropped = g_queue_pop_head (&self->input_queue);
+      if (GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME (dropped))
+        GST_VIDEO_CODEC_FRAME_SET_FORCE_KEYFRAME (frame);
+      break;
+    } else if (self->input_queue_policy ==
+        GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DROP_NEWEST) {
+      dropped = frame;
+      frame = NULL;
+      if (GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME (dropped))
+        GST_VIDEO_CODEC_FRAME_SET_FORCE_KEYFRAME (g_queue_peek_tail
+            (&self->input_queue));
+      break;
+    }
+
+    /* Release the stream lock while blocking, the input
+     * thread needs it to pass the queued frames */
+    g_mutex_unlock (&self->input_lock);
+    GST_VIDEO_ENCODER_STREAM_UNLOCK (self);
+    g_mutex_lock (&self->input_lock);
+    while (!self->input_stop && self->input_flow_ret == GST_FLOW_OK
+        && g_queue_get_length (&self->input_queue) >= self->input_queue_size)
+      g_cond_wait (&self->input_cond, &self->input_lock);
+    g_mutex_unlock (&self->input_lock);
+    GST_VIDEO_ENCODER_STREAM_LOCK (self);
+    g_mutex_lock (&self->input_lock);
+  }
+
+  if (self->input_stop || self->input_flow_ret != GST_FLOW_OK) {
+    ret = self->input_stop ? GST_FLOW_FLUSHING : self->input_flow_ret;
+    g_mutex_unlock (&self->input_lock);
+    gst_video_codec_frame_unref (frame);
+    return ret;
+  }
+
+  if (dropped)
+    self->input_dropped++;
+  if (frame) {
+    g_queue_push_tail (&self->input_queue, frame);
+    g_cond_broadcast (&self->input_cond);
+  }
+  g_mutex_unlock (&self->input_lock);
+
+  if (dropped) {
+    GST_DEBUG_OBJECT (self, "Input queue full, dropping frame %u",
+        dropped->system_frame_number);
+    gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (self), dropped);
+  }
+
+  return self->downstream_flow_ret;
+}
+
 static GstFlowReturn
 gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
     GstVideoCodecFrame * frame)
 {
-  GstOMXAcquireBufferReturn acq_ret = GST_OMX_ACQUIRE_BUFFER_ERROR;
   GstOMXVideoEnc *self;
-  GstOMXPort *port;
-  GstOMXBuffer *buf;
-  OMX_ERRORTYPE err;
 
   self = GST_OMX_VIDEO_ENC (encoder);
 
@@ -1483,6 +3226,33 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
     return self->downstream_flow_ret;
   }
 
+  gst_omx_video_enc_schedule_keyframe (self, frame);
+  gst_omx_video_enc_apply_abr_bitrate (self);
+
+  if (gst_omx_video_enc_abr_skip_frame (self, frame)) {
+    GST_DEBUG_OBJECT (self, "Skipping frame, bandwidth estimate below "
+        "min-bitrate");
+    return gst_video_encoder_finish_frame (encoder, frame);
+  }
+
+  if (self->input_thread)
+    return gst_omx_video_enc_queue_frame (self, frame);
+
+  return gst_omx_video_enc_submit_frame (self, frame);
+}
+
+/* Passes @frame to the component, called with the stream lock
+ * from handle_frame() or the input thread */
+static GstFlowReturn
+gst_omx_video_enc_submit_frame (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame)
+{
+  GstOMXAcquireBufferReturn acq_ret = GST_OMX_ACQUIRE_BUFFER_ERROR;
+  GstOMXPort *port;
+  GstOMXBuffer *buf;
+  OMX_ERRORTYPE err;
+  gboolean filled;
+
   port = self->enc_in_port;
 
   while (acq_ret != GST_OMX_ACQUIRE_BUFFER_OK) {
@@ -1526,6 +3296,9 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
         goto reconfigure_error;
       }
 
+      gst_omx_port_set_wrap_buffers (self->enc_out_port,
+          self->zero_copy_output);
+
       err = gst_omx_port_set_enabled (port, TRUE);
       if (err != OMX_ErrorNone) {
         GST_VIDEO_ENCODER_STREAM_LOCK (self);
@@ -1600,9 +3373,15 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
             gst_omx_error_to_string (err), err);
     }
 
+    gst_omx_video_enc_apply_roi (self, frame);
+
     /* Copy the buffer content in chunks of size as requested
-     * by the port */
-    if (!gst_omx_video_enc_fill_buffer (self, frame->input_buffer, buf)) {
+     * by the port. The input state only changes after draining,
+     * so _loop() can finish frames meanwhile */
+    GST_VIDEO_ENCODER_STREAM_UNLOCK (self);
+    filled = gst_omx_video_enc_fill_buffer (self, frame->input_buffer, buf);
+    GST_VIDEO_ENCODER_STREAM_LOCK (self);
+    if (!filled) {
       gst_omx_port_release_buffer (port, buf);
       goto buffer_fill_error;
     }
@@ -1623,6 +3402,9 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
       buf->omx_buf->nTickCount = 0;
     }
 
+    /* For the latency and the statistics */
+    gst_omx_video_latency_mark_submitted (frame);
+
     self->started = TRUE;
     err = gst_omx_port_release_buffer (port, buf);
     if (err != OMX_ErrorNone)
@@ -1712,6 +3494,13 @@ gst_omx_video_enc_drain (GstOMXVideoEnc * self)
 
   klass = GST_OMX_VIDEO_ENC_GET_CLASS (self);
 
+  /* Let the input thread pass all queued frames first */
+  if (self->input_thread) {
+    GST_VIDEO_ENCODER_STREAM_UNLOCK (self);
+    gst_omx_video_enc_wait_input_queue (self);
+    GST_VIDEO_ENCODER_STREAM_LOCK (self);
+  }
+
   if (!self->started) {
     GST_DEBUG_OBJECT (self, "Component not started yet");
     return GST_FLOW_OK;
@@ -1818,6 +3607,7 @@ gst_omx_video_enc_getcaps (GstVideoEncoder * encoder, GstCaps * filter)
       gst_omx_video_get_supported_colorformats (self->enc_in_port,
       self->input_state);
   negotiation_map = filter_supported_formats (negotiation_map);
+  negotiation_map = gst_omx_video_enc_add_converted_formats (negotiation_map);
 
   comp_supported_caps = gst_omx_video_get_caps_for_map (negotiation_map);
   g_list_free_full (negotiation_map,
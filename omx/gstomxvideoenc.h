@@ -26,6 +26,8 @@
 #include <gst/video/gstvideoencoder.h>
 
 #include "gstomx.h"
+#include "gstomxvideo.h"
+#include "gstomxvideoencmeta.h"
 
 G_BEGIN_DECLS
 
@@ -45,6 +47,28 @@ G_BEGIN_DECLS
 typedef struct _GstOMXVideoEnc GstOMXVideoEnc;
 typedef struct _GstOMXVideoEncClass GstOMXVideoEncClass;
 
+/* Statistics of the frames since the last omx-encoder-stats message */
+typedef struct
+{
+  /* PTS of the first frame */
+  GstClockTime start;
+  guint frames;
+  guint i_frames, p_frames, b_frames;
+  guint keyframes;
+  guint64 bytes;
+  GstClockTime latency_sum, latency_max;
+  guint latency_frames;
+  guint64 qp_sum;
+  guint qp_frames;
+} GstOMXVideoEncStats;
+
+typedef enum
+{
+  GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_BLOCK,
+  GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DROP_OLDEST,
+  GST_OMX_VIDEO_ENC_INPUT_QUEUE_POLICY_DROP_NEWEST
+} GstOMXVideoEncInputQueuePolicy;
+
 struct _GstOMXVideoEnc
 {
   GstVideoEncoder parent;
@@ -67,12 +91,83 @@ struct _GstOMXVideoEnc
   /* TRUE if EOS buffers shouldn't be forwarded */
   gboolean draining;
 
+  /* Measured latency of the component */
+  GstOMXVideoLatency latency;
+
+  /* TRUE if handle_output_frame() passed the current output buffer
+   * downstream without copying it */
+  gboolean out_buf_wrapped;
+
+  /* Adaptive bitrate state, OBJECT_LOCK */
+  guint32 abr_bitrate;
+  guint32 abr_applied_bitrate;
+  /* abr_applied_bitrate still has to be set on the component, this is
+   * done from handle_frame() with the stream lock */
+  gboolean abr_bitrate_pending;
+  gdouble abr_skip_ratio;
+  gdouble abr_skip_credit;
+
+  /* Input thread, only running if input-queue-size > 0 */
+  GThread *input_thread;
+  GMutex input_lock;
+  GCond input_cond;
+  /* Frames waiting to be passed to the component, INPUT_LOCK */
+  GQueue input_queue;
+  /* TRUE while the input thread passes a frame to the
+   * component, INPUT_LOCK */
+  gboolean input_busy;
+  /* TRUE if the input thread should exit, INPUT_LOCK */
+  gboolean input_stop;
+  /* Error of the input thread, returned by handle_frame(), INPUT_LOCK */
+  GstFlowReturn input_flow_ret;
+  /* Frames dropped because the queue was full, INPUT_LOCK */
+  guint input_dropped;
+
+  /* Running time of the next scheduled keyframe */
+  GstClockTime keyframe_next;
+  /* Numbers of the frames scheduled as keyframes that
+   * were not output yet */
+  GQueue keyframe_targets;
+  /* Keyframe schedule statistics, OBJECT_LOCK */
+  guint keyframes_on_target;
+  guint keyframes_missed;
+  guint keyframes_unscheduled;
+
+  /* Index of the region of interest extension if supported */
+  gboolean roi_supported;
+  OMX_INDEXTYPE roi_index;
+  /* TRUE while the bitrate is raised for regions of interest and
+   * the bitrate it's raised from, OBJECT_LOCK */
+  gboolean roi_boosted;
+  guint32 roi_base_bitrate;
+
+  /* Index of the average quantizer extension if supported */
+  gboolean average_qp_supported;
+  OMX_INDEXTYPE average_qp_index;
+  /* Output of the current frame so far */
+  gsize stats_frame_bytes;
+  GstOMXVideoEncStats stats;
+
   /* properties */
   guint32 control_rate;
   guint32 target_bitrate;
   guint32 quant_i_frames;
   guint32 quant_p_frames;
   guint32 quant_b_frames;
+  gboolean zero_copy_output;
+  gboolean slice_output;
+  guint32 intra_refresh_mode;
+  guint32 intra_refresh_mbs;
+  gboolean adaptive_bitrate;
+  guint32 min_bitrate;
+  guint32 max_bitrate;
+  guint input_queue_size;
+  GstOMXVideoEncInputQueuePolicy input_queue_policy;
+  GstClockTime keyframe_schedule;
+  gint roi_qp_delta;
+  guint roi_bitrate_boost;
+  gboolean stats_meta;
+  GstClockTime stats_interval;
 
   GstFlowReturn downstream_flow_ret;
 };
@@ -86,10 +181,16 @@ struct _GstOMXVideoEncClass
   gboolean            (*set_format)          (GstOMXVideoEnc * self, GstOMXPort * port, GstVideoCodecState * state);
   GstCaps            *(*get_caps)           (GstOMXVideoEnc * self, GstOMXPort * port, GstVideoCodecState * state);
   GstFlowReturn       (*handle_output_frame) (GstOMXVideoEnc * self, GstOMXPort * port, GstOMXBuffer * buffer, GstVideoCodecFrame * frame);
+  /* Returns the type of the frame that ends with @buffer */
+  GstOMXVideoEncFrameType (*get_frame_type) (GstOMXVideoEnc * self, GstOMXBuffer * buffer);
 };
 
 GType gst_omx_video_enc_get_type (void);
 
+gboolean gst_omx_video_enc_fill_omx_buffer (GstObject * parent,
+    OMX_PARAM_PORTDEFINITIONTYPE * port_def, GstVideoInfo * info,
+    GstBuffer * inbuf, GstOMXBuffer * outbuf);
+
 G_END_DECLS
 
 #endif /* __GST_OMX_VIDEO_ENC_H__ */
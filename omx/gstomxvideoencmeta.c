@@ -0,0 +1,115 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstomxvideoencmeta.h"
+
+GType
+gst_omx_video_enc_stats_meta_api_get_type (void)
+{
+  static volatile GType type;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type =
+        gst_meta_api_type_register ("GstOMXVideoEncStatsMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_omx_video_enc_stats_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstOMXVideoEncStatsMeta *smeta = (GstOMXVideoEncStatsMeta *) meta;
+
+  smeta->size = 0;
+  smeta->frame_type = GST_OMX_VIDEO_ENC_FRAME_TYPE_UNKNOWN;
+  smeta->keyframe = FALSE;
+  smeta->latency = GST_CLOCK_TIME_NONE;
+  smeta->average_qp = -1;
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_video_enc_stats_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstOMXVideoEncStatsMeta *smeta = (GstOMXVideoEncStatsMeta *) meta;
+  GstOMXVideoEncStatsMeta *dmeta;
+
+  /* The statistics are about the whole frame */
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  dmeta = gst_buffer_add_omx_video_enc_stats_meta (dest);
+  if (!dmeta)
+    return FALSE;
+
+  dmeta->size = smeta->size;
+  dmeta->frame_type = smeta->frame_type;
+  dmeta->keyframe = smeta->keyframe;
+  dmeta->latency = smeta->latency;
+  dmeta->average_qp = smeta->average_qp;
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_omx_video_enc_stats_meta_get_info (void)
+{
+  static const GstMetaInfo *info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & info)) {
+    const GstMetaInfo *meta =
+        gst_meta_register (GST_OMX_VIDEO_ENC_STATS_META_API_TYPE,
+        "GstOMXVideoEncStatsMeta", sizeof (GstOMXVideoEncStatsMeta),
+        gst_omx_video_enc_stats_meta_init, NULL,
+        gst_omx_video_enc_stats_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & info, (GstMetaInfo *) meta);
+  }
+  return info;
+}
+
+GstOMXVideoEncStatsMeta *
+gst_buffer_add_omx_video_enc_stats_meta (GstBuffer * buffer)
+{
+  return (GstOMXVideoEncStatsMeta *) gst_buffer_add_meta (buffer,
+      GST_OMX_VIDEO_ENC_STATS_META_INFO, NULL);
+}
+
+const gchar *
+gst_omx_video_enc_frame_type_to_string (GstOMXVideoEncFrameType type)
+{
+  switch (type) {
+    case GST_OMX_VIDEO_ENC_FRAME_TYPE_I:
+      return "I";
+    case GST_OMX_VIDEO_ENC_FRAME_TYPE_P:
+      return "P";
+    case GST_OMX_VIDEO_ENC_FRAME_TYPE_B:
+      return "B";
+    default:
+      break;
+  }
+
+  return "unknown";
+}
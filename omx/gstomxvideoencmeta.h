@@ -0,0 +1,74 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_OMX_VIDEO_ENC_META_H__
+#define __GST_OMX_VIDEO_ENC_META_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_OMX_VIDEO_ENC_STATS_META_API_TYPE \
+  (gst_omx_video_enc_stats_meta_api_get_type())
+#define GST_OMX_VIDEO_ENC_STATS_META_INFO \
+  (gst_omx_video_enc_stats_meta_get_info())
+
+#define gst_buffer_get_omx_video_enc_stats_meta(b) \
+  ((GstOMXVideoEncStatsMeta*)gst_buffer_get_meta((b),GST_OMX_VIDEO_ENC_STATS_META_API_TYPE))
+
+typedef struct _GstOMXVideoEncStatsMeta GstOMXVideoEncStatsMeta;
+
+typedef enum
+{
+  GST_OMX_VIDEO_ENC_FRAME_TYPE_UNKNOWN,
+  GST_OMX_VIDEO_ENC_FRAME_TYPE_I,
+  GST_OMX_VIDEO_ENC_FRAME_TYPE_P,
+  GST_OMX_VIDEO_ENC_FRAME_TYPE_B
+} GstOMXVideoEncFrameType;
+
+/* Statistics of one encoded frame */
+struct _GstOMXVideoEncStatsMeta
+{
+  GstMeta meta;
+
+  /* Encoded size in bytes, including slices pushed before */
+  gsize size;
+  GstOMXVideoEncFrameType frame_type;
+  gboolean keyframe;
+  /* Time from passing the frame to the component until it
+   * was encoded, or GST_CLOCK_TIME_NONE */
+  GstClockTime latency;
+  /* Average quantizer, or -1 if the component doesn't report it */
+  gint average_qp;
+};
+
+GType gst_omx_video_enc_stats_meta_api_get_type (void);
+const GstMetaInfo *gst_omx_video_enc_stats_meta_get_info (void);
+
+GstOMXVideoEncStatsMeta *gst_buffer_add_omx_video_enc_stats_meta (GstBuffer *
+    buffer);
+
+const gchar *gst_omx_video_enc_frame_type_to_string (GstOMXVideoEncFrameType
+    type);
+
+G_END_DECLS
+
+#endif /* __GST_OMX_VIDEO_ENC_META_H__ */